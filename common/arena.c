@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "buffer.h"
+
+#define SCRATCH_MIN_CLASS 12   // 4 KiB.
+#define SCRATCH_CLASSES 48
+
+#define POISON 0xFF   // Every byte 0xFF reads back as a NaN double.
+
+static size_t align_up(size_t bytes) {
+    return (bytes + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+}
+
+#ifdef MEMORY_DEBUG
+static void misuse(const char *what, const void *p) {
+    fprintf(stderr, "Memory error: %s (%p)\n", what, p);
+    exit(EXIT_FAILURE);
+}
+#endif
+
+// ---- Arena ----
+
+void arena_init(arena_t *a) {
+    a->base = NULL;
+    a->capacity = a->used = a->high_water = 0;
+}
+
+void arena_init_block(arena_t *a, void *block, size_t bytes) {
+    a->base = (char *)block;
+    a->capacity = bytes;
+    a->used = a->high_water = 0;
+}
+
+void arena_reserve(arena_t *a, size_t bytes) {
+    arena_reset(a, 0);
+    if (bytes > a->capacity) {
+        buffer_free(a->base);
+        a->base = (char *)buffer_alloc(bytes);
+        a->capacity = bytes;
+    }
+}
+
+void *arena_alloc(arena_t *a, size_t bytes) {
+    size_t size = align_up(bytes);
+    if (size > a->capacity - a->used) {
+        fprintf(stderr, "Arena exhausted: %zu bytes requested, %zu of %zu in use\n", bytes,
+                a->used, a->capacity);
+        exit(EXIT_FAILURE);
+    }
+    void *p = a->base + a->used;
+    a->used += size;
+    if (a->used > a->high_water) {
+        a->high_water = a->used;
+    }
+    return p;
+}
+
+void arena_reset(arena_t *a, size_t mark) {
+#ifdef MEMORY_DEBUG
+    if (mark > a->used) {
+        misuse("arena reset to a mark past the allocation pointer", a->base + mark);
+    }
+    memset(a->base + mark, POISON, a->used - mark);
+#endif
+    a->used = mark;
+}
+
+void arena_release(arena_t *a) {
+    buffer_free(a->base);
+    arena_init(a);
+}
+
+size_t arena_matrix_bytes(int rows, int cols, int padded) {
+    int ld = padded ? matrix_padded_ld(cols) : cols;
+    return align_up((size_t)rows * ld * sizeof(double));
+}
+
+matrix_t arena_matrix(arena_t *a, int rows, int cols, int padded) {
+    matrix_t m;
+    m.rows = rows;
+    m.cols = cols;
+    m.ld = padded ? matrix_padded_ld(cols) : cols;
+    m.data = (double *)arena_alloc(a, (size_t)rows * m.ld * sizeof(double));
+    return m;
+}
+
+// ---- Pool ----
+
+// Sits in the MATRIX_ALIGNMENT bytes in front of each block, so the block
+// itself stays aligned.
+struct pool_header {
+    pool_header_t *next_free;
+    pool_header_t *next_block;
+    pool_t *owner;
+    int in_use;
+};
+
+static void *block_of(pool_header_t *h) {
+    return (char *)h + MATRIX_ALIGNMENT;
+}
+
+static pool_header_t *header_of(void *p) {
+    return (pool_header_t *)((char *)p - MATRIX_ALIGNMENT);
+}
+
+// Caller holds pool->lock.
+static pool_header_t *pool_grow(pool_t *pool) {
+    pool_header_t *h = (pool_header_t *)aligned_alloc(MATRIX_ALIGNMENT,
+                                                      MATRIX_ALIGNMENT + pool->block_size);
+    if (!h) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    h->next_free = NULL;
+    h->next_block = pool->blocks;
+    h->owner = pool;
+    h->in_use = 0;
+    pool->blocks = h;
+    pool->allocated++;
+    return h;
+}
+
+void pool_init(pool_t *pool, size_t block_size, int prealloc) {
+    pool->block_size = align_up(block_size ? block_size : 1);
+    pool->free_list = NULL;
+    pool->blocks = NULL;
+    pool->allocated = pool->outstanding = 0;
+    pthread_mutex_init(&pool->lock, NULL);
+    for (int i = 0; i < prealloc; i++) {
+        pool_header_t *h = pool_grow(pool);
+        h->next_free = pool->free_list;
+        pool->free_list = h;
+    }
+}
+
+void *pool_get(pool_t *pool) {
+    pthread_mutex_lock(&pool->lock);
+    pool_header_t *h = pool->free_list;
+    if (h) {
+        pool->free_list = h->next_free;
+    } else {
+        h = pool_grow(pool);
+    }
+    h->in_use = 1;
+    pool->outstanding++;
+    pthread_mutex_unlock(&pool->lock);
+    return block_of(h);
+}
+
+void pool_put(pool_t *pool, void *p) {
+    pool_header_t *h = header_of(p);
+    pthread_mutex_lock(&pool->lock);
+#ifdef MEMORY_DEBUG
+    // Walk the pool's own list rather than trusting the header, which a
+    // foreign pointer would not have. The checks, the poison and the push
+    // share one hold of the lock, so two threads returning the same block
+    // cannot both pass the in_use test.
+    pool_header_t *b = pool->blocks;
+    while (b && b != h) {
+        b = b->next_block;
+    }
+    if (b == NULL) {
+        misuse("pool_put of a block this pool did not allocate", p);
+    }
+    if (!h->in_use) {
+        misuse("double free of a pool block", p);
+    }
+    memset(p, POISON, pool->block_size);
+#endif
+    h->in_use = 0;
+    h->next_free = pool->free_list;
+    pool->free_list = h;
+    pool->outstanding--;
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_destroy(pool_t *pool) {
+#ifdef MEMORY_DEBUG
+    if (pool->outstanding > 0) {
+        fprintf(stderr, "Memory leak: %d pool block(s) of %zu bytes never returned:",
+                pool->outstanding, pool->block_size);
+        for (pool_header_t *h = pool->blocks; h; h = h->next_block) {
+            if (h->in_use) {
+                fprintf(stderr, " %p", block_of(h));
+            }
+        }
+        fprintf(stderr, "\n");
+    }
+#endif
+    pool_header_t *h = pool->blocks;
+    while (h) {
+        pool_header_t *next = h->next_block;
+        free(h);
+        h = next;
+    }
+    pool->free_list = pool->blocks = NULL;
+    pool->allocated = pool->outstanding = 0;
+    pthread_mutex_destroy(&pool->lock);
+}
+
+// ---- Scratch ----
+
+static pool_t scratch_pools[SCRATCH_CLASSES];
+static pthread_mutex_t scratch_lock = PTHREAD_MUTEX_INITIALIZER;
+
+void *scratch_get(size_t bytes) {
+    int c = SCRATCH_MIN_CLASS;
+    while (c < SCRATCH_CLASSES - 1 && ((size_t)1 << c) < bytes) {
+        c++;
+    }
+    if (((size_t)1 << c) < bytes) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    pthread_mutex_lock(&scratch_lock);
+    if (scratch_pools[c].block_size == 0) {
+        pool_init(&scratch_pools[c], (size_t)1 << c, 0);
+    }
+    pthread_mutex_unlock(&scratch_lock);
+    return pool_get(&scratch_pools[c]);
+}
+
+void scratch_put(void *p) {
+    if (p) {
+        pool_put(header_of(p)->owner, p);
+    }
+}
+
+int scratch_allocated(void) {
+    int total = 0;
+    pthread_mutex_lock(&scratch_lock);
+    for (int c = 0; c < SCRATCH_CLASSES; c++) {
+        if (scratch_pools[c].block_size) {
+            pthread_mutex_lock(&scratch_pools[c].lock);
+            total += scratch_pools[c].allocated;
+            pthread_mutex_unlock(&scratch_pools[c].lock);
+        }
+    }
+    pthread_mutex_unlock(&scratch_lock);
+    return total;
+}
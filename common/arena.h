@@ -0,0 +1,88 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <pthread.h>
+#include <stddef.h>
+
+#include "matrix.h"
+
+// Allocators for memory that is reused across calls, so repeated multiplies
+// do no heap allocation once they reach steady state.
+//
+// Built with -DMEMORY_DEBUG, both check their own use instead of relying on
+// Valgrind alone: released memory is poisoned with 0xFF bytes (NaN doubles)
+// so use-after-release shows up in results, arena_reset rejects marks past
+// the allocation pointer, pool_put reports double frees and foreign
+// pointers, and pool_destroy lists the blocks that were never returned.
+// Misuse prints a message and exits.
+
+// Bump-pointer arena over one buffer_alloc block. Allocations are
+// MATRIX_ALIGNMENT aligned and are released in bulk, back to a mark.
+typedef struct {
+    char *base;
+    size_t capacity;     // Bytes.
+    size_t used;         // Bytes, rounded to MATRIX_ALIGNMENT per allocation.
+    size_t high_water;   // Largest used so far.
+} arena_t;
+
+// Empty arena (no block until arena_reserve).
+void arena_init(arena_t *a);
+
+// Arena over a block the caller owns (e.g. from scratch_get), bytes long.
+// Never arena_reserve or arena_release it; the caller frees the block.
+void arena_init_block(arena_t *a, void *block, size_t bytes);
+
+// Make room for at least bytes and release everything. The block is only
+// replaced when it is too small, so a steady-state caller never allocates.
+void arena_reserve(arena_t *a, size_t bytes);
+
+// Aligned allocation; exits if the reserved capacity is exceeded.
+void *arena_alloc(arena_t *a, size_t bytes);
+
+// Release everything allocated after mark (a previous a->used; 0 = all).
+void arena_reset(arena_t *a, size_t mark);
+
+// Free the block.
+void arena_release(arena_t *a);
+
+// Bytes arena_matrix takes for a rows x cols matrix, to size arena_reserve.
+size_t arena_matrix_bytes(int rows, int cols, int padded);
+
+// rows x cols matrix_t whose data lives in the arena (never matrix_free it).
+matrix_t arena_matrix(arena_t *a, int rows, int cols, int padded);
+
+// Fixed-size block pool: blocks are kept on a free list when returned and
+// handed out again; the heap is only used when the list is empty. Blocks are
+// MATRIX_ALIGNMENT aligned. pool_get and pool_put are thread-safe.
+typedef struct pool_header pool_header_t;
+
+typedef struct {
+    size_t block_size;
+    pool_header_t *free_list;
+    pool_header_t *blocks;   // Every block the pool owns, for pool_destroy.
+    int allocated;           // Blocks taken from the heap so far.
+    int outstanding;         // Blocks handed out and not returned.
+    pthread_mutex_t lock;
+} pool_t;
+
+// Pool of block_size-byte blocks with prealloc of them allocated up front.
+void pool_init(pool_t *pool, size_t block_size, int prealloc);
+void *pool_get(pool_t *pool);
+void pool_put(pool_t *pool, void *p);
+
+// Free every block, including outstanding ones.
+void pool_destroy(pool_t *pool);
+
+// Process-wide scratch buffers: one pool per power-of-two size class (at
+// least 4 KiB). For temporaries whose size varies between calls, such as
+// GEMM pack buffers. Thread-safe; the buffers are kept for the process. A
+// class grows until it covers the most buffers ever out at once (with the
+// GEMM engines, two per worker), then stops allocating.
+void *scratch_get(size_t bytes);
+void scratch_put(void *p);   // NULL is ignored.
+
+// Blocks the scratch pools have taken from the heap so far; constant once
+// the callers reach steady state.
+int scratch_allocated(void);
+
+#endif
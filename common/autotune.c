@@ -0,0 +1,353 @@
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "autotune.h"
+#include "precision.h"
+#include "timing.h"
+
+#define TUNE_WARMUP 1
+#define TUNE_REPS 3
+// The i-j-k / i-k-j loops are only tried up to this many flops: past it
+// they lose to the tiled engine by an order of magnitude and would dominate
+// the search time.
+#define TUNE_ORDER_MAX_FLOPS (2.0 * 512 * 512 * 512)
+
+// ---- Table: open addressing on the key string, so lookup is O(1) ----
+
+typedef struct {
+    char key[4 * GEMM_TUNE_NAME];   // "cpu dtype m n k"; empty = free slot.
+    gemm_tune_config_t cfg;
+} tune_entry_t;
+
+#define TABLE_SLOTS (2 * GEMM_TUNE_MAX_ENTRIES)   // Power of two, at most half full.
+
+static tune_entry_t table[TABLE_SLOTS];
+static int table_count = 0;
+
+static const char *order_names[] = {"ijk", "ikj", "blocked"};
+
+static uint32_t hash_key(const char *key) {
+    uint32_t h = 2166136261u;   // FNV-1a.
+    for (; *key; key++) {
+        h = (h ^ (unsigned char)*key) * 16777619u;
+    }
+    return h;
+}
+
+static tune_entry_t *table_slot(const char *key) {
+    uint32_t i = hash_key(key) & (TABLE_SLOTS - 1);
+    while (table[i].key[0] && strcmp(table[i].key, key) != 0) {
+        i = (i + 1) & (TABLE_SLOTS - 1);
+    }
+    return &table[i];
+}
+
+static void make_key(char *key, size_t size, const char *cpu, const char *dtype, int m, int n, int k) {
+    snprintf(key, size, "%s %s %d %d %d", cpu, dtype, m, n, k);
+}
+
+static void table_put(const char *key, const gemm_tune_config_t *cfg) {
+    tune_entry_t *e = table_slot(key);
+    if (!e->key[0]) {
+        if (table_count == GEMM_TUNE_MAX_ENTRIES) {
+            fprintf(stderr, "Warning: tuning table full, entry not stored\n");
+            return;
+        }
+        table_count++;
+        snprintf(e->key, sizeof(e->key), "%s", key);
+    }
+    e->cfg = *cfg;
+}
+
+const char *gemm_tune_cpu_model(void) {
+    static char model[GEMM_TUNE_NAME * 2] = "";
+    if (model[0]) {
+        return model;
+    }
+    snprintf(model, sizeof(model), "unknown");
+    FILE *f = fopen("/proc/cpuinfo", "r");
+    if (f) {
+        char line[256];
+        while (fgets(line, sizeof(line), f)) {
+            char *colon = strchr(line, ':');
+            if (strncmp(line, "model name", 10) == 0 && colon) {
+                snprintf(model, sizeof(model), "%s", colon + 2);
+                break;
+            }
+        }
+        fclose(f);
+    }
+    // One token: spaces become '_', the trailing newline goes.
+    for (char *p = model; *p; p++) {
+        if (*p == '\n') {
+            *p = '\0';
+            break;
+        }
+        if (*p == ' ' || *p == '\t') {
+            *p = '_';
+        }
+    }
+    return model;
+}
+
+// ---- Cache file: one entry per line, '#' starts a comment ----
+// cpu dtype m n k order kernel mc kc nc threads gflops
+
+int gemm_tune_load(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        return 0;
+    }
+    char line[512];
+    int read = 0;
+    while (fgets(line, sizeof(line), f)) {
+        char cpu[GEMM_TUNE_NAME * 2], dtype[GEMM_TUNE_NAME], order[GEMM_TUNE_NAME];
+        gemm_tune_config_t cfg;
+        int m, n, k;
+        if (line[0] == '#' ||
+            sscanf(line, "%63s %31s %d %d %d %31s %31s %d %d %d %d %lf", cpu, dtype, &m, &n, &k, order,
+                   cfg.kernel, &cfg.blocking.mc, &cfg.blocking.kc, &cfg.blocking.nc, &cfg.threads,
+                   &cfg.gflops) != 12) {
+            continue;
+        }
+        cfg.order = -1;
+        for (int o = 0; o < 3; o++) {
+            if (strcmp(order, order_names[o]) == 0) {
+                cfg.order = o;
+            }
+        }
+        if (cfg.order < 0) {
+            continue;
+        }
+        char key[4 * GEMM_TUNE_NAME];
+        make_key(key, sizeof(key), cpu, dtype, m, n, k);
+        table_put(key, &cfg);
+        read++;
+    }
+    fclose(f);
+    return read;
+}
+
+int gemm_tune_save(const char *path) {
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    fprintf(f, "# cpu dtype m n k order kernel mc kc nc threads gflops\n");
+    for (int i = 0; i < TABLE_SLOTS; i++) {
+        const tune_entry_t *e = &table[i];
+        if (e->key[0]) {
+            fprintf(f, "%s %s %s %d %d %d %d %.2f\n", e->key, order_names[e->cfg.order], e->cfg.kernel,
+                    e->cfg.blocking.mc, e->cfg.blocking.kc, e->cfg.blocking.nc, e->cfg.threads,
+                    e->cfg.gflops);
+        }
+    }
+    return fclose(f) == 0 ? 0 : -1;
+}
+
+const gemm_tune_config_t *gemm_tune_lookup(const char *dtype, int m, int k, int n) {
+    char key[4 * GEMM_TUNE_NAME];
+    make_key(key, sizeof(key), gemm_tune_cpu_model(), dtype, m, n, k);
+    const tune_entry_t *e = table_slot(key);
+    return e->key[0] ? &e->cfg : NULL;
+}
+
+void gemm_tune_describe(const gemm_tune_config_t *cfg, char *buf, size_t size) {
+    if (cfg->order == GEMM_ORDER_BLOCKED) {
+        snprintf(buf, size, "blocked %s MC=%d KC=%d NC=%d threads %d", cfg->kernel, cfg->blocking.mc,
+                 cfg->blocking.kc, cfg->blocking.nc, cfg->threads);
+    } else {
+        snprintf(buf, size, "%s threads %d", order_names[cfg->order], cfg->threads);
+    }
+}
+
+void gemm_tune_apply(const gemm_tune_config_t *cfg) {
+    if (strcmp(cfg->kernel, "auto") != 0 && gemm_kernel_force(cfg->kernel) != 0) {
+        fprintf(stderr, "Warning: tuned kernel '%s' is not available\n", cfg->kernel);
+    }
+    if (gemm_get_num_threads() != cfg->threads) {
+        gemm_set_num_threads(cfg->threads);
+    }
+}
+
+// A double matrix_t seen as a typed matrix (same layout).
+static typed_matrix_t as_typed(const matrix_t *m) {
+    typed_matrix_t t = {m->data, m->rows, m->cols, m->ld, sizeof(double)};
+    return t;
+}
+
+void gemm_tune_multiply(const gemm_tune_config_t *cfg, const matrix_t *A, const matrix_t *B,
+                        matrix_t *C) {
+    if (cfg->order == GEMM_ORDER_BLOCKED) {
+        matrix_multiply_blocked(A, B, C, &cfg->blocking);
+    } else {
+        // The i-j-k / i-k-j loops of mxm.c, as generated in precision.c.
+        typed_matrix_t a = as_typed(A), b = as_typed(B), c = as_typed(C);
+        gemm_precision_find("double")->multiply(&a, &b, &c, cfg->order, NULL);
+    }
+}
+
+// ---- Search ----
+
+typedef struct {
+    const gemm_precision_t *p;
+    int packed;   // double: matrix_multiply_blocked and its kernels.
+    matrix_t A, B, C;
+    typed_matrix_t TA, TB, TC;
+    const gemm_tune_config_t *cfg;
+} search_ctx_t;
+
+static void search_body(void *p) {
+    search_ctx_t *ctx = (search_ctx_t *)p;
+    if (ctx->packed) {
+        gemm_tune_multiply(ctx->cfg, &ctx->A, &ctx->B, &ctx->C);
+    } else {
+        ctx->p->multiply(&ctx->TA, &ctx->TB, &ctx->TC, ctx->cfg->order, &ctx->cfg->blocking);
+    }
+}
+
+static void search_reset(void *p) {
+    search_ctx_t *ctx = (search_ctx_t *)p;
+    if (ctx->packed) {
+        matrix_fill(&ctx->C, 0.0);
+    } else {
+        typed_matrix_zero(&ctx->TC);
+    }
+}
+
+// Time cfg; keeps it in *best if faster. Returns its GFLOP/s.
+static double try_config(search_ctx_t *ctx, gemm_tune_config_t cfg, gemm_tune_config_t *best,
+                         double gflop, FILE *log) {
+    gemm_tune_apply(&cfg);
+    ctx->packed = ctx->p == gemm_precision_find("double") && cfg.order == GEMM_ORDER_BLOCKED;
+    ctx->cfg = &cfg;
+    double ms = timing_run(search_body, search_reset, ctx, TUNE_WARMUP, TUNE_REPS).median;
+    cfg.gflops = gflop / (ms / 1000.0);
+    if (log) {
+        char desc[128];
+        gemm_tune_describe(&cfg, desc, sizeof(desc));
+        fprintf(log, "  %-56s %8.2f GFLOP/s\n", desc, cfg.gflops);
+    }
+    if (cfg.gflops > best->gflops) {
+        *best = cfg;
+    }
+    return cfg.gflops;
+}
+
+// Scale a block size, keeping it a positive multiple of step.
+static int scaled(int value, double factor, int step) {
+    int v = (int)(value * factor) / step * step;
+    return v < step ? step : v;
+}
+
+gemm_tune_config_t gemm_tune_search(const char *dtype, int m, int k, int n, FILE *log) {
+    search_ctx_t ctx;
+    memset(&ctx, 0, sizeof(ctx));
+    ctx.p = gemm_precision_find(dtype);
+    if (ctx.p == NULL) {
+        fprintf(stderr, "Unknown dtype '%s' (expected %s)\n", dtype, GEMM_PRECISION_NAMES);
+        exit(EXIT_FAILURE);
+    }
+    int is_double = strcmp(ctx.p->name, "double") == 0;
+    char saved_kernel[GEMM_TUNE_NAME];
+    snprintf(saved_kernel, sizeof(saved_kernel), "%s", gemm_kernel_select()->name);
+    int saved_threads = gemm_get_num_threads();
+
+    // Operands: uniform data, converted once for the typed engines.
+    srand(42);
+    ctx.A = matrix_create(m, k, 1);
+    ctx.B = matrix_create(k, n, 1);
+    ctx.C = matrix_create(m, n, 1);
+    matrix_fill_uniform(&ctx.A, -1.0, 1.0);
+    matrix_fill_uniform(&ctx.B, -1.0, 1.0);
+    ctx.TA = typed_matrix_create(m, k, ctx.p->in_size, 1);
+    ctx.TB = typed_matrix_create(k, n, ctx.p->in_size, 1);
+    ctx.TC = typed_matrix_create(m, n, ctx.p->acc_size, 1);
+    typed_matrix_from_double(ctx.p, &ctx.TA, &ctx.A);
+    typed_matrix_from_double(ctx.p, &ctx.TB, &ctx.B);
+
+    double gflop = 2.0 * m * n * k / 1e9;
+    gemm_tune_config_t best, cfg;
+    memset(&best, 0, sizeof(best));
+    memset(&cfg, 0, sizeof(cfg));
+    cfg.order = GEMM_ORDER_BLOCKED;
+    cfg.threads = 1;
+    snprintf(cfg.kernel, sizeof(cfg.kernel), "auto");
+
+    if (log) {
+        fprintf(log, "Tuning %s %dx%dx%d on %s\n", ctx.p->name, m, k, n, gemm_tune_cpu_model());
+    }
+
+    // 1. Kernel (double only: the typed engines pick their SIMD width themselves).
+    if (is_double) {
+        const char *kernels[] = {"scalar", "avx2", "avx512"};
+        for (int i = 0; i < 3; i++) {
+            if (gemm_kernel_force(kernels[i]) != 0) {
+                continue;
+            }
+            snprintf(cfg.kernel, sizeof(cfg.kernel), "%s", kernels[i]);
+            cfg.blocking = gemm_blocking_auto(gemm_kernel_select());
+            try_config(&ctx, cfg, &best, gflop, log);
+        }
+    } else {
+        cfg.blocking = gemm_precision_blocking(ctx.p);
+        try_config(&ctx, cfg, &best, gflop, log);
+    }
+
+    // 2. Block sizes around the cache-derived ones, one loop at a time.
+    const double factors[] = {0.25, 0.5, 0.75, 1.5, 2.0};
+    for (int dim = 0; dim < 3; dim++) {
+        gemm_tune_config_t base = best;
+        for (int f = 0; f < 5; f++) {
+            cfg = base;
+            if (dim == 0) {
+                cfg.blocking.kc = scaled(base.blocking.kc, factors[f], 8);
+            } else if (dim == 1) {
+                cfg.blocking.mc = scaled(base.blocking.mc, factors[f], 8);
+            } else {
+                cfg.blocking.nc = scaled(base.blocking.nc, factors[f], 16);
+            }
+            try_config(&ctx, cfg, &best, gflop, log);
+        }
+    }
+
+    // 3. Thread count (the typed engines are single-threaded).
+    if (is_double) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        gemm_tune_config_t base = best;
+        // Powers of two, then every online CPU.
+        for (long t = 2; t <= cpus; t = t < cpus && t * 2 > cpus ? cpus : t * 2) {
+            cfg = base;
+            cfg.threads = (int)t;
+            try_config(&ctx, cfg, &best, gflop, log);
+        }
+    }
+
+    // 4. The untiled loop orders of mxm.c, for small problems.
+    if (2.0 * m * n * k <= TUNE_ORDER_MAX_FLOPS) {
+        for (int order = GEMM_ORDER_IJK; order <= GEMM_ORDER_IKJ; order++) {
+            cfg = best;
+            cfg.order = order;
+            cfg.threads = 1;
+            snprintf(cfg.kernel, sizeof(cfg.kernel), "auto");
+            try_config(&ctx, cfg, &best, gflop, log);
+        }
+    }
+
+    char key[4 * GEMM_TUNE_NAME];
+    make_key(key, sizeof(key), gemm_tune_cpu_model(), ctx.p->name, m, n, k);
+    table_put(key, &best);
+
+    gemm_kernel_force(saved_kernel);
+    gemm_set_num_threads(saved_threads);
+    matrix_free(&ctx.A);
+    matrix_free(&ctx.B);
+    matrix_free(&ctx.C);
+    typed_matrix_free(&ctx.TA);
+    typed_matrix_free(&ctx.TB);
+    typed_matrix_free(&ctx.TC);
+    return best;
+}
@@ -0,0 +1,56 @@
+#ifndef AUTOTUNE_H
+#define AUTOTUNE_H
+
+#include <stdio.h>
+
+#include "gemm.h"
+
+#define GEMM_TUNE_NAME 32             // Buffer size for kernel / dtype / CPU names.
+#define GEMM_TUNE_MAX_ENTRIES 1024    // Capacity of the in-memory tuning table.
+#define GEMM_TUNE_DEFAULT_CACHE "gemm_tuning.txt"
+
+// Best configuration found for one (CPU model, dtype, M, N, K).
+typedef struct {
+    int order;                      // GEMM_ORDER_IJK, _IKJ or _BLOCKED (precision.h).
+    char kernel[GEMM_TUNE_NAME];    // gemm kernel name for double + blocked, else "auto".
+    gemm_blocking_t blocking;       // GEMM_ORDER_BLOCKED only.
+    int threads;                    // 1 for every engine but the double blocked one.
+    double gflops;                  // Measured when the entry was tuned.
+} gemm_tune_config_t;
+
+// CPU model string ("model name" in /proc/cpuinfo, spaces replaced by '_'),
+// the first part of every cache key.
+const char *gemm_tune_cpu_model(void);
+
+// Read a tuning cache into the in-memory table (entries for other CPU
+// models are kept, so saving preserves them). Returns the number of entries
+// read; a missing file is not an error (0).
+int gemm_tune_load(const char *path);
+
+// Write every entry back to path. Returns 0 on success.
+int gemm_tune_save(const char *path);
+
+// Hash lookup for this CPU: the entry for an (m x k) * (k x n) multiply in
+// dtype, or NULL.
+const gemm_tune_config_t *gemm_tune_lookup(const char *dtype, int m, int k, int n);
+
+// Search kernel, block sizes, loop order and thread count for an
+// (m x k) * (k x n) multiply in dtype ("double", "float", "bf16") and store
+// the winner in the table (replacing any previous entry). Coordinate
+// descent: each parameter in turn is swept with the others fixed at their
+// best so far. Candidates are logged to log if not NULL. The GEMM kernel
+// and thread settings are restored afterwards.
+gemm_tune_config_t gemm_tune_search(const char *dtype, int m, int k, int n, FILE *log);
+
+// One-line description ("blocked avx512 MC=.. KC=.. NC=.. threads 2").
+void gemm_tune_describe(const gemm_tune_config_t *cfg, char *buf, size_t size);
+
+// Select cfg's kernel (if it is a gemm kernel name) and thread count.
+void gemm_tune_apply(const gemm_tune_config_t *cfg);
+
+// Run a double multiply, C += A * B, with cfg. Call gemm_tune_apply first;
+// keeping that out of the call means repetitions do not rebuild the pool.
+void gemm_tune_multiply(const gemm_tune_config_t *cfg, const matrix_t *A, const matrix_t *B,
+                        matrix_t *C);
+
+#endif
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "buffer.h"
+
+#define BUFFER_ALIGNMENT 64
+#define HUGE_2M (2UL << 20)
+#define HUGE_1G (1UL << 30)
+#define MAX_MAPPINGS 256
+
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+
+static buffer_backing_t backing = BUFFER_MALLOC;
+static int populate_pages = 0;
+
+// munmap needs the length, so mmap-backed buffers are remembered here.
+// Anything not found is a malloc-family pointer.
+static struct {
+    void *p;
+    size_t bytes;
+} mappings[MAX_MAPPINGS];
+static pthread_mutex_t mappings_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static const struct {
+    const char *name;
+    const char *description;
+} backings[] = {
+    [BUFFER_MALLOC] = {"malloc", "malloc (aligned_alloc)"},
+    [BUFFER_MEMALIGN] = {"memalign", "posix_memalign (2 MiB aligned)"},
+    [BUFFER_THP] = {"thp", "mmap + MADV_HUGEPAGE"},
+    [BUFFER_HUGE_2M] = {"huge2m", "mmap + MAP_HUGETLB (2 MiB pages)"},
+    [BUFFER_HUGE_1G] = {"huge1g", "mmap + MAP_HUGETLB (1 GiB pages)"},
+};
+
+int buffer_set_backing(const char *name) {
+    for (size_t i = 0; i < sizeof(backings) / sizeof(backings[0]); i++) {
+        if (strcmp(backings[i].name, name) == 0) {
+            backing = (buffer_backing_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void buffer_set_populate(int populate) {
+    populate_pages = populate;
+}
+
+const char *buffer_backing_name(void) {
+    static char text[96];
+    snprintf(text, sizeof(text), "%s%s", backings[backing].description,
+             populate_pages ? ", prefaulted" : "");
+    return text;
+}
+
+int buffer_parse_arg(int argc, char **argv, int *i) {
+    if (strcmp(argv[*i], "--populate") == 0) {
+        buffer_set_populate(1);
+        return 1;
+    }
+    if (strcmp(argv[*i], "--alloc") == 0 && *i + 1 < argc) {
+        if (buffer_set_backing(argv[++*i]) != 0) {
+            fprintf(stderr, "Unknown allocator: %s (malloc, memalign, thp, huge2m, huge1g)\n",
+                    argv[*i]);
+            exit(EXIT_FAILURE);
+        }
+        return 1;
+    }
+    return 0;
+}
+
+static void remember_mapping(void *p, size_t bytes) {
+    pthread_mutex_lock(&mappings_lock);
+    for (int i = 0; i < MAX_MAPPINGS; i++) {
+        if (!mappings[i].p) {
+            mappings[i].p = p;
+            mappings[i].bytes = bytes;
+            pthread_mutex_unlock(&mappings_lock);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&mappings_lock);
+    fprintf(stderr, "Too many mapped buffers\n");
+    exit(EXIT_FAILURE);
+}
+
+// Anonymous mapping of bytes (a multiple of align) starting on an align
+// boundary: over-map by align, then trim both ends.
+static void *map_aligned(size_t bytes, size_t align, int flags) {
+    size_t span = bytes + align;
+    char *raw = mmap(NULL, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+    if (raw == MAP_FAILED) {
+        return NULL;
+    }
+    char *p = (char *)(((size_t)raw + align - 1) & ~(align - 1));
+    if (p > raw) {
+        munmap(raw, (size_t)(p - raw));
+    }
+    if (raw + span > p + bytes) {
+        munmap(p + bytes, (size_t)(raw + span - (p + bytes)));
+    }
+    return p;
+}
+
+static void fail(const char *why) {
+    fprintf(stderr, "Memory allocation failed (%s)\n", why);
+    exit(EXIT_FAILURE);
+}
+
+void *buffer_alloc(size_t bytes) {
+    if (bytes == 0) {
+        bytes = BUFFER_ALIGNMENT;
+    }
+    int touch_pages = populate_pages;   // Cleared where MAP_POPULATE does it.
+    void *p = NULL;
+    size_t mapped = 0;
+
+    switch (backing) {
+    case BUFFER_MALLOC:
+        // aligned_alloc requires the size to be a multiple of the alignment.
+        p = aligned_alloc(BUFFER_ALIGNMENT, (bytes + BUFFER_ALIGNMENT - 1) / BUFFER_ALIGNMENT * BUFFER_ALIGNMENT);
+        if (!p) {
+            fail("malloc");
+        }
+        break;
+    case BUFFER_MEMALIGN:
+        if (posix_memalign(&p, HUGE_2M, bytes) != 0) {
+            fail("posix_memalign");
+        }
+        break;
+    case BUFFER_THP:
+        mapped = (bytes + HUGE_2M - 1) / HUGE_2M * HUGE_2M;
+        // MADV_HUGEPAGE has to come before the pages are touched, so this one
+        // is prefaulted by hand rather than with MAP_POPULATE.
+        p = map_aligned(mapped, HUGE_2M, 0);
+        if (!p) {
+            fail("mmap");
+        }
+        if (madvise(p, mapped, MADV_HUGEPAGE) != 0) {
+            perror("madvise(MADV_HUGEPAGE)");
+        }
+        break;
+    case BUFFER_HUGE_2M:
+    case BUFFER_HUGE_1G: {
+        size_t page = backing == BUFFER_HUGE_2M ? HUGE_2M : HUGE_1G;
+        mapped = (bytes + page - 1) / page * page;
+        p = mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (populate_pages ? MAP_POPULATE : 0) |
+                     (backing == BUFFER_HUGE_2M ? MAP_HUGE_2MB : MAP_HUGE_1GB),
+                 -1, 0);
+        if (p == MAP_FAILED) {
+            fail(backing == BUFFER_HUGE_2M
+                     ? "no 2 MiB huge pages; reserve some in /proc/sys/vm/nr_hugepages"
+                     : "no 1 GiB huge pages; reserve some with hugepagesz=1G hugepages=N");
+        }
+        touch_pages = 0;
+        break;
+    }
+    }
+
+    if (mapped) {
+        remember_mapping(p, mapped);
+    }
+    if (touch_pages) {
+        long page = sysconf(_SC_PAGESIZE);
+        for (size_t off = 0; off < bytes; off += (size_t)page) {
+            ((volatile char *)p)[off] = 0;
+        }
+    }
+    return p;
+}
+
+void buffer_free(void *p) {
+    if (!p) {
+        return;
+    }
+    pthread_mutex_lock(&mappings_lock);
+    for (int i = 0; i < MAX_MAPPINGS; i++) {
+        if (mappings[i].p == p) {
+            size_t bytes = mappings[i].bytes;
+            mappings[i].p = NULL;
+            pthread_mutex_unlock(&mappings_lock);
+            munmap(p, bytes);
+            return;
+        }
+    }
+    pthread_mutex_unlock(&mappings_lock);
+    free(p);
+}
@@ -0,0 +1,40 @@
+#ifndef BUFFER_H
+#define BUFFER_H
+
+#include <stddef.h>
+
+// Backing store for the large benchmark buffers (arrays and matrices).
+typedef enum {
+    BUFFER_MALLOC,      // aligned_alloc, 64-byte aligned (default).
+    BUFFER_MEMALIGN,    // posix_memalign on a 2 MiB boundary.
+    BUFFER_THP,         // Anonymous mmap, 2 MiB aligned, madvise(MADV_HUGEPAGE).
+    BUFFER_HUGE_2M,     // mmap(MAP_HUGETLB), 2 MiB pages from the hugetlbfs pool.
+    BUFFER_HUGE_1G,     // mmap(MAP_HUGETLB), 1 GiB pages.
+} buffer_backing_t;
+
+// Select the backing for subsequent buffer_alloc calls by name ("malloc",
+// "memalign", "thp", "huge2m", "huge1g"). Returns 0, or -1 for an unknown name.
+int buffer_set_backing(const char *name);
+
+// With populate != 0, buffers are prefaulted at allocation (MAP_POPULATE for
+// mmap backings, one write per page otherwise). Note that this places every
+// page from the allocating thread, which overrides NUMA first-touch.
+void buffer_set_populate(int populate);
+
+// Human-readable description of the current setting, for result headers
+// (e.g. "mmap + MADV_HUGEPAGE, prefaulted").
+const char *buffer_backing_name(void);
+
+// Parse --alloc NAME / --populate at argv[*i], like timing_parse_arg.
+// Returns 1 (and advances *i past any value) if the argument was one of
+// them, 0 otherwise. Exits on an unknown backing name.
+int buffer_parse_arg(int argc, char **argv, int *i);
+
+// Allocate at least bytes (64-byte aligned) with the current backing.
+// Exits on failure, including when no huge pages are reserved.
+void *buffer_alloc(size_t bytes);
+
+// Release a buffer from buffer_alloc (NULL is ignored).
+void buffer_free(void *p);
+
+#endif
@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "cache_info.h"
+
+// Used when neither sysconf nor sysfs know a level.
+#define DEFAULT_L1D (32L * 1024)
+#define DEFAULT_L2 (256L * 1024)
+#define DEFAULT_L3 (8L * 1024 * 1024)
+#define DEFAULT_LINE 64
+
+static long sysconf_or_zero(int name) {
+    long v = sysconf(name);
+    return v > 0 ? v : 0;
+}
+
+// Read one line of a sysfs attribute into buf; returns 0 on success.
+static int read_sysfs(const char *dir, const char *attr, char *buf, size_t len) {
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+    FILE *fp = fopen(path, "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    int ok = fgets(buf, (int)len, fp) != NULL;
+    fclose(fp);
+    if (!ok) {
+        return -1;
+    }
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+// Fill missing levels from /sys/devices/system/cpu/cpu0/cache/index*/.
+static void probe_sysfs(cache_info_t *info) {
+    for (int idx = 0; idx < 16; idx++) {
+        char dir[128], level[16], type[32], size[32];
+        snprintf(dir, sizeof(dir), "/sys/devices/system/cpu/cpu0/cache/index%d", idx);
+        if (read_sysfs(dir, "level", level, sizeof(level)) != 0) {
+            break;
+        }
+        if (read_sysfs(dir, "type", type, sizeof(type)) != 0 ||
+            read_sysfs(dir, "size", size, sizeof(size)) != 0 ||
+            strcmp(type, "Instruction") == 0) {
+            continue;
+        }
+
+        // Sizes look like "48K" or "32M".
+        char *unit;
+        long bytes = strtol(size, &unit, 10);
+        if (*unit == 'K') bytes *= 1024;
+        else if (*unit == 'M') bytes *= 1024 * 1024;
+
+        int lvl = atoi(level);
+        if (lvl == 1 && info->l1d == 0) info->l1d = bytes;
+        else if (lvl == 2 && info->l2 == 0) info->l2 = bytes;
+        else if (lvl == 3 && info->l3 == 0) info->l3 = bytes;
+
+        char line[16];
+        if (info->line == 0 && read_sysfs(dir, "coherency_line_size", line, sizeof(line)) == 0) {
+            info->line = atoi(line);
+        }
+    }
+}
+
+const cache_info_t *cache_info_get(void) {
+    static cache_info_t info;
+    static int initialized = 0;
+    if (initialized) {
+        return &info;
+    }
+
+    info.l1d = sysconf_or_zero(_SC_LEVEL1_DCACHE_SIZE);
+    info.l2 = sysconf_or_zero(_SC_LEVEL2_CACHE_SIZE);
+    info.l3 = sysconf_or_zero(_SC_LEVEL3_CACHE_SIZE);
+    info.line = (int)sysconf_or_zero(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (info.l1d == 0 || info.l2 == 0 || info.l3 == 0 || info.line == 0) {
+        probe_sysfs(&info);
+    }
+
+    info.detected = info.l1d && info.l2 && info.l3;
+    if (info.l1d == 0) info.l1d = DEFAULT_L1D;
+    if (info.l2 == 0) info.l2 = DEFAULT_L2;
+    if (info.l3 == 0) info.l3 = DEFAULT_L3;
+    if (info.line == 0) info.line = DEFAULT_LINE;
+
+    initialized = 1;
+    return &info;
+}
@@ -0,0 +1,17 @@
+#ifndef CACHE_INFO_H
+#define CACHE_INFO_H
+
+// Data cache geometry of the host (bytes). Levels that cannot be detected
+// are filled with conservative defaults and flagged in `detected`.
+typedef struct {
+    long l1d;
+    long l2;
+    long l3;
+    int line;
+    int detected;   // 1 if every size came from sysconf or sysfs.
+} cache_info_t;
+
+// Detect once (sysconf, then /sys/devices/system/cpu/cpu0/cache) and cache the result.
+const cache_info_t *cache_info_get(void);
+
+#endif
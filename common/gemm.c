@@ -0,0 +1,965 @@
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "cache_info.h"
+#include "gemm.h"
+#include "gemm_stats.h"
+#include "thread_pool.h"
+#include "topology.h"
+
+static int min(int a, int b) {
+    return (a < b) ? a : b;
+}
+
+#define DOUBLES_PER_LINE (MATRIX_ALIGNMENT / (int)sizeof(double))
+
+// Software prefetch distance in rows of B (0 = off); see gemm_set_prefetch_distance.
+static int prefetch_rows = 0;
+
+void gemm_set_prefetch_distance(int rows) {
+    prefetch_rows = rows > 0 ? rows : 0;
+}
+
+int gemm_get_prefetch_distance(void) {
+    return prefetch_rows;
+}
+
+// Prefetch the cache lines of row[0:count].
+static inline void prefetch_span(const double *row, int count) {
+    for (int c = 0; c < count; c += DOUBLES_PER_LINE) {
+        __builtin_prefetch(row + c);
+    }
+    __builtin_prefetch(row + count - 1);
+}
+
+// Plain i-k-j update of C[i0:i1, j0:j1] over k0:k1 (scalar fallback and tile edges),
+// C += alpha * A * B. With pf > 0, row k + pf of the B tile is prefetched
+// while row k is used.
+static void tile_scalar(const double *restrict a, int lda, const double *restrict b, int ldb,
+                        double *restrict c, int ldc, int i0, int i1, int k0, int k1, int j0, int j1,
+                        int pf, double alpha) {
+    for (int i = i0; i < i1; i++) {
+        double *c_row = c + (size_t)i * ldc;
+        for (int k = k0; k < k1; k++) {
+            double a_ik = alpha * a[(size_t)i * lda + k];
+            const double *b_row = b + (size_t)k * ldb;
+            if (pf && k + pf < k1) {
+                prefetch_span(b_row + (size_t)pf * ldb + j0, j1 - j0);
+            }
+            for (int j = j0; j < j1; j++) {
+                c_row[j] += a_ik * b_row[j];
+            }
+        }
+    }
+}
+
+// Copy alpha * A[0:mc, 0:kc] into MR-row panels: panel p holds rows p*mr..
+// in k-major order (mr consecutive values per k), so the micro-kernel reads
+// A with unit stride. Rows past mc are zero-filled. Scaling here costs one
+// multiply per packed element instead of a pass over C.
+static void pack_a(const double *a, int lda, int mc, int kc, int mr, double alpha,
+                   double *restrict ap) {
+    for (int i0 = 0; i0 < mc; i0 += mr) {
+        int rows = min(mr, mc - i0);
+        for (int k = 0; k < kc; k++) {
+            for (int r = 0; r < rows; r++) {
+                ap[r] = alpha * a[(size_t)(i0 + r) * lda + k];
+            }
+            for (int r = rows; r < mr; r++) {
+                ap[r] = 0.0;
+            }
+            ap += mr;
+        }
+    }
+}
+
+// Copy B[0:kc, 0:nc] into NR-column panels: panel q holds columns q*nr.. as
+// kc contiguous rows of nr values. Columns past nc are zero-filled.
+// With pf > 0, the source row pf rows ahead is prefetched (up to k_avail rows
+// from b, so the start of the next kk tile is fetched early too).
+static void pack_b(const double *b, int ldb, int kc, int nc, int nr, double *restrict bp,
+                   int pf, int k_avail) {
+    for (int j0 = 0; j0 < nc; j0 += nr) {
+        int cols = min(nr, nc - j0);
+        for (int k = 0; k < kc; k++) {
+            const double *b_row = b + (size_t)k * ldb + j0;
+            if (pf && k + pf < k_avail) {
+                prefetch_span(b_row + (size_t)pf * ldb, cols);
+            }
+            for (int c = 0; c < cols; c++) {
+                bp[c] = b_row[c];
+            }
+            for (int c = cols; c < nr; c++) {
+                bp[c] = 0.0;
+            }
+            bp += nr;
+        }
+    }
+}
+
+// Round v down to a multiple of step (at least step) and clamp to [lo, hi].
+static int fit_block(long v, int step, int lo, int hi) {
+    if (v > hi) v = hi;
+    if (v < lo) v = lo;
+    v = v / step * step;
+    return v < step ? step : (int)v;
+}
+
+gemm_blocking_t gemm_blocking_auto(const gemm_kernel_t *kernel) {
+    const cache_info_t *cache = cache_info_get();
+    int mr = kernel->mr, nr = kernel->nr;
+    long elem = (long)sizeof(double);
+    gemm_blocking_t blk;
+
+    if (kernel->fn == NULL) {
+        // Scalar i-k-j tiles have no register block: size the KC x NC tile of
+        // B (re-read for every row of the block) to fill L1.
+        int side = 8;
+        while ((long)(side + 8) * (side + 8) * elem <= cache->l1d) {
+            side += 8;
+        }
+        blk.kc = blk.nc = side;
+        blk.mc = fit_block(cache->l2 / 2 / (blk.kc * elem), 8, 8, 4096);
+        return blk;
+    }
+
+    // KC: the KC x NR sliver of packed B is reused by every MR row block, so
+    // it gets half of L1; the streamed A sliver and C tile share the rest.
+    blk.kc = fit_block(cache->l1d / 2 / (nr * elem), 8, 32, 1024);
+
+    // MC: the packed MC x KC block of A is reused across the whole B panel
+    // and gets half of L2 (the other half holds B slivers passing through).
+    blk.mc = fit_block(cache->l2 / 2 / (blk.kc * elem), mr, mr, 4096);
+
+    // NC: the packed KC x NC panel of B lives in L3; use half of it so C and
+    // A traffic do not evict the panel.
+    blk.nc = fit_block(cache->l3 / 2 / (blk.kc * elem), nr, nr, 8192);
+
+    return blk;
+}
+
+gemm_blocking_t gemm_blocking_uniform(int block_size) {
+    gemm_blocking_t blk = {block_size, block_size, block_size};
+    return blk;
+}
+
+static double *alloc_scratch(size_t count) {
+    size_t bytes = (count * sizeof(double) + MATRIX_ALIGNMENT - 1) / MATRIX_ALIGNMENT * MATRIX_ALIGNMENT;
+    double *p = (double *)aligned_alloc(MATRIX_ALIGNMENT, bytes);
+    if (!p) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    return p;
+}
+
+static thread_pool_t *gemm_pool = NULL;   // NULL = run on the calling thread only.
+
+void gemm_set_num_threads(int nthreads) {
+    thread_pool_destroy(gemm_pool);
+    gemm_pool = NULL;
+    if (nthreads != 1) {
+        gemm_pool = thread_pool_create(nthreads);
+        if (thread_pool_size(gemm_pool) == 1) {
+            thread_pool_destroy(gemm_pool);
+            gemm_pool = NULL;
+        }
+    }
+}
+
+int gemm_get_num_threads(void) {
+    return gemm_pool ? thread_pool_size(gemm_pool) : 1;
+}
+
+thread_pool_t *gemm_get_pool(void) {
+    return gemm_pool;
+}
+
+int gemm_pin_threads(void) {
+    return gemm_pool ? thread_pool_pin(gemm_pool) : topology_pin_self(0);
+}
+
+// Shared, read-only description of one matrix_multiply_blocked() call.
+typedef struct {
+    const matrix_t *A;
+    const matrix_t *B;
+    matrix_t *C;
+    const gemm_kernel_t *kernel;
+    int mc, kc, nc;             // Effective block sizes (clamped to the problem).
+    int prefetch;               // B prefetch distance in rows (0 = off).
+    int region_m, region_n;     // Size of the C region handled by one task.
+    int regions_n;              // Regions per row of the task grid.
+    size_t ap_count, bp_count;  // Scratch sizes (doubles) per worker.
+    double **ap;                // Per-worker packed A block and B panel, owned by a
+    double **bp;                // plan; NULL = borrow from the scratch pools per task.
+    gemm_epilogue_t ep;         // alpha, beta, bias and activation of this call.
+} gemm_job_t;
+
+static const gemm_epilogue_t default_epilogue = GEMM_EPILOGUE_DEFAULT;
+
+// C[0:rows, 0:cols] *= beta before the first product is added. beta = 0
+// stores zeros instead, so whatever C held (even NaN) is dropped, as in BLAS.
+static void scale_tile(double *c, int ldc, int rows, int cols, double beta) {
+    if (beta == 1.0) {
+        return;
+    }
+    for (int r = 0; r < rows; r++) {
+        double *c_row = c + (size_t)r * ldc;
+        for (int j = 0; j < cols; j++) {
+            c_row[j] = beta == 0.0 ? 0.0 : beta * c_row[j];
+        }
+    }
+}
+
+// Bias and activation on C[0:rows, 0:cols] once its product is complete;
+// bias points at the entry of the tile's first column.
+static void finish_tile(double *c, int ldc, int rows, int cols, const gemm_epilogue_t *ep,
+                        const double *bias) {
+    if (!bias && ep->activation == GEMM_ACTIVATION_NONE) {
+        return;
+    }
+    for (int r = 0; r < rows; r++) {
+        double *c_row = c + (size_t)r * ldc;
+        if (bias) {
+            for (int j = 0; j < cols; j++) {
+                c_row[j] += bias[j];
+            }
+        }
+        if (ep->activation == GEMM_ACTIVATION_RELU) {
+            for (int j = 0; j < cols; j++) {
+                c_row[j] = c_row[j] > 0.0 ? c_row[j] : 0.0;
+            }
+        }
+    }
+}
+
+// Blocked multiply of C[i0:i1, j0:j1] without packing (scalar fallback kernel).
+static void region_scalar(const gemm_job_t *job, int i0, int i1, int j0, int j1) {
+    const matrix_t *A = job->A, *B = job->B;
+    matrix_t *C = job->C;
+    int kdim = A->cols;
+
+    // Iterate over submatrices so the inner work reuses cache lines more effectively.
+    for (int ii = i0; ii < i1; ii += job->mc) {             // Block row index (A and C).
+        int ie = min(ii + job->mc, i1);
+        for (int jj = j0; jj < j1; jj += job->nc) {         // Block column index (B and C).
+            int je = min(jj + job->nc, j1);
+            double *c_block = &MAT(C, ii, jj);
+            scale_tile(c_block, C->ld, ie - ii, je - jj, job->ep.beta);
+            for (int kk = 0; kk < kdim; kk += job->kc) {    // Block index used for accumulation.
+                tile_scalar(A->data, A->ld, B->data, B->ld, C->data, C->ld,
+                            ii, ie, kk, min(kk + job->kc, kdim), jj, je, job->prefetch,
+                            job->ep.alpha);
+            }
+            finish_tile(c_block, C->ld, ie - ii, je - jj, &job->ep,
+                        job->ep.bias ? job->ep.bias + jj : NULL);
+        }
+    }
+}
+
+// Packed, register-blocked multiply of C[i0:i1, j0:j1] over the full k range.
+static void region_packed(const gemm_job_t *job, int i0, int i1, int j0, int j1,
+                          double *ap, double *bp) {
+    const matrix_t *A = job->A, *B = job->B;
+    matrix_t *C = job->C;
+    const gemm_kernel_t *kernel = job->kernel;
+    int kdim = A->cols;
+    int lda = A->ld, ldb = B->ld, ldc = C->ld;
+    int mr = kernel->mr, nr = kernel->nr;
+    double c_edge[GEMM_MAX_MR * GEMM_MAX_NR];
+
+    // GotoBLAS order: each packed B panel (kk, jj) is reused by every ii block,
+    // and each packed A block by every register block in the panel.
+    for (int jj = j0; jj < j1; jj += job->nc) {             // Block column index (B and C): L3.
+        int nc = min(job->nc, j1 - jj);
+        for (int kk = 0; kk < kdim; kk += job->kc) {        // Block index used for accumulation: L1.
+            int kc = min(job->kc, kdim - kk);
+            pack_b(B->data + (size_t)kk * ldb + jj, ldb, kc, nc, nr, bp, job->prefetch, kdim - kk);
+
+            for (int ii = i0; ii < i1; ii += job->mc) {     // Block row index (A and C): L2.
+                int mc = min(job->mc, i1 - ii);
+                pack_a(A->data + (size_t)ii * lda + kk, lda, mc, kc, mr, job->ep.alpha, ap);
+
+                for (int j = 0; j < nc; j += nr) {
+                    const double *bp_panel = bp + (size_t)j * kc;
+                    for (int i = 0; i < mc; i += mr) {
+                        const double *ap_panel = ap + (size_t)i * kc;
+                        double *c_tile = C->data + (size_t)(ii + i) * ldc + jj + j;
+                        int rows = min(mr, mc - i), cols = min(nr, nc - j);
+
+                        // beta on the first kk pass and the epilogue on the
+                        // last one, each while the tile is in L1 for the kernel.
+                        if (kk == 0) {
+                            scale_tile(c_tile, ldc, rows, cols, job->ep.beta);
+                        }
+                        if (rows == mr && cols == nr) {
+                            kernel->fn(kc, ap_panel, 1, mr, bp_panel, nr, c_tile, ldc);
+                        } else {
+                            // Partial register block: run the kernel on a zeroed
+                            // scratch tile and add back only the valid part.
+                            for (int t = 0; t < mr * nr; t++) {
+                                c_edge[t] = 0.0;
+                            }
+                            kernel->fn(kc, ap_panel, 1, mr, bp_panel, nr, c_edge, nr);
+                            for (int r = 0; r < rows; r++) {
+                                for (int c = 0; c < cols; c++) {
+                                    c_tile[(size_t)r * ldc + c] += c_edge[r * nr + c];
+                                }
+                            }
+                        }
+                        if (kk + kc == kdim) {
+                            finish_tile(c_tile, ldc, rows, cols, &job->ep,
+                                        job->ep.bias ? job->ep.bias + jj + j : NULL);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+// One task = one region of C, including its whole kk reduction, so no two
+// workers ever write the same element and no locking is needed.
+static void region_task(void *ctx, int task, int worker) {
+    const gemm_job_t *job = (const gemm_job_t *)ctx;
+    int i0 = task / job->regions_n * job->region_m;
+    int j0 = task % job->regions_n * job->region_n;
+    int i1 = min(i0 + job->region_m, job->C->rows);
+    int j1 = min(j0 + job->region_n, job->C->cols);
+
+    if (job->kernel->fn == NULL) {
+        region_scalar(job, i0, i1, j0, j1);
+        return;
+    }
+
+    // Plans own one pair of buffers per worker; plain calls borrow a pair
+    // from the scratch pools per region (heap only until steady state).
+    if (job->ap) {
+        region_packed(job, i0, i1, j0, j1, job->ap[worker], job->bp[worker]);
+        return;
+    }
+    double *ap = (double *)scratch_get(job->ap_count * sizeof(double));
+    double *bp = (double *)scratch_get(job->bp_count * sizeof(double));
+    region_packed(job, i0, i1, j0, j1, ap, bp);
+    scratch_put(ap);
+    scratch_put(bp);
+}
+
+static int round_up(int v, int step) {
+    return (v + step - 1) / step * step;
+}
+
+// Split C into regions of whole register blocks. A single region covers the
+// entire matrix on one thread; with more threads, regions are halved (wider
+// side first) until there are about four per thread for stealing to balance.
+static void choose_regions(gemm_job_t *job, int nthreads) {
+    int m = job->C->rows, n = job->C->cols;
+    int mr = job->kernel->mr, nr = job->kernel->nr;
+    int min_m = 2 * (mr > 8 ? mr : 8), min_n = 2 * (nr > 8 ? nr : 8);
+    int rm = round_up(m, mr), rn = round_up(n, nr);
+
+    long target = nthreads > 1 ? 4L * nthreads : 1;
+    while ((long)((m + rm - 1) / rm) * ((n + rn - 1) / rn) < target) {
+        if (rn >= rm && rn / 2 >= min_n) {
+            rn = round_up(rn / 2, nr);
+        } else if (rm / 2 >= min_m) {
+            rm = round_up(rm / 2, mr);
+        } else if (rn / 2 >= min_n) {
+            rn = round_up(rn / 2, nr);
+        } else {
+            break;
+        }
+    }
+    job->region_m = rm;
+    job->region_n = rn;
+    job->regions_n = (n + rn - 1) / rn;
+}
+
+// The regions of a blocked call (see choose_regions) over the buffers that
+// gemm_first_touch writes.
+typedef struct {
+    matrix_t *A, *B, *C;
+    int region_m, region_n;
+    int regions_n;
+} first_touch_job_t;
+
+// First-touch task: zero the pages the matching compute task will use most,
+// so the kernel places them on that worker's node.
+static void first_touch_task(void *ctx, int task, int worker) {
+    (void)worker;
+    const first_touch_job_t *job = (const first_touch_job_t *)ctx;
+    matrix_t *A = job->A, *B = job->B, *C = job->C;
+    int regions = (C->rows + job->region_m - 1) / job->region_m * job->regions_n;
+    int region_row = task / job->regions_n;
+    int i0 = region_row * job->region_m;
+    int j0 = task % job->regions_n * job->region_n;
+    int i1 = min(i0 + job->region_m, C->rows);
+    int j1 = min(j0 + job->region_n, C->cols);
+
+    // C: exactly the region this task writes during the multiply.
+    for (int i = i0; i < i1; i++) {
+        for (int j = j0; j < j1; j++) {
+            MAT(C, i, j) = 0.0;
+        }
+    }
+
+    // A: rows of the region row, owned by the task at its left edge.
+    if (task % job->regions_n == 0) {
+        for (int i = i0; i < i1; i++) {
+            for (int k = 0; k < A->cols; k++) {
+                MAT(A, i, k) = 0.0;
+            }
+        }
+    }
+
+    // B: every region reads all of it, so spread its rows evenly.
+    int k0 = (int)((long)B->rows * task / regions);
+    int k1 = (int)((long)B->rows * (task + 1) / regions);
+    for (int k = k0; k < k1; k++) {
+        for (int j = 0; j < B->cols; j++) {
+            MAT(B, k, j) = 0.0;
+        }
+    }
+}
+
+void gemm_first_touch(matrix_t *A, matrix_t *B, matrix_t *C) {
+    gemm_job_t split;
+    split.A = A;
+    split.B = B;
+    split.C = C;
+    split.kernel = gemm_kernel_select();
+    choose_regions(&split, gemm_get_num_threads());
+    first_touch_job_t job = {A, B, C, split.region_m, split.region_n, split.regions_n};
+    int regions = (C->rows + job.region_m - 1) / job.region_m * job.regions_n;
+
+    if (gemm_pool) {
+        thread_pool_run_static(gemm_pool, regions, first_touch_task, &job);
+    } else {
+        for (int t = 0; t < regions; t++) {
+            first_touch_task(&job, t, 0);
+        }
+    }
+}
+
+// Everything about a blocked call that depends only on the shape, kernel,
+// blocking and thread count: regions, clamped block sizes and scratch sizes.
+// Returns the number of regions (tasks).
+static int job_setup(gemm_job_t *job, int m, int n, int kdim, const gemm_kernel_t *kernel,
+                     const gemm_blocking_t *blk, int nthreads, int prefetch) {
+    matrix_t shape = {NULL, m, n, n};   // choose_regions only reads C's size.
+    job->C = &shape;
+    job->kernel = kernel;
+    job->prefetch = prefetch;
+    choose_regions(job, nthreads);
+    job->C = NULL;
+
+    // Never allocate more scratch than one region needs.
+    job->mc = min(blk->mc, job->region_m);
+    job->kc = min(blk->kc, kdim);
+    job->nc = min(blk->nc, job->region_n);
+
+    // Packed scratch per worker: one A block (rows rounded up to mr) and one
+    // B panel (columns rounded up to nr), reused for every tile it computes.
+    job->ap_count = (size_t)round_up(job->mc, kernel->mr) * job->kc;
+    job->bp_count = (size_t)job->kc * round_up(job->nc, kernel->nr);
+    job->ap = job->bp = NULL;
+    job->ep = default_epilogue;
+    return (m + job->region_m - 1) / job->region_m * job->regions_n;
+}
+
+static void job_run(gemm_job_t *job, thread_pool_t *pool, int regions) {
+    if (pool) {
+        thread_pool_run(pool, regions, region_task, job);
+    } else {
+        for (int t = 0; t < regions; t++) {
+            region_task(job, t, 0);
+        }
+    }
+}
+
+// Without a product to add (alpha = 0 or K = 0), C = act(beta * C + bias).
+static void epilogue_only(matrix_t *C, const gemm_epilogue_t *ep) {
+    scale_tile(C->data, C->ld, C->rows, C->cols, ep->beta);
+    finish_tile(C->data, C->ld, C->rows, C->cols, ep, ep->bias);
+}
+
+void matrix_multiply_blocked(const matrix_t *A, const matrix_t *B, matrix_t *C,
+                             const gemm_blocking_t *blocking) {
+    matrix_multiply_fused(A, B, C, NULL, blocking);
+}
+
+void matrix_multiply_fused(const matrix_t *A, const matrix_t *B, matrix_t *C,
+                           const gemm_epilogue_t *epilogue, const gemm_blocking_t *blocking) {
+    int m = C->rows, n = C->cols, kdim = A->cols;
+    const gemm_epilogue_t *ep = epilogue ? epilogue : &default_epilogue;
+    if (m == 0 || n == 0) {
+        return;
+    }
+    gemm_stats_call_t call;
+    gemm_stats_begin(&call, GEMM_STATS_BLOCKED);
+    if (kdim == 0 || ep->alpha == 0.0) {
+        epilogue_only(C, ep);
+        gemm_stats_end(&call, 0.0);
+        return;
+    }
+
+    gemm_job_t job;
+    const gemm_kernel_t *kernel = gemm_kernel_select();
+    gemm_blocking_t blk = blocking ? *blocking : gemm_blocking_auto(kernel);
+    int nthreads = gemm_get_num_threads();
+    int regions = job_setup(&job, m, n, kdim, kernel, &blk, nthreads, prefetch_rows);
+    job.A = A;
+    job.B = B;
+    job.C = C;
+    job.ep = *ep;
+    job_run(&job, gemm_pool, regions);
+    gemm_stats_end(&call, 2.0 * m * n * kdim);
+}
+
+// ---- Plans ----
+
+struct gemm_plan {
+    int m, k, n;
+    int nthreads;
+    int regions;
+    thread_pool_t *pool;   // Owned by the plan; NULL for one thread.
+    gemm_job_t job;        // Template: A, B and C are filled in per execute.
+};
+
+gemm_plan_t *gemm_plan_create(int m, int k, int n, const gemm_plan_options_t *options) {
+    gemm_plan_options_t opt = GEMM_PLAN_OPTIONS_DEFAULT;
+    if (options) {
+        opt = *options;
+    }
+    if (m <= 0 || n <= 0 || k <= 0) {
+        return NULL;
+    }
+    const gemm_kernel_t *kernel = opt.kernel ? gemm_kernel_find(opt.kernel) : gemm_kernel_select();
+    if (kernel == NULL) {
+        return NULL;
+    }
+
+    gemm_plan_t *plan = (gemm_plan_t *)calloc(1, sizeof(*plan));
+    if (!plan) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    plan->m = m;
+    plan->n = n;
+    plan->k = k;
+    if (opt.threads != 1) {
+        plan->pool = thread_pool_create(opt.threads);
+        if (thread_pool_size(plan->pool) == 1) {
+            thread_pool_destroy(plan->pool);
+            plan->pool = NULL;
+        }
+    }
+    if (opt.pin && (plan->pool ? thread_pool_pin(plan->pool) : topology_pin_self(0)) != 0) {
+        fprintf(stderr, "Warning: could not pin every plan thread\n");
+    }
+    plan->nthreads = plan->pool ? thread_pool_size(plan->pool) : 1;
+
+    gemm_blocking_t blk = opt.blocking ? *opt.blocking : gemm_blocking_auto(kernel);
+    plan->regions = job_setup(&plan->job, m, n, k, kernel, &blk, plan->nthreads, opt.prefetch);
+
+    // Every worker's pack buffers now, so region_task never allocates.
+    plan->job.ap = (double **)calloc(plan->nthreads, sizeof(double *));
+    plan->job.bp = (double **)calloc(plan->nthreads, sizeof(double *));
+    if (!plan->job.ap || !plan->job.bp) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    if (kernel->fn != NULL) {
+        for (int w = 0; w < plan->nthreads; w++) {
+            plan->job.ap[w] = alloc_scratch(plan->job.ap_count);
+            plan->job.bp[w] = alloc_scratch(plan->job.bp_count);
+        }
+    }
+    return plan;
+}
+
+int gemm_plan_execute(const gemm_plan_t *plan, const matrix_t *A, const matrix_t *B, matrix_t *C) {
+    return gemm_plan_execute_fused(plan, A, B, C, NULL);
+}
+
+int gemm_plan_execute_fused(const gemm_plan_t *plan, const matrix_t *A, const matrix_t *B,
+                            matrix_t *C, const gemm_epilogue_t *epilogue) {
+    if (A->rows != plan->m || A->cols != plan->k || B->rows != plan->k || B->cols != plan->n ||
+        C->rows != plan->m || C->cols != plan->n) {
+        return -1;
+    }
+    const gemm_epilogue_t *ep = epilogue ? epilogue : &default_epilogue;
+    gemm_stats_call_t call;
+    gemm_stats_begin(&call, GEMM_STATS_PLAN);
+    if (ep->alpha == 0.0) {
+        epilogue_only(C, ep);
+        gemm_stats_end(&call, 0.0);
+        return 0;
+    }
+    gemm_job_t job = plan->job;   // Shares the plan's scratch pointers.
+    job.A = A;
+    job.B = B;
+    job.C = C;
+    job.ep = *ep;
+    job_run(&job, plan->pool, plan->regions);
+    gemm_stats_end(&call, 2.0 * plan->m * plan->n * plan->k);
+    return 0;
+}
+
+void gemm_plan_describe(const gemm_plan_t *plan, char *buf, size_t size) {
+    snprintf(buf, size, "%s MC=%d KC=%d NC=%d threads %d regions %d", plan->job.kernel->name,
+             plan->job.mc, plan->job.kc, plan->job.nc, plan->nthreads, plan->regions);
+}
+
+void gemm_plan_destroy(gemm_plan_t *plan) {
+    if (plan == NULL) {
+        return;
+    }
+    for (int w = 0; w < plan->nthreads; w++) {
+        free(plan->job.ap[w]);
+        free(plan->job.bp[w]);
+    }
+    free(plan->job.ap);
+    free(plan->job.bp);
+    thread_pool_destroy(plan->pool);
+    free(plan);
+}
+
+int gemm_recursive_tile(const gemm_kernel_t *kernel) {
+    // Smallest common multiple of mr and nr, repeated up to about 64.
+    int a = kernel->mr, b = kernel->nr;
+    while (b) {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+    int lcm = kernel->mr / a * kernel->nr;
+    return lcm >= GEMM_RECURSIVE_BASE ? lcm : GEMM_RECURSIVE_BASE / lcm * lcm;
+}
+
+#define EDGE_KC 256   // Depth per pass of edge_tile (bounds its stack copies).
+
+// Partial register block (rows <= mr, cols <= nr) through the micro-kernel:
+// the missing rows of A and columns of B are zero in stack copies, and the
+// kernel accumulates into an mr x nr temporary that is added back to C.
+static void edge_tile(const gemm_kernel_t *kernel, const double *a, int lda, const double *b,
+                      int ldb, double *c, int ldc, int rows, int cols, int kdim) {
+    int mr = kernel->mr, nr = kernel->nr;
+    double a_pad[GEMM_MAX_MR * EDGE_KC], b_pad[EDGE_KC * GEMM_MAX_NR];
+    double c_tmp[GEMM_MAX_MR * GEMM_MAX_NR] = {0};
+    for (int k0 = 0; k0 < kdim; k0 += EDGE_KC) {
+        int kc = min(EDGE_KC, kdim - k0);
+        const double *ap = a + k0, *bp = b + (size_t)k0 * ldb;
+        int rs_a = lda, ld_b = ldb;
+        if (rows < mr) {
+            memset(a_pad, 0, sizeof(double) * mr * kc);
+            for (int i = 0; i < rows; i++) {
+                memcpy(a_pad + i * kc, ap + (size_t)i * lda, sizeof(double) * kc);
+            }
+            ap = a_pad;
+            rs_a = kc;
+        }
+        if (cols < nr) {
+            for (int k = 0; k < kc; k++) {
+                memcpy(b_pad + k * nr, bp + (size_t)k * ldb, sizeof(double) * cols);
+                memset(b_pad + k * nr + cols, 0, sizeof(double) * (nr - cols));
+            }
+            bp = b_pad;
+            ld_b = nr;
+        }
+        kernel->fn(kc, ap, rs_a, 1, bp, ld_b, c_tmp, nr);
+    }
+    for (int i = 0; i < rows; i++) {
+        for (int j = 0; j < cols; j++) {
+            c[(size_t)i * ldc + j] += c_tmp[i * nr + j];
+        }
+    }
+}
+
+// C[i0:i1, j0:j1] += A[i0:i1, k0:k1] * B[k0:k1, j0:j1] on row-major operands:
+// full register blocks go straight to the micro-kernel (A read in place with
+// rs_a = lda, cs_a = 1), partial blocks on the right and bottom edges through
+// edge_tile. No packing, so nothing depends on the cache sizes.
+static void unpacked_multiply(const gemm_kernel_t *kernel, const double *a, int lda,
+                              const double *b, int ldb, double *c, int ldc, int i0, int i1,
+                              int k0, int k1, int j0, int j1) {
+    if (kernel->fn == NULL) {
+        tile_scalar(a, lda, b, ldb, c, ldc, i0, i1, k0, k1, j0, j1, 0, 1.0);
+        return;
+    }
+    int mr = kernel->mr, nr = kernel->nr;
+    for (int i = i0; i < i1; i += mr) {
+        int rows = min(mr, i1 - i);
+        for (int j = j0; j < j1; j += nr) {
+            int cols = min(nr, j1 - j);
+            const double *ap = a + (size_t)i * lda + k0, *bp = b + (size_t)k0 * ldb + j;
+            double *cp = c + (size_t)i * ldc + j;
+            if (rows == mr && cols == nr) {
+                kernel->fn(k1 - k0, ap, lda, 1, bp, ldb, cp, ldc);
+            } else {
+                edge_tile(kernel, ap, lda, bp, ldb, cp, ldc, rows, cols, k1 - k0);
+            }
+        }
+    }
+}
+
+// Base case of the recursion: the unpacked kernel on the job's matrices.
+static void recursive_base(const gemm_job_t *job, int i0, int i1, int k0, int k1, int j0, int j1) {
+    unpacked_multiply(job->kernel, job->A->data, job->A->ld, job->B->data, job->B->ld,
+                      job->C->data, job->C->ld, i0, i1, k0, k1, j0, j1);
+}
+
+// Split the largest of m, k, n in half until all three fit the base size.
+// m and n are split on register-block boundaries so the base cases stay
+// made of full micro-kernel tiles; the two k halves run one after the other
+// because they update the same C.
+static void recursive_multiply(const gemm_job_t *job, int base, int i0, int i1, int k0, int k1,
+                               int j0, int j1) {
+    int m = i1 - i0, kd = k1 - k0, n = j1 - j0;
+    if (m <= base && kd <= base && n <= base) {
+        recursive_base(job, i0, i1, k0, k1, j0, j1);
+        return;
+    }
+    if (m >= kd && m >= n) {
+        int half = i0 + round_up(m / 2, job->kernel->mr);
+        if (half >= i1) half = i0 + m / 2;
+        recursive_multiply(job, base, i0, half, k0, k1, j0, j1);
+        recursive_multiply(job, base, half, i1, k0, k1, j0, j1);
+    } else if (n >= kd) {
+        int half = j0 + round_up(n / 2, job->kernel->nr);
+        if (half >= j1) half = j0 + n / 2;
+        recursive_multiply(job, base, i0, i1, k0, k1, j0, half);
+        recursive_multiply(job, base, i0, i1, k0, k1, half, j1);
+    } else {
+        int half = k0 + kd / 2;
+        recursive_multiply(job, base, i0, i1, k0, half, j0, j1);
+        recursive_multiply(job, base, i0, i1, half, k1, j0, j1);
+    }
+}
+
+static void recursive_task(void *ctx, int task, int worker) {
+    (void)worker;
+    const gemm_job_t *job = (const gemm_job_t *)ctx;
+    int i0 = task / job->regions_n * job->region_m;
+    int j0 = task % job->regions_n * job->region_n;
+    int i1 = min(i0 + job->region_m, job->C->rows);
+    int j1 = min(j0 + job->region_n, job->C->cols);
+    recursive_multiply(job, gemm_recursive_tile(job->kernel), i0, i1, 0, job->A->cols, j0, j1);
+}
+
+void matrix_multiply_recursive(const matrix_t *A, const matrix_t *B, matrix_t *C) {
+    if (C->rows == 0 || C->cols == 0 || A->cols == 0) {
+        return;
+    }
+    gemm_stats_call_t call;
+    gemm_stats_begin(&call, GEMM_STATS_RECURSIVE);
+    gemm_job_t job;
+    job.A = A;
+    job.B = B;
+    job.C = C;
+    job.kernel = gemm_kernel_select();
+
+    // Threads share out the same C regions as the tiled path; each region
+    // then recurses on its own.
+    choose_regions(&job, gemm_get_num_threads());
+    int regions = (C->rows + job.region_m - 1) / job.region_m * job.regions_n;
+    if (gemm_pool) {
+        thread_pool_run(gemm_pool, regions, recursive_task, &job);
+    } else {
+        for (int t = 0; t < regions; t++) {
+            recursive_task(&job, t, 0);
+        }
+    }
+    gemm_stats_end(&call, 2.0 * C->rows * C->cols * A->cols);
+}
+
+// Morton variant: the recursion runs on block coordinates (power-of-two
+// ranges, so every split lands on a quadrant boundary) and the base case is
+// one tile x tile block product, contiguous in memory for all three operands.
+typedef struct {
+    const morton_matrix_t *A;
+    const morton_matrix_t *B;
+    morton_matrix_t *C;
+    const gemm_kernel_t *kernel;
+    int blocks_m, blocks_k, blocks_n;   // Blocks that hold matrix data.
+    int split_m, split_n;               // C is split split_m x split_n ways across tasks.
+} morton_job_t;
+
+static void morton_base(const morton_job_t *job, int bi, int bk, int bj) {
+    int t = job->C->tile;
+    const double *a = morton_block(job->A, bi, bk);
+    const double *b = morton_block(job->B, bk, bj);
+    double *c = morton_block(job->C, bi, bj);
+    const gemm_kernel_t *kernel = job->kernel;
+
+    // Padding is zero and t is a multiple of mr and nr: no edge cases.
+    if (kernel->fn == NULL) {
+        tile_scalar(a, t, b, t, c, t, 0, t, 0, t, 0, t, 0, 1.0);
+        return;
+    }
+    for (int i = 0; i < t; i += kernel->mr) {
+        for (int j = 0; j < t; j += kernel->nr) {
+            kernel->fn(t, a + (size_t)i * t, t, 1, b + j, t, c + (size_t)i * t + j, t);
+        }
+    }
+}
+
+static void morton_multiply(const morton_job_t *job, int bi0, int bi1, int bk0, int bk1,
+                            int bj0, int bj1) {
+    // Ranges entirely in the padding contribute nothing.
+    if (bi0 >= job->blocks_m || bk0 >= job->blocks_k || bj0 >= job->blocks_n) {
+        return;
+    }
+    int m = bi1 - bi0, kd = bk1 - bk0, n = bj1 - bj0;
+    if (m == 1 && kd == 1 && n == 1) {
+        morton_base(job, bi0, bk0, bj0);
+    } else if (m >= kd && m >= n) {
+        morton_multiply(job, bi0, bi0 + m / 2, bk0, bk1, bj0, bj1);
+        morton_multiply(job, bi0 + m / 2, bi1, bk0, bk1, bj0, bj1);
+    } else if (n >= kd) {
+        morton_multiply(job, bi0, bi1, bk0, bk1, bj0, bj0 + n / 2);
+        morton_multiply(job, bi0, bi1, bk0, bk1, bj0 + n / 2, bj1);
+    } else {
+        morton_multiply(job, bi0, bi1, bk0, bk0 + kd / 2, bj0, bj1);
+        morton_multiply(job, bi0, bi1, bk0 + kd / 2, bk1, bj0, bj1);
+    }
+}
+
+static void morton_task(void *ctx, int task, int worker) {
+    (void)worker;
+    const morton_job_t *job = (const morton_job_t *)ctx;
+    int side_m = job->C->grid_rows / job->split_m, side_n = job->C->grid_cols / job->split_n;
+    int bi0 = task / job->split_n * side_m, bj0 = task % job->split_n * side_n;
+    morton_multiply(job, bi0, bi0 + side_m, 0, job->A->grid_cols, bj0, bj0 + side_n);
+}
+
+void matrix_multiply_recursive_morton(const morton_matrix_t *A, const morton_matrix_t *B,
+                                      morton_matrix_t *C) {
+    gemm_stats_call_t call;
+    gemm_stats_begin(&call, GEMM_STATS_RECURSIVE);
+    morton_job_t job;
+    job.A = A;
+    job.B = B;
+    job.C = C;
+    job.kernel = gemm_kernel_select();
+    int t = C->tile;
+    job.blocks_m = (C->rows + t - 1) / t;
+    job.blocks_k = (A->cols + t - 1) / t;
+    job.blocks_n = (C->cols + t - 1) / t;
+
+    // Quadrant tasks: halve the longer side of the task's block range until
+    // there are about four tasks per thread (or every task is a single block).
+    int nthreads = gemm_get_num_threads();
+    job.split_m = job.split_n = 1;
+    while (nthreads > 1 && job.split_m * job.split_n < 4 * nthreads) {
+        int side_m = C->grid_rows / job.split_m, side_n = C->grid_cols / job.split_n;
+        if (side_m >= side_n && side_m > 1) {
+            job.split_m *= 2;
+        } else if (side_n > 1) {
+            job.split_n *= 2;
+        } else {
+            break;
+        }
+    }
+    int tasks = job.split_m * job.split_n;
+    if (gemm_pool) {
+        thread_pool_run(gemm_pool, tasks, morton_task, &job);
+    } else {
+        for (int task = 0; task < tasks; task++) {
+            morton_task(&job, task, 0);
+        }
+    }
+    gemm_stats_end(&call, 2.0 * C->rows * C->cols * A->cols);
+}
+
+void matrix_multiply_standard(const matrix_t *A, const matrix_t *B, matrix_t *C) {
+    tile_scalar(A->data, A->ld, B->data, B->ld, C->data, C->ld, 0, C->rows, 0, A->cols, 0, C->cols, 0,
+                1.0);
+}
+
+// One batched call: either strided (pa == NULL) or pointer-array operands.
+typedef struct {
+    const gemm_batch_shape_t *shape;
+    const gemm_kernel_t *kernel;
+    gemm_fixed_fn fixed;   // Non-NULL for square 4, 8, 16.
+    const double *A, *B;
+    double *C;
+    size_t stride_a, stride_b, stride_c;
+    const double *const *pa, *const *pb;
+    double *const *pc;
+    int count;
+    int chunk;   // Problems per task.
+} batch_job_t;
+
+static void batch_task(void *ctx, int task, int worker) {
+    (void)worker;
+    const batch_job_t *job = (const batch_job_t *)ctx;
+    const gemm_batch_shape_t *s = job->shape;
+    int end = min(job->count, (task + 1) * job->chunk);
+    for (int i = task * job->chunk; i < end; i++) {
+        const double *a = job->pa ? job->pa[i] : job->A + (size_t)i * job->stride_a;
+        const double *b = job->pb ? job->pb[i] : job->B + (size_t)i * job->stride_b;
+        double *c = job->pc ? job->pc[i] : job->C + (size_t)i * job->stride_c;
+        if (job->fixed) {
+            job->fixed(a, s->lda, b, s->ldb, c, s->ldc);
+        } else {
+            unpacked_multiply(job->kernel, a, s->lda, b, s->ldb, c, s->ldc, 0, s->m, 0, s->k, 0, s->n);
+        }
+    }
+}
+
+static void run_batch(batch_job_t *job) {
+    const gemm_batch_shape_t *s = job->shape;
+    // C += nothing: also keeps the chunk size below away from 0 flops.
+    if (job->count <= 0 || s->m <= 0 || s->n <= 0 || s->k <= 0) {
+        return;
+    }
+    gemm_stats_call_t call;
+    gemm_stats_begin(&call, GEMM_STATS_BATCH);
+    job->kernel = gemm_kernel_select();
+    job->fixed = s->m == s->k && s->k == s->n ? gemm_fixed_kernel(s->m) : NULL;
+
+    // Enough problems per task to amortize the hand-off; small batches of
+    // tiny matrices stay on the calling thread.
+    double flops = 2.0 * s->m * s->k * s->n;
+    job->chunk = flops >= GEMM_BATCH_MIN_FLOPS ? 1 : (int)(GEMM_BATCH_MIN_FLOPS / flops);
+    int tasks = (job->count + job->chunk - 1) / job->chunk;
+
+    if (gemm_pool && tasks > 1) {
+        thread_pool_run(gemm_pool, tasks, batch_task, job);
+    } else {
+        for (int t = 0; t < tasks; t++) {
+            batch_task(job, t, 0);
+        }
+    }
+    gemm_stats_end(&call, flops * job->count);
+}
+
+void matrix_multiply_batch_strided(const gemm_batch_shape_t *shape, const double *A,
+                                   size_t stride_a, const double *B, size_t stride_b,
+                                   double *C, size_t stride_c, int count) {
+    batch_job_t job = {0};
+    job.shape = shape;
+    job.A = A;
+    job.B = B;
+    job.C = C;
+    job.stride_a = stride_a;
+    job.stride_b = stride_b;
+    job.stride_c = stride_c;
+    job.count = count;
+    run_batch(&job);
+}
+
+void matrix_multiply_batch(const gemm_batch_shape_t *shape, const double *const *A,
+                           const double *const *B, double *const *C, int count) {
+    batch_job_t job = {0};
+    job.shape = shape;
+    job.pa = A;
+    job.pb = B;
+    job.pc = C;
+    job.count = count;
+    run_batch(&job);
+}
@@ -0,0 +1,217 @@
+#ifndef GEMM_H
+#define GEMM_H
+
+#include "matrix.h"
+#include "thread_pool.h"
+
+// Register-blocked micro-kernel: C[0:mr, 0:nr] += A[0:mr, 0:kc] * B[0:kc, 0:nr].
+// Element (i, k) of A is read from a[i * rs_a + k * cs_a] so the same kernel
+// runs on row-major A (rs_a = lda, cs_a = 1) or on a packed panel.
+// B and C are row-major with leading dimensions ldb and ldc.
+typedef void (*gemm_microkernel_fn)(int kc, const double *a, int rs_a, int cs_a,
+                                    const double *b, int ldb, double *c, int ldc);
+
+#define GEMM_MAX_MR 8   // Upper bounds on mr/nr over all kernels (edge scratch tiles).
+#define GEMM_MAX_NR 16
+
+typedef struct {
+    const char *name;
+    int mr;                   // Rows of C held in registers.
+    int nr;                   // Columns of C held in registers.
+    gemm_microkernel_fn fn;   // NULL for the scalar fallback (plain i-k-j loop).
+} gemm_kernel_t;
+
+// Best kernel supported by this CPU (detected once via CPUID), unless one
+// was forced with gemm_kernel_force().
+const gemm_kernel_t *gemm_kernel_select(void);
+
+// Force a kernel by name ("scalar", "avx2", "avx512"). Returns 0 on success,
+// -1 if the name is unknown or the CPU lacks the required instructions.
+int gemm_kernel_force(const char *name);
+
+// Kernel by name without changing the selection; NULL if the name is unknown
+// or the CPU lacks the required instructions.
+const gemm_kernel_t *gemm_kernel_find(const char *name);
+
+// Block sizes for the three tile loops, one per cache level:
+// an MR x KC sliver of A and a KC x NR sliver of B stay in L1,
+// the packed MC x KC block of A in L2 and the KC x NC panel of B in L3.
+typedef struct {
+    int mc;   // Rows of A/C per block (ii loop).
+    int kc;   // Depth of each partial product (kk loop).
+    int nc;   // Columns of B/C per panel (jj loop).
+} gemm_blocking_t;
+
+// Block sizes derived from the detected cache sizes for the given kernel.
+gemm_blocking_t gemm_blocking_auto(const gemm_kernel_t *kernel);
+
+// The same size for all three loops (the original single block_size).
+gemm_blocking_t gemm_blocking_uniform(int block_size);
+
+// Blocked (tiled) matrix multiplication: C += A * B. A NULL blocking uses
+// gemm_blocking_auto() for the selected kernel. With a SIMD kernel, each A
+// block and B panel is first packed into contiguous, kernel-ordered scratch
+// buffers that are reused across the tile loops.
+void matrix_multiply_blocked(const matrix_t *A, const matrix_t *B, matrix_t *C,
+                             const gemm_blocking_t *blocking);
+
+// BLAS-style scaling plus an optional epilogue for matrix_multiply_fused:
+//   C = act(alpha * A * B + beta * C + bias)
+// with bias[j] added to every row of column j. alpha is applied while A is
+// packed, beta to each register tile of C just before its first partial
+// product, and bias and activation right after its last one, while the tile
+// is still in L1. Callers that zero C first and post-process it afterwards
+// thus save both passes over C. beta = 0 ignores C's contents (NaN included).
+typedef enum { GEMM_ACTIVATION_NONE, GEMM_ACTIVATION_RELU } gemm_activation_t;
+
+typedef struct {
+    double alpha;
+    double beta;
+    const double *bias;            // C->cols entries, NULL = none.
+    gemm_activation_t activation;
+} gemm_epilogue_t;
+
+#define GEMM_EPILOGUE_DEFAULT {1.0, 1.0, NULL, GEMM_ACTIVATION_NONE}   // C += A * B.
+
+// matrix_multiply_blocked with an epilogue (NULL = GEMM_EPILOGUE_DEFAULT).
+void matrix_multiply_fused(const matrix_t *A, const matrix_t *B, matrix_t *C,
+                           const gemm_epilogue_t *epilogue, const gemm_blocking_t *blocking);
+
+// Software prefetch distance for B in matrix_multiply_blocked, in rows of B
+// (0 = off, the default). Consecutive rows of B are ldb apart, a stride the
+// hardware prefetcher may not follow: while packing (or, for the scalar
+// kernel, consuming) row k, row k + rows is prefetched.
+void gemm_set_prefetch_distance(int rows);
+int gemm_get_prefetch_distance(void);
+
+// Number of threads used by matrix_multiply_blocked (default 1). The (ii, jj)
+// tile space of C is split into regions handed out through a work-stealing
+// pool; each region's kk reduction stays on one thread. nthreads <= 0 uses
+// every online CPU.
+// The pool runs one job at a time: while it is busy, a multiply started on
+// another thread (this header and sparse.h, all but the gemm_plan_* calls)
+// runs single-threaded. Concurrent callers that each want parallelism
+// should use their own gemm_plan_t (see below).
+void gemm_set_num_threads(int nthreads);
+int gemm_get_num_threads(void);
+
+// The pool behind gemm_set_num_threads (NULL when single-threaded), so other
+// engines built on these kernels (sparse.c) share the same workers.
+thread_pool_t *gemm_get_pool(void);
+
+// Pin the GEMM workers (and the calling thread as worker 0) to CPUs in
+// node-major order. Returns 0 on success.
+int gemm_pin_threads(void);
+
+// Zero A, B and C in parallel with the same region-to-worker split the
+// multiply starts from, so on NUMA hosts each page is first touched (and
+// therefore allocated) on the node of the worker that will use it. Call it
+// on fresh buffers before filling them; later serial writes do not move pages.
+void gemm_first_touch(matrix_t *A, matrix_t *B, matrix_t *C);
+
+#define GEMM_RECURSIVE_BASE 64   // Approximate base-case side of the recursive engine.
+
+// Cache-oblivious multiply: C += A * B by recursively halving the largest of
+// m, k and n until all three are at most gemm_recursive_tile(), then running
+// the micro-kernel directly on the operands. There are no block sizes to
+// tune: some level of the recursion fits each cache level. Threads split C
+// into the same regions as matrix_multiply_blocked.
+void matrix_multiply_recursive(const matrix_t *A, const matrix_t *B, matrix_t *C);
+
+// Same recursion on Morton-ordered operands (morton_matrix_t), which keeps
+// every sub-problem contiguous in memory. All three must use the same tile,
+// a multiple of the kernel's mr and nr (use gemm_recursive_tile()).
+void matrix_multiply_recursive_morton(const morton_matrix_t *A, const morton_matrix_t *B,
+                                      morton_matrix_t *C);
+
+// Base-case side for the given kernel: a multiple of mr and nr close to
+// GEMM_RECURSIVE_BASE (also the Morton tile size).
+int gemm_recursive_tile(const gemm_kernel_t *kernel);
+
+// Strassen-Winograd fast multiply for square matrices: C += A * B with 7
+// half-size products per level instead of 8, recursing until the side is at
+// most crossover and then calling matrix_multiply_blocked. crossover <= 0
+// uses gemm_strassen_crossover(). Temporaries come from one scratch_get
+// buffer per call (see arena.h), so concurrent calls never share them.
+// Non-square shapes, or sides already at or below the crossover, go straight
+// to matrix_multiply_blocked. Rounding error grows with the number of levels
+// (normwise, not elementwise, stable).
+void matrix_multiply_strassen(const matrix_t *A, const matrix_t *B, matrix_t *C, int crossover);
+
+// Crossover side for this host: measured once (first call, other callers
+// wait for it) from the blocked kernel's flop rate and the matrix-addition
+// bandwidth, as a multiple of 64.
+int gemm_strassen_crossover(void);
+
+// Recursion levels matrix_multiply_strassen uses for side n.
+int gemm_strassen_levels(int n, int crossover);
+
+// Shape shared by every problem of a batch: A_i is m x k, B_i is k x n and
+// C_i is m x n, with row strides lda, ldb and ldc.
+typedef struct {
+    int m, k, n;
+    int lda, ldb, ldc;
+} gemm_batch_shape_t;
+
+// Batched small multiplies, C_i += A_i * B_i for i in [0, count), meant for
+// sides up to about 64. Square 4, 8 and 16 use gemm_fixed_kernel(); other
+// shapes run the micro-kernel directly on the unpacked operands (no scratch
+// allocation, no blocking). Problems are spread over the GEMM threads in
+// chunks of at least GEMM_BATCH_MIN_FLOPS.
+#define GEMM_BATCH_MIN_FLOPS (1 << 18)
+
+// Strided layout: problem i starts at A + i * stride_a, B + i * stride_b and
+// C + i * stride_c (in doubles), e.g. count matrices back to back in one buffer.
+void matrix_multiply_batch_strided(const gemm_batch_shape_t *shape, const double *A,
+                                   size_t stride_a, const double *B, size_t stride_b,
+                                   double *C, size_t stride_c, int count);
+
+// Pointer-array layout: problem i uses A[i], B[i] and C[i].
+void matrix_multiply_batch(const gemm_batch_shape_t *shape, const double *const *A,
+                           const double *const *B, double *const *C, int count);
+
+// Fully unrolled kernel for square size x size operands (C += A * B), or
+// NULL if there is none for this size (only 4, 8 and 16).
+typedef void (*gemm_fixed_fn)(const double *a, int lda, const double *b, int ldb, double *c,
+                              int ldc);
+gemm_fixed_fn gemm_fixed_kernel(int size);
+
+// Unblocked i-k-j multiplication (used as a reference point): C += A * B.
+void matrix_multiply_standard(const matrix_t *A, const matrix_t *B, matrix_t *C);
+
+// Planned execution: gemm_plan_create does the one-time work for a fixed
+// M x K x N shape (kernel choice, blocking, task split, every worker's pack
+// buffers and its own thread pool) so gemm_plan_execute can run in a hot loop
+// without allocating. A plan is independent of gemm_set_num_threads and
+// gemm_kernel_force; plans may coexist but one plan must not be executed from
+// two threads at once (its workers and scratch are shared).
+typedef struct gemm_plan gemm_plan_t;
+
+typedef struct {
+    int threads;                       // Workers, caller included (<= 0: every online CPU).
+    const char *kernel;                // Kernel name, NULL = gemm_kernel_select().
+    const gemm_blocking_t *blocking;   // NULL = gemm_blocking_auto() for the kernel.
+    int pin;                           // Pin the workers (see gemm_pin_threads).
+    int prefetch;                      // B prefetch distance in rows (0 = off).
+} gemm_plan_options_t;
+
+#define GEMM_PLAN_OPTIONS_DEFAULT {1, NULL, NULL, 0, 0}
+
+// A is m x k, B is k x n, C is m x n; options may be NULL for the defaults.
+// Returns NULL for a non-positive shape or an unavailable kernel.
+gemm_plan_t *gemm_plan_create(int m, int k, int n, const gemm_plan_options_t *options);
+
+// C += A * B with the plan's kernel, blocking and workers. Any leading
+// dimensions are accepted. Returns 0, or -1 if the shapes differ from the plan.
+int gemm_plan_execute(const gemm_plan_t *plan, const matrix_t *A, const matrix_t *B, matrix_t *C);
+
+// Same with an epilogue (see gemm_epilogue_t; NULL = C += A * B).
+int gemm_plan_execute_fused(const gemm_plan_t *plan, const matrix_t *A, const matrix_t *B,
+                            matrix_t *C, const gemm_epilogue_t *epilogue);
+
+// One-line summary ("avx512 MC=.. KC=.. NC=.. threads T regions R").
+void gemm_plan_describe(const gemm_plan_t *plan, char *buf, size_t size);
+
+void gemm_plan_destroy(gemm_plan_t *plan);
+
+#endif
@@ -0,0 +1,203 @@
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "gemm.h"
+
+// Each kernel below is compiled for its own instruction set with a target
+// attribute, so the file builds with plain -O2 and the right one is picked
+// at runtime.
+
+// AVX2 + FMA: 6x8 tile of C = 12 ymm accumulators (4 doubles each).
+__attribute__((target("avx2,fma")))
+static void kernel_avx2_6x8(int kc, const double *a, int rs_a, int cs_a,
+                            const double *b, int ldb, double *c, int ldc) {
+    __m256d c00 = _mm256_loadu_pd(c + 0 * ldc), c01 = _mm256_loadu_pd(c + 0 * ldc + 4);
+    __m256d c10 = _mm256_loadu_pd(c + 1 * ldc), c11 = _mm256_loadu_pd(c + 1 * ldc + 4);
+    __m256d c20 = _mm256_loadu_pd(c + 2 * ldc), c21 = _mm256_loadu_pd(c + 2 * ldc + 4);
+    __m256d c30 = _mm256_loadu_pd(c + 3 * ldc), c31 = _mm256_loadu_pd(c + 3 * ldc + 4);
+    __m256d c40 = _mm256_loadu_pd(c + 4 * ldc), c41 = _mm256_loadu_pd(c + 4 * ldc + 4);
+    __m256d c50 = _mm256_loadu_pd(c + 5 * ldc), c51 = _mm256_loadu_pd(c + 5 * ldc + 4);
+
+    for (int k = 0; k < kc; k++) {
+        const double *bk = b + (size_t)k * ldb;
+        const double *ak = a + (size_t)k * cs_a;
+        __m256d b0 = _mm256_loadu_pd(bk);
+        __m256d b1 = _mm256_loadu_pd(bk + 4);
+        __m256d ai;
+
+        ai = _mm256_broadcast_sd(ak + 0 * rs_a);
+        c00 = _mm256_fmadd_pd(ai, b0, c00); c01 = _mm256_fmadd_pd(ai, b1, c01);
+        ai = _mm256_broadcast_sd(ak + 1 * rs_a);
+        c10 = _mm256_fmadd_pd(ai, b0, c10); c11 = _mm256_fmadd_pd(ai, b1, c11);
+        ai = _mm256_broadcast_sd(ak + 2 * rs_a);
+        c20 = _mm256_fmadd_pd(ai, b0, c20); c21 = _mm256_fmadd_pd(ai, b1, c21);
+        ai = _mm256_broadcast_sd(ak + 3 * rs_a);
+        c30 = _mm256_fmadd_pd(ai, b0, c30); c31 = _mm256_fmadd_pd(ai, b1, c31);
+        ai = _mm256_broadcast_sd(ak + 4 * rs_a);
+        c40 = _mm256_fmadd_pd(ai, b0, c40); c41 = _mm256_fmadd_pd(ai, b1, c41);
+        ai = _mm256_broadcast_sd(ak + 5 * rs_a);
+        c50 = _mm256_fmadd_pd(ai, b0, c50); c51 = _mm256_fmadd_pd(ai, b1, c51);
+    }
+
+    _mm256_storeu_pd(c + 0 * ldc, c00); _mm256_storeu_pd(c + 0 * ldc + 4, c01);
+    _mm256_storeu_pd(c + 1 * ldc, c10); _mm256_storeu_pd(c + 1 * ldc + 4, c11);
+    _mm256_storeu_pd(c + 2 * ldc, c20); _mm256_storeu_pd(c + 2 * ldc + 4, c21);
+    _mm256_storeu_pd(c + 3 * ldc, c30); _mm256_storeu_pd(c + 3 * ldc + 4, c31);
+    _mm256_storeu_pd(c + 4 * ldc, c40); _mm256_storeu_pd(c + 4 * ldc + 4, c41);
+    _mm256_storeu_pd(c + 5 * ldc, c50); _mm256_storeu_pd(c + 5 * ldc + 4, c51);
+}
+
+// AVX-512F: 6x16 tile of C = 12 zmm accumulators (8 doubles each).
+__attribute__((target("avx512f")))
+static void kernel_avx512_6x16(int kc, const double *a, int rs_a, int cs_a,
+                               const double *b, int ldb, double *c, int ldc) {
+    __m512d c00 = _mm512_loadu_pd(c + 0 * ldc), c01 = _mm512_loadu_pd(c + 0 * ldc + 8);
+    __m512d c10 = _mm512_loadu_pd(c + 1 * ldc), c11 = _mm512_loadu_pd(c + 1 * ldc + 8);
+    __m512d c20 = _mm512_loadu_pd(c + 2 * ldc), c21 = _mm512_loadu_pd(c + 2 * ldc + 8);
+    __m512d c30 = _mm512_loadu_pd(c + 3 * ldc), c31 = _mm512_loadu_pd(c + 3 * ldc + 8);
+    __m512d c40 = _mm512_loadu_pd(c + 4 * ldc), c41 = _mm512_loadu_pd(c + 4 * ldc + 8);
+    __m512d c50 = _mm512_loadu_pd(c + 5 * ldc), c51 = _mm512_loadu_pd(c + 5 * ldc + 8);
+
+    for (int k = 0; k < kc; k++) {
+        const double *bk = b + (size_t)k * ldb;
+        const double *ak = a + (size_t)k * cs_a;
+        __m512d b0 = _mm512_loadu_pd(bk);
+        __m512d b1 = _mm512_loadu_pd(bk + 8);
+        __m512d ai;
+
+        ai = _mm512_set1_pd(ak[0 * rs_a]);
+        c00 = _mm512_fmadd_pd(ai, b0, c00); c01 = _mm512_fmadd_pd(ai, b1, c01);
+        ai = _mm512_set1_pd(ak[1 * rs_a]);
+        c10 = _mm512_fmadd_pd(ai, b0, c10); c11 = _mm512_fmadd_pd(ai, b1, c11);
+        ai = _mm512_set1_pd(ak[2 * rs_a]);
+        c20 = _mm512_fmadd_pd(ai, b0, c20); c21 = _mm512_fmadd_pd(ai, b1, c21);
+        ai = _mm512_set1_pd(ak[3 * rs_a]);
+        c30 = _mm512_fmadd_pd(ai, b0, c30); c31 = _mm512_fmadd_pd(ai, b1, c31);
+        ai = _mm512_set1_pd(ak[4 * rs_a]);
+        c40 = _mm512_fmadd_pd(ai, b0, c40); c41 = _mm512_fmadd_pd(ai, b1, c41);
+        ai = _mm512_set1_pd(ak[5 * rs_a]);
+        c50 = _mm512_fmadd_pd(ai, b0, c50); c51 = _mm512_fmadd_pd(ai, b1, c51);
+    }
+
+    _mm512_storeu_pd(c + 0 * ldc, c00); _mm512_storeu_pd(c + 0 * ldc + 8, c01);
+    _mm512_storeu_pd(c + 1 * ldc, c10); _mm512_storeu_pd(c + 1 * ldc + 8, c11);
+    _mm512_storeu_pd(c + 2 * ldc, c20); _mm512_storeu_pd(c + 2 * ldc + 8, c21);
+    _mm512_storeu_pd(c + 3 * ldc, c30); _mm512_storeu_pd(c + 3 * ldc + 8, c31);
+    _mm512_storeu_pd(c + 4 * ldc, c40); _mm512_storeu_pd(c + 4 * ldc + 8, c41);
+    _mm512_storeu_pd(c + 5 * ldc, c50); _mm512_storeu_pd(c + 5 * ldc + 8, c51);
+}
+
+// Fixed-size square kernels for batched small problems: C += A * B with
+// S x S operands. S is a compile-time constant, so every loop over it is
+// unrolled and the R x S block of C stays in registers across the k loop.
+// GCC vector types (4 doubles) instead of intrinsics let one template
+// serve both the AVX2 build and the baseline SSE2 build.
+typedef double v4d __attribute__((vector_size(32), aligned(8), may_alias));
+
+#define UNROLL _Pragma("GCC unroll 16")
+
+#define DEFINE_FIXED_KERNEL(S, R, SUFFIX, ATTR)                                                 \
+    ATTR static void fixed_##S##SUFFIX(const double *restrict a, int lda, const double *restrict b, \
+                                       int ldb, double *restrict c, int ldc) {                    \
+        enum { V = S / 4 };                                                                     \
+        for (int i = 0; i < S; i += R) {                                                        \
+            v4d acc[R][V];                                                                      \
+            UNROLL for (int r = 0; r < R; r++) {                                                \
+                UNROLL for (int v = 0; v < V; v++) {                                            \
+                    acc[r][v] = *(const v4d *)(c + (size_t)(i + r) * ldc + 4 * v);              \
+                }                                                                               \
+            }                                                                                   \
+            for (int k = 0; k < S; k++) {                                                       \
+                v4d bv[V];                                                                      \
+                UNROLL for (int v = 0; v < V; v++) {                                            \
+                    bv[v] = *(const v4d *)(b + (size_t)k * ldb + 4 * v);                        \
+                }                                                                               \
+                UNROLL for (int r = 0; r < R; r++) {                                            \
+                    double x = a[(size_t)(i + r) * lda + k];                                    \
+                    UNROLL for (int v = 0; v < V; v++) {                                        \
+                        acc[r][v] += x * bv[v];                                                 \
+                    }                                                                           \
+                }                                                                               \
+            }                                                                                   \
+            UNROLL for (int r = 0; r < R; r++) {                                                \
+                UNROLL for (int v = 0; v < V; v++) {                                            \
+                    *(v4d *)(c + (size_t)(i + r) * ldc + 4 * v) = acc[r][v];                    \
+                }                                                                               \
+            }                                                                                   \
+        }                                                                                       \
+    }
+
+// R rows per pass: 8 accumulator registers, in ymm (AVX2) or xmm pairs (SSE2).
+DEFINE_FIXED_KERNEL(4, 4, _avx2, __attribute__((target("avx2,fma"))))
+DEFINE_FIXED_KERNEL(8, 4, _avx2, __attribute__((target("avx2,fma"))))
+DEFINE_FIXED_KERNEL(16, 2, _avx2, __attribute__((target("avx2,fma"))))
+DEFINE_FIXED_KERNEL(4, 2, _sse2, )
+DEFINE_FIXED_KERNEL(8, 2, _sse2, )
+DEFINE_FIXED_KERNEL(16, 1, _sse2, )
+
+static const gemm_kernel_t kernel_scalar = {"scalar", 1, 1, NULL};
+static const gemm_kernel_t kernel_avx2 = {"avx2", 6, 8, kernel_avx2_6x8};
+static const gemm_kernel_t kernel_avx512 = {"avx512", 6, 16, kernel_avx512_6x16};
+
+static const gemm_kernel_t *selected_kernel = NULL;
+
+// __builtin_cpu_supports reads CPUID and also checks that the OS saves the
+// wider register state (XGETBV), so a positive answer is safe to act on.
+static int kernel_supported(const gemm_kernel_t *kernel) {
+    __builtin_cpu_init();
+    if (kernel == &kernel_avx512) {
+        return __builtin_cpu_supports("avx512f");
+    }
+    if (kernel == &kernel_avx2) {
+        return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return 1;
+}
+
+const gemm_kernel_t *gemm_kernel_select(void) {
+    if (selected_kernel == NULL) {
+        if (kernel_supported(&kernel_avx512)) {
+            selected_kernel = &kernel_avx512;
+        } else if (kernel_supported(&kernel_avx2)) {
+            selected_kernel = &kernel_avx2;
+        } else {
+            selected_kernel = &kernel_scalar;
+        }
+    }
+    return selected_kernel;
+}
+
+const gemm_kernel_t *gemm_kernel_find(const char *name) {
+    const gemm_kernel_t *all[] = {&kernel_scalar, &kernel_avx2, &kernel_avx512};
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (strcmp(all[i]->name, name) == 0) {
+            return kernel_supported(all[i]) ? all[i] : NULL;
+        }
+    }
+    return NULL;
+}
+
+int gemm_kernel_force(const char *name) {
+    const gemm_kernel_t *kernel = gemm_kernel_find(name);
+    if (kernel == NULL) {
+        return -1;
+    }
+    selected_kernel = kernel;
+    return 0;
+}
+
+gemm_fixed_fn gemm_fixed_kernel(int size) {
+    // Any SIMD kernel selected implies AVX2 + FMA (every AVX-512 CPU has both).
+    int simd = gemm_kernel_select()->fn != NULL;
+    switch (size) {
+    case 4:
+        return simd ? fixed_4_avx2 : fixed_4_sse2;
+    case 8:
+        return simd ? fixed_8_avx2 : fixed_8_sse2;
+    case 16:
+        return simd ? fixed_16_avx2 : fixed_16_sse2;
+    default:
+        return NULL;
+    }
+}
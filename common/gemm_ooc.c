@@ -0,0 +1,353 @@
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "buffer.h"
+#include "gemm.h"
+#include "gemm_stats.h"
+#include "gemm_ooc.h"
+#include "matfile.h"
+#include "timing.h"
+
+#define QUEUE_SIZE 8   // Never more than two loads and two writes outstanding.
+
+enum { CMD_LOAD, CMD_WRITE, CMD_STOP };
+
+typedef struct {
+    int kind;
+    long step;   // CMD_LOAD: step to load; CMD_WRITE: first step of the C tile.
+    int slot;    // Buffer pair (CMD_LOAD) or C buffer (CMD_WRITE).
+} io_cmd_t;
+
+// An open matrix file and its validated header.
+typedef struct {
+    int fd;
+    const matfile_header_t *h;
+} file_t;
+
+typedef struct {
+    file_t a, b, c;
+    int m, n, k;
+    int tm, tn, tk;
+    int tiles_n, tiles_k;
+    long steps;
+
+    matrix_t abuf[2], bbuf[2], cbuf[2];
+    long loaded[2];    // Step held by each buffer pair, -1 if none.
+    int c_busy[2];     // C buffer waiting to be written.
+    int failed;
+
+    io_cmd_t queue[QUEUE_SIZE];
+    int head, count;
+    pthread_mutex_t lock;
+    pthread_cond_t cv;
+
+    uint64_t bytes_read, bytes_written;
+    double io_seconds;
+} ooc_job_t;
+
+static int min(int a, int b) {
+    return a < b ? a : b;
+}
+
+// Full-length pread/pwrite (both may return short counts).
+static int transfer(int write, int fd, void *buf, size_t bytes, off_t offset) {
+    char *p = (char *)buf;
+    while (bytes > 0) {
+        ssize_t done = write ? pwrite(fd, p, bytes, offset) : pread(fd, p, bytes, offset);
+        if (done <= 0) {
+            return -1;
+        }
+        p += done;
+        bytes -= done;
+        offset += done;
+    }
+    return 0;
+}
+
+// Move one tile, rows [r0, r0 + rows) and columns [c0, c0 + cols) of a file,
+// to or from a buffer with row stride ld. A tile spanning whole rows with the
+// file's own ld moves with a single pread/pwrite.
+static int transfer_tile(int write, const file_t *f, double *buf, int ld, int r0, int rows,
+                         int c0, int cols) {
+    const matfile_header_t *h = f->h;
+    off_t row_bytes = (off_t)h->ld * sizeof(double);
+    off_t base = (off_t)h->data_offset + (off_t)r0 * row_bytes + (off_t)c0 * sizeof(double);
+    if (c0 == 0 && cols == (int)h->cols && ld == (int)h->ld) {
+        return transfer(write, f->fd, buf, (size_t)rows * row_bytes, base);
+    }
+    for (int i = 0; i < rows; i++) {
+        if (transfer(write, f->fd, buf + (size_t)i * ld, (size_t)cols * sizeof(double),
+                     base + i * row_bytes) != 0) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void step_coords(const ooc_job_t *job, long step, int *ti, int *tj, int *kk) {
+    *kk = (int)(step % job->tiles_k);
+    *tj = (int)(step / job->tiles_k % job->tiles_n);
+    *ti = (int)(step / job->tiles_k / job->tiles_n);
+}
+
+// Caller holds job->lock.
+static void push(ooc_job_t *job, int kind, long step, int slot) {
+    io_cmd_t cmd = {kind, step, slot};
+    job->queue[(job->head + job->count) % QUEUE_SIZE] = cmd;
+    job->count++;
+    pthread_cond_broadcast(&job->cv);
+}
+
+static void *io_thread(void *p) {
+    ooc_job_t *job = (ooc_job_t *)p;
+    for (;;) {
+        pthread_mutex_lock(&job->lock);
+        while (job->count == 0) {
+            pthread_cond_wait(&job->cv, &job->lock);
+        }
+        io_cmd_t cmd = job->queue[job->head];
+        job->head = (job->head + 1) % QUEUE_SIZE;
+        job->count--;
+        pthread_mutex_unlock(&job->lock);
+        if (cmd.kind == CMD_STOP) {
+            return NULL;
+        }
+
+        int ti, tj, kk;
+        step_coords(job, cmd.step, &ti, &tj, &kk);
+        int r0 = ti * job->tm, c0 = tj * job->tn, k0 = kk * job->tk;
+        int rows = min(job->tm, job->m - r0), cols = min(job->tn, job->n - c0);
+        int depth = min(job->tk, job->k - k0);
+        double start = timing_now();
+        int status;
+        uint64_t bytes;
+        if (cmd.kind == CMD_LOAD) {
+            matrix_t *a = &job->abuf[cmd.slot], *b = &job->bbuf[cmd.slot];
+            status = transfer_tile(0, &job->a, a->data, a->ld, r0, rows, k0, depth);
+            status |= transfer_tile(0, &job->b, b->data, b->ld, k0, depth, c0, cols);
+            bytes = ((uint64_t)rows * depth + (uint64_t)depth * cols) * sizeof(double);
+        } else {
+            matrix_t *c = &job->cbuf[cmd.slot];
+            status = transfer_tile(1, &job->c, c->data, c->ld, r0, rows, c0, cols);
+            bytes = (uint64_t)rows * cols * sizeof(double);
+        }
+        double elapsed = timing_now() - start;
+
+        pthread_mutex_lock(&job->lock);
+        job->io_seconds += elapsed;
+        if (status != 0) {
+            job->failed = 1;
+        }
+        if (cmd.kind == CMD_LOAD) {
+            job->loaded[cmd.slot] = cmd.step;
+            job->bytes_read += bytes;
+        } else {
+            job->c_busy[cmd.slot] = 0;
+            job->bytes_written += bytes;
+        }
+        pthread_cond_broadcast(&job->cv);
+        pthread_mutex_unlock(&job->lock);
+    }
+}
+
+// Buffer for tiles of at most rows x cols of the file described by h:
+// a whole-row tile uses the file's ld so it transfers in one call. Padding
+// columns start (and stay) zero, so whole-row C writes keep the file clean.
+static matrix_t tile_buffer(int rows, int cols, const matfile_header_t *h) {
+    matrix_t m;
+    m.rows = rows;
+    m.cols = cols;
+    m.ld = cols == (int)h->cols ? (int)h->ld : cols;
+    size_t bytes = (size_t)rows * m.ld * sizeof(double);
+    m.data = (double *)buffer_alloc(bytes);
+    memset(m.data, 0, bytes);
+    return m;
+}
+
+static int open_input(const char *path, file_t *f, matfile_header_t *h) {
+    f->fd = open(path, O_RDONLY);
+    f->h = h;
+    if (f->fd < 0) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        return -1;
+    }
+    if (matfile_read_header(f->fd, path, h) != 0) {
+        return -1;
+    }
+    if (h->dtype != MATFILE_F64) {
+        fprintf(stderr, "%s: out-of-core multiply needs double matrices\n", path);
+        return -1;
+    }
+    // Tiles are read in file order within each pass.
+    posix_fadvise(f->fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    return 0;
+}
+
+// Open A and B, check the shapes and create C. Returns 0 or -1.
+static int ooc_open(ooc_job_t *job, const char *a_path, const char *b_path, const char *c_path,
+                    matfile_header_t *ha, matfile_header_t *hb, matfile_header_t *hc) {
+    if (open_input(a_path, &job->a, ha) != 0 || open_input(b_path, &job->b, hb) != 0) {
+        return -1;
+    }
+    if (ha->cols != hb->rows) {
+        fprintf(stderr, "%s, %s: A has %llu columns but B has %llu rows\n", a_path, b_path,
+                (unsigned long long)ha->cols, (unsigned long long)hb->rows);
+        return -1;
+    }
+    job->m = (int)ha->rows;
+    job->k = (int)ha->cols;
+    job->n = (int)hb->cols;
+    job->c.h = hc;
+    job->c.fd = matfile_create_fd(c_path, job->m, job->n, MATFILE_F64, hc);
+    return job->c.fd < 0 ? -1 : 0;
+}
+
+// Tile loop on the calling thread, with the I/O thread one step ahead.
+static void ooc_run(ooc_job_t *job, size_t memory, int tile, gemm_ooc_stats_t *stats) {
+    // Six tiles resident (two A/B pairs, two C tiles): 6 T^2 doubles.
+    if (tile == 0) {
+        tile = (int)sqrt((double)memory / (6.0 * sizeof(double))) / 64 * 64;
+        tile = tile < 64 ? 64 : tile;
+    }
+    job->tm = min(tile, job->m);
+    job->tn = min(tile, job->n);
+    job->tk = min(tile, job->k);
+    int tiles_m = (job->m + job->tm - 1) / job->tm;
+    job->tiles_n = (job->n + job->tn - 1) / job->tn;
+    job->tiles_k = (job->k + job->tk - 1) / job->tk;
+    job->steps = (long)tiles_m * job->tiles_n * job->tiles_k;
+    for (int s = 0; s < 2; s++) {
+        job->abuf[s] = tile_buffer(job->tm, job->tk, job->a.h);
+        job->bbuf[s] = tile_buffer(job->tk, job->tn, job->b.h);
+        job->cbuf[s] = tile_buffer(job->tm, job->tn, job->c.h);
+        job->loaded[s] = -1;
+    }
+    pthread_mutex_init(&job->lock, NULL);
+    pthread_cond_init(&job->cv, NULL);
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, io_thread, job) != 0) {
+        fprintf(stderr, "Failed to create the I/O thread\n");
+        exit(EXIT_FAILURE);
+    }
+
+    double compute = 0.0, stall = 0.0;
+    pthread_mutex_lock(&job->lock);
+    for (long s = 0; s < 2 && s < job->steps; s++) {
+        push(job, CMD_LOAD, s, (int)s);
+    }
+    pthread_mutex_unlock(&job->lock);
+
+    long tile_index = 0;
+    for (long s = 0; s < job->steps; s++) {
+        int slot = (int)(s % 2), cslot = (int)(tile_index % 2);
+        int ti, tj, kk;
+        step_coords(job, s, &ti, &tj, &kk);
+
+        // Wait for this step's tiles and, on a new C tile, for its buffer's
+        // previous write.
+        double wait = timing_now();
+        pthread_mutex_lock(&job->lock);
+        while (!job->failed && (job->loaded[slot] != s || (kk == 0 && job->c_busy[cslot]))) {
+            pthread_cond_wait(&job->cv, &job->lock);
+        }
+        int failed = job->failed;
+        pthread_mutex_unlock(&job->lock);
+        stall += timing_now() - wait;
+        if (failed) {
+            break;
+        }
+
+        int rows = min(job->tm, job->m - ti * job->tm), cols = min(job->tn, job->n - tj * job->tn);
+        int depth = min(job->tk, job->k - kk * job->tk);
+        matrix_t a = job->abuf[slot], b = job->bbuf[slot], c = job->cbuf[cslot];
+        a.rows = rows;
+        a.cols = depth;
+        b.rows = depth;
+        b.cols = cols;
+        c.rows = rows;
+        c.cols = cols;
+        double t0 = timing_now();
+        if (kk == 0) {
+            matrix_fill(&c, 0.0);
+        }
+        matrix_multiply_blocked(&a, &b, &c, NULL);
+        compute += timing_now() - t0;
+
+        pthread_mutex_lock(&job->lock);
+        job->loaded[slot] = -1;
+        if (kk == job->tiles_k - 1) {
+            job->c_busy[cslot] = 1;
+            push(job, CMD_WRITE, s, cslot);
+            tile_index++;
+        }
+        if (s + 2 < job->steps) {
+            push(job, CMD_LOAD, s + 2, slot);
+        }
+        pthread_mutex_unlock(&job->lock);
+    }
+
+    // The I/O thread drains the queue (pending C writes) before stopping.
+    pthread_mutex_lock(&job->lock);
+    push(job, CMD_STOP, 0, 0);
+    pthread_mutex_unlock(&job->lock);
+    pthread_join(thread, NULL);
+    pthread_mutex_destroy(&job->lock);
+    pthread_cond_destroy(&job->cv);
+    for (int s = 0; s < 2; s++) {
+        buffer_free(job->abuf[s].data);
+        buffer_free(job->bbuf[s].data);
+        buffer_free(job->cbuf[s].data);
+    }
+
+    if (stats) {
+        stats->tile_m = job->tm;
+        stats->tile_n = job->tn;
+        stats->tile_k = job->tk;
+        stats->steps = job->steps;
+        stats->bytes_read = job->bytes_read;
+        stats->bytes_written = job->bytes_written;
+        stats->io_seconds = job->io_seconds;
+        stats->compute_seconds = compute;
+        stats->stall_seconds = stall;
+    }
+}
+
+int gemm_ooc_multiply(const char *a_path, const char *b_path, const char *c_path,
+                      const gemm_ooc_options_t *options, gemm_ooc_stats_t *stats) {
+    double start = timing_now();
+    gemm_stats_call_t call;
+    gemm_stats_begin(&call, GEMM_STATS_OUT_OF_CORE);
+    ooc_job_t job;
+    memset(&job, 0, sizeof(job));
+    job.a.fd = job.b.fd = job.c.fd = -1;
+    if (stats) {
+        memset(stats, 0, sizeof(*stats));
+    }
+
+    matfile_header_t ha, hb, hc;
+    int status = ooc_open(&job, a_path, b_path, c_path, &ha, &hb, &hc);
+    if (status == 0) {
+        size_t memory = options && options->memory ? options->memory : GEMM_OOC_DEFAULT_MEMORY;
+        ooc_run(&job, memory, options && options->tile > 0 ? options->tile : 0, stats);
+        if (job.failed) {
+            fprintf(stderr, "%s: I/O error during the out-of-core multiply\n", c_path);
+            status = -1;
+        }
+    }
+
+    if (job.a.fd >= 0) close(job.a.fd);
+    if (job.b.fd >= 0) close(job.b.fd);
+    if (job.c.fd >= 0 && close(job.c.fd) != 0) {
+        status = -1;
+    }
+    if (stats) {
+        stats->seconds = timing_now() - start;
+    }
+    gemm_stats_end(&call, status == 0 ? 2.0 * ha.rows * ha.cols * hb.cols : 0.0);
+    return status;
+}
@@ -0,0 +1,41 @@
+#ifndef GEMM_OOC_H
+#define GEMM_OOC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Out-of-core multiply on matrix files (common/matfile.h), for operands
+// that do not fit in memory: C = A * B with only a few tiles resident.
+//
+// C is computed one tile_m x tile_n tile at a time, accumulating over K in
+// tile_k slices with matrix_multiply_blocked (so on the GEMM threads). A
+// separate I/O thread runs one step ahead. It preads the next A and B
+// tiles into the second of two buffer pairs while the current pair is
+// multiplied, and pwrites each finished C tile, again from one of two
+// buffers, while the next tile is computed. With enough compute per byte
+// (large tiles), disk bandwidth rather than stalls sets the speed.
+typedef struct {
+    size_t memory;   // Budget for all tile buffers in bytes (0 = GEMM_OOC_DEFAULT_MEMORY).
+    int tile;        // Tile side (0 = the largest multiple of 64 that fits memory).
+} gemm_ooc_options_t;
+
+#define GEMM_OOC_DEFAULT_MEMORY ((size_t)256 << 20)
+
+typedef struct {
+    int tile_m, tile_n, tile_k;   // Tile sizes used.
+    long steps;                   // A/B tile pairs multiplied.
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    double seconds;               // Wall clock, whole call.
+    double io_seconds;            // Spent in pread/pwrite (I/O thread).
+    double compute_seconds;       // Spent multiplying (calling thread).
+    double stall_seconds;         // Calling thread waiting for a tile or a C buffer.
+} gemm_ooc_stats_t;
+
+// A (M x K) and B (K x N) must be double matrix files; c_path is created
+// (or truncated) as M x N. options and stats may be NULL. Returns 0, or -1
+// after a message on stderr (bad input files, shape mismatch, I/O error).
+int gemm_ooc_multiply(const char *a_path, const char *b_path, const char *c_path,
+                      const gemm_ooc_options_t *options, gemm_ooc_stats_t *stats);
+
+#endif
@@ -0,0 +1,321 @@
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "gemm_stats.h"
+
+#define SUB_COUNT (1 << GEMM_STATS_SUB_BITS)
+
+// One per recording thread, written only by its owner; readers walk the
+// list with atomic loads. Shards are never freed, so a thread's counts stay
+// in the totals after it exits.
+typedef struct stats_shard {
+    struct stats_shard *next;
+    gemm_stats_entry_t engine[GEMM_STATS_ENGINES];
+    int countdown;   // Calls left until the next hardware-counter sample.
+} stats_shard_t;
+
+static stats_shard_t *shards;   // Lock-free push-only list.
+static int enabled;
+static int sample_every;
+static int sample_busy;         // 1 while some thread owns the perf counters.
+static uint64_t epoch_ns;
+
+static __thread stats_shard_t *my_shard;
+static __thread int depth;      // Instrumented calls in progress on this thread.
+
+static const char *engine_names[GEMM_STATS_ENGINES] = {
+    "blocked", "plan", "recursive", "strassen", "batch", "sparse", "out_of_core",
+};
+
+// Prometheus-friendly names of the perf_counters.h events.
+static const char *event_names[PERF_NUM_EVENTS] = {
+    "cycles", "instructions", "l1d_misses", "llc_misses", "dtlb_misses", "fp_ops",
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+void gemm_stats_enable(int on) {
+    uint64_t expected = 0;
+    __atomic_compare_exchange_n(&epoch_ns, &expected, now_ns(), 0, __ATOMIC_RELAXED,
+                                __ATOMIC_RELAXED);
+    __atomic_store_n(&enabled, on ? 1 : 0, __ATOMIC_RELAXED);
+}
+
+int gemm_stats_enabled(void) {
+    return __atomic_load_n(&enabled, __ATOMIC_RELAXED);
+}
+
+void gemm_stats_set_sampling(int every) {
+    __atomic_store_n(&sample_every, every > 0 ? every : 0, __ATOMIC_RELAXED);
+}
+
+const char *gemm_stats_engine_name(int engine) {
+    return engine >= 0 && engine < GEMM_STATS_ENGINES ? engine_names[engine] : "unknown";
+}
+
+static stats_shard_t *shard_get(void) {
+    if (my_shard) {
+        return my_shard;
+    }
+    stats_shard_t *s = (stats_shard_t *)calloc(1, sizeof(*s));
+    if (!s) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    s->next = __atomic_load_n(&shards, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&shards, &s->next, s, 1, __ATOMIC_RELEASE,
+                                        __ATOMIC_RELAXED)) {
+    }
+    return my_shard = s;
+}
+
+// Single-writer update: a relaxed store (no locked instruction) that
+// concurrent snapshots read without tearing.
+static inline void add(uint64_t *counter, uint64_t v) {
+    __atomic_store_n(counter, __atomic_load_n(counter, __ATOMIC_RELAXED) + v, __ATOMIC_RELAXED);
+}
+
+static int bucket_index(uint64_t ns) {
+    if (ns < SUB_COUNT) {
+        return (int)ns;
+    }
+    int e = 63 - __builtin_clzll(ns);
+    if (e > GEMM_STATS_MAX_EXP) {
+        return GEMM_STATS_BUCKETS - 1;
+    }
+    int sub = (int)(ns >> (e - GEMM_STATS_SUB_BITS)) & (SUB_COUNT - 1);
+    return ((e - GEMM_STATS_SUB_BITS + 1) << GEMM_STATS_SUB_BITS) + sub;
+}
+
+// Middle of a bucket's range, in nanoseconds.
+static double bucket_mid(int index) {
+    if (index < SUB_COUNT) {
+        return index + 0.5;
+    }
+    int e = (index >> GEMM_STATS_SUB_BITS) + GEMM_STATS_SUB_BITS - 1;
+    int sub = index & (SUB_COUNT - 1);
+    double width = ldexp(1.0, e - GEMM_STATS_SUB_BITS);
+    return (SUB_COUNT + sub) * width + width / 2;
+}
+
+void gemm_stats_begin(gemm_stats_call_t *call, int engine) {
+    call->start = 0;
+    call->engine = -1;
+    if (!__atomic_load_n(&enabled, __ATOMIC_RELAXED)) {
+        return;
+    }
+    call->engine = engine;
+    if (depth++ > 0) {
+        return;   // Nested (start stays 0): counted by the outer call.
+    }
+    stats_shard_t *s = shard_get();
+    call->sampled = 0;
+    int every = __atomic_load_n(&sample_every, __ATOMIC_RELAXED);
+    if (every > 0 && --s->countdown <= 0) {
+        s->countdown = every;
+        int idle = 0;
+        if (perf_counters_enabled() &&
+            __atomic_compare_exchange_n(&sample_busy, &idle, 1, 0, __ATOMIC_ACQUIRE,
+                                        __ATOMIC_RELAXED)) {
+            call->sampled = 1;
+            perf_counters_read(&call->before);
+            perf_counters_resume();
+        }
+    }
+    call->start = now_ns();
+}
+
+void gemm_stats_end(gemm_stats_call_t *call, double flops) {
+    if (call->engine < 0) {
+        return;
+    }
+    depth--;
+    if (call->start == 0) {
+        return;
+    }
+    uint64_t ns = now_ns() - call->start;
+    gemm_stats_entry_t *e = &my_shard->engine[call->engine];
+    if (call->sampled) {
+        perf_sample_t after;
+        perf_counters_pause();
+        perf_counters_read(&after);
+        __atomic_store_n(&sample_busy, 0, __ATOMIC_RELEASE);
+        for (int v = 0; v < PERF_NUM_EVENTS; v++) {
+            if (after.valid[v] && call->before.valid[v]) {
+                double d = after.value[v] - call->before.value[v];
+                add(&e->events[v], d > 0.0 ? (uint64_t)llround(d) : 0);
+                if (!(e->event_mask & (1ULL << v))) {
+                    add(&e->event_mask, 1ULL << v);
+                }
+            }
+        }
+        add(&e->samples, 1);
+    }
+    add(&e->calls, 1);
+    add(&e->flops, (uint64_t)flops);
+    add(&e->nanoseconds, ns);
+    add(&e->buckets[bucket_index(ns)], 1);
+    if (ns > e->max_ns) {
+        __atomic_store_n(&e->max_ns, ns, __ATOMIC_RELAXED);
+    }
+}
+
+void gemm_stats_snapshot(gemm_stats_snapshot_t *out) {
+    memset(out, 0, sizeof(*out));
+    uint64_t epoch = __atomic_load_n(&epoch_ns, __ATOMIC_RELAXED);
+    out->seconds = epoch ? (now_ns() - epoch) * 1e-9 : 0.0;
+    for (stats_shard_t *s = __atomic_load_n(&shards, __ATOMIC_ACQUIRE); s; s = s->next) {
+        out->threads++;
+        for (int g = 0; g < GEMM_STATS_ENGINES; g++) {
+            const gemm_stats_entry_t *src = &s->engine[g];
+            gemm_stats_entry_t *dst = &out->engine[g];
+            dst->calls += __atomic_load_n(&src->calls, __ATOMIC_RELAXED);
+            dst->flops += __atomic_load_n(&src->flops, __ATOMIC_RELAXED);
+            dst->nanoseconds += __atomic_load_n(&src->nanoseconds, __ATOMIC_RELAXED);
+            uint64_t max_ns = __atomic_load_n(&src->max_ns, __ATOMIC_RELAXED);
+            dst->max_ns = max_ns > dst->max_ns ? max_ns : dst->max_ns;
+            for (int b = 0; b < GEMM_STATS_BUCKETS; b++) {
+                dst->buckets[b] += __atomic_load_n(&src->buckets[b], __ATOMIC_RELAXED);
+            }
+            dst->samples += __atomic_load_n(&src->samples, __ATOMIC_RELAXED);
+            for (int v = 0; v < PERF_NUM_EVENTS; v++) {
+                dst->events[v] += __atomic_load_n(&src->events[v], __ATOMIC_RELAXED);
+            }
+            dst->event_mask |= __atomic_load_n(&src->event_mask, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+double gemm_stats_quantile(const gemm_stats_entry_t *e, double q) {
+    // Buckets, not calls: a snapshot taken mid-update may see one without the other.
+    uint64_t total = 0;
+    for (int b = 0; b < GEMM_STATS_BUCKETS; b++) {
+        total += e->buckets[b];
+    }
+    if (total == 0) {
+        return 0.0;
+    }
+    uint64_t rank = (uint64_t)ceil(q * total);
+    rank = rank < 1 ? 1 : rank;
+    uint64_t seen = 0;
+    for (int b = 0; b < GEMM_STATS_BUCKETS; b++) {
+        seen += e->buckets[b];
+        if (seen >= rank) {
+            // The top bucket's midpoint can lie past the slowest call seen.
+            double mid = bucket_mid(b);
+            return (e->max_ns && mid > e->max_ns ? e->max_ns : mid) * 1e-9;
+        }
+    }
+    return e->max_ns * 1e-9;
+}
+
+void gemm_stats_print(FILE *out, const gemm_stats_snapshot_t *s) {
+    fprintf(out, "Engine, Calls, GFLOP/s, Mean (msec), P50 (msec), P99 (msec), P99.9 (msec), "
+                 "Max (msec), Sampled, Cycles/call, IPC\n");
+    for (int g = 0; g < GEMM_STATS_ENGINES; g++) {
+        const gemm_stats_entry_t *e = &s->engine[g];
+        if (e->calls == 0) {
+            continue;
+        }
+        fprintf(out, "%s, %llu, %.2f, %.4f, %.4f, %.4f, %.4f, %.4f, %llu", engine_names[g],
+                (unsigned long long)e->calls,
+                e->nanoseconds ? (double)e->flops / e->nanoseconds : 0.0,
+                e->nanoseconds * 1e-6 / e->calls, gemm_stats_quantile(e, 0.5) * 1e3,
+                gemm_stats_quantile(e, 0.99) * 1e3, gemm_stats_quantile(e, 0.999) * 1e3,
+                e->max_ns * 1e-6, (unsigned long long)e->samples);
+        uint64_t both = (1ULL << PERF_CYCLES) | (1ULL << PERF_INSTRUCTIONS);
+        if (e->samples && (e->event_mask & both) == both && e->events[PERF_CYCLES]) {
+            fprintf(out, ", %.0f, %.2f\n", (double)e->events[PERF_CYCLES] / e->samples,
+                    (double)e->events[PERF_INSTRUCTIONS] / e->events[PERF_CYCLES]);
+        } else {
+            fprintf(out, ", n/a, n/a\n");
+        }
+    }
+}
+
+// Header lines of one metric family.
+static void family(FILE *out, const char *name, const char *type, const char *help) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+void gemm_stats_print_prometheus(FILE *out, const gemm_stats_snapshot_t *s) {
+    family(out, "mxm_calls_total", "counter", "Multiply calls by engine.");
+    for (int g = 0; g < GEMM_STATS_ENGINES; g++) {
+        fprintf(out, "mxm_calls_total{engine=\"%s\"} %llu\n", engine_names[g],
+                (unsigned long long)s->engine[g].calls);
+    }
+    family(out, "mxm_flops_total", "counter", "Floating-point operations performed.");
+    for (int g = 0; g < GEMM_STATS_ENGINES; g++) {
+        fprintf(out, "mxm_flops_total{engine=\"%s\"} %llu\n", engine_names[g],
+                (unsigned long long)s->engine[g].flops);
+    }
+
+    // Cumulative buckets at powers of four from about 1 us (1.02 us, 4.1 us,
+    // 16.4 us, ...); the HDR buckets underneath are much finer.
+    family(out, "mxm_call_duration_seconds", "histogram", "Latency of each multiply call.");
+    for (int g = 0; g < GEMM_STATS_ENGINES; g++) {
+        const gemm_stats_entry_t *e = &s->engine[g];
+        if (e->calls == 0) {
+            continue;
+        }
+        uint64_t cumulative = 0;
+        int b = 0;
+        for (int exp = 10; exp <= GEMM_STATS_MAX_EXP; exp += 2) {
+            int limit = bucket_index(1ULL << exp);   // First bucket at or above 2^exp ns.
+            while (b < limit) {
+                cumulative += e->buckets[b++];
+            }
+            fprintf(out, "mxm_call_duration_seconds_bucket{engine=\"%s\",le=\"%.6g\"} %llu\n",
+                    engine_names[g], ldexp(1e-9, exp), (unsigned long long)cumulative);
+        }
+        while (b < GEMM_STATS_BUCKETS) {
+            cumulative += e->buckets[b++];
+        }
+        fprintf(out, "mxm_call_duration_seconds_bucket{engine=\"%s\",le=\"+Inf\"} %llu\n",
+                engine_names[g], (unsigned long long)cumulative);
+        fprintf(out, "mxm_call_duration_seconds_sum{engine=\"%s\"} %.9f\n", engine_names[g],
+                e->nanoseconds * 1e-9);
+        fprintf(out, "mxm_call_duration_seconds_count{engine=\"%s\"} %llu\n", engine_names[g],
+                (unsigned long long)cumulative);
+    }
+
+    // Quantiles from the fine buckets, as gauges (a histogram family cannot
+    // carry them).
+    family(out, "mxm_call_latency_quantile_seconds", "gauge",
+           "Call latency quantiles from the HDR histogram.");
+    const double quantiles[] = {0.5, 0.9, 0.99, 0.999};
+    for (int g = 0; g < GEMM_STATS_ENGINES; g++) {
+        if (s->engine[g].calls == 0) {
+            continue;
+        }
+        for (int q = 0; q < 4; q++) {
+            fprintf(out, "mxm_call_latency_quantile_seconds{engine=\"%s\",quantile=\"%g\"} %.9f\n",
+                    engine_names[g], quantiles[q], gemm_stats_quantile(&s->engine[g], quantiles[q]));
+        }
+    }
+
+    family(out, "mxm_sampled_calls_total", "counter", "Calls measured with hardware counters.");
+    for (int g = 0; g < GEMM_STATS_ENGINES; g++) {
+        fprintf(out, "mxm_sampled_calls_total{engine=\"%s\"} %llu\n", engine_names[g],
+                (unsigned long long)s->engine[g].samples);
+    }
+    family(out, "mxm_sampled_events_total", "counter",
+           "Hardware events summed over the sampled calls.");
+    for (int g = 0; g < GEMM_STATS_ENGINES; g++) {
+        const gemm_stats_entry_t *e = &s->engine[g];
+        for (int v = 0; v < PERF_NUM_EVENTS; v++) {
+            if (e->event_mask & (1ULL << v)) {
+                fprintf(out, "mxm_sampled_events_total{engine=\"%s\",event=\"%s\"} %llu\n",
+                        engine_names[g], event_names[v], (unsigned long long)e->events[v]);
+            }
+        }
+    }
+    family(out, "mxm_stats_threads", "gauge", "Threads that have recorded a multiply call.");
+    fprintf(out, "mxm_stats_threads %d\n", s->threads);
+}
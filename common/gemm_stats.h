@@ -0,0 +1,97 @@
+#ifndef GEMM_STATS_H
+#define GEMM_STATS_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "perf_counters.h"
+
+// Live instrumentation of the multiply entry points, cheap enough to leave
+// on in a service: per-engine call counts, flops, busy time and an HDR-style
+// latency histogram, recorded by the calling thread into a shard of its own
+// (no locks, no shared cache lines on the hot path), plus optional hardware
+// counters for 1 in N calls. Snapshots sum the shards while they are written.
+//
+// Only the outermost call is recorded: Strassen's leaf products, the
+// out-of-core tile multiplies and an adaptive call's CSR or dense path are
+// counted once, under the engine the caller asked for. Disabled (the
+// default), each entry point pays one relaxed load and a branch.
+typedef enum {
+    GEMM_STATS_BLOCKED,       // matrix_multiply_blocked / matrix_multiply_fused.
+    GEMM_STATS_PLAN,          // gemm_plan_execute / gemm_plan_execute_fused.
+    GEMM_STATS_RECURSIVE,     // matrix_multiply_recursive (and _morton).
+    GEMM_STATS_STRASSEN,
+    GEMM_STATS_BATCH,         // Both batched layouts, one call per batch.
+    GEMM_STATS_SPARSE,        // csr_multiply / bsr_multiply (flops = 2 nnz N).
+    GEMM_STATS_OUT_OF_CORE,   // gemm_ooc_multiply.
+    GEMM_STATS_ENGINES
+} gemm_stats_engine_t;
+
+// Log-linear buckets: values below 2^GEMM_STATS_SUB_BITS ns have a bucket
+// each, and every later power of two is split into 2^GEMM_STATS_SUB_BITS
+// equal buckets, so any latency is known within 1/16 (6.25%). Latencies
+// above 2^GEMM_STATS_MAX_EXP ns (about 18 minutes) land in the last bucket.
+#define GEMM_STATS_SUB_BITS 4
+#define GEMM_STATS_MAX_EXP 40
+#define GEMM_STATS_BUCKETS ((GEMM_STATS_MAX_EXP - GEMM_STATS_SUB_BITS + 2) << GEMM_STATS_SUB_BITS)
+
+typedef struct {
+    uint64_t calls;
+    uint64_t flops;
+    uint64_t nanoseconds;   // Summed call latency.
+    uint64_t max_ns;
+    uint64_t buckets[GEMM_STATS_BUCKETS];
+    uint64_t samples;       // Calls measured with hardware counters.
+    uint64_t events[PERF_NUM_EVENTS];   // Summed over the samples.
+    uint64_t event_mask;    // Bit e set once event e was read (others are not available).
+} gemm_stats_entry_t;
+
+typedef struct {
+    double seconds;   // Since gemm_stats_enable(1) was first called.
+    int threads;      // Threads that have recorded a call.
+    gemm_stats_entry_t engine[GEMM_STATS_ENGINES];
+} gemm_stats_snapshot_t;
+
+// Turn recording on or off (process-wide; calls in flight finish normally).
+void gemm_stats_enable(int on);
+int gemm_stats_enabled(void);
+
+// Measure 1 in every calls per thread with the counters of perf_counters.h
+// (0 = never, the default). The counters must already be open, before the
+// worker pools were created, so workers inherit them. Samples are taken one
+// at a time process-wide (a call that finds one in progress is not sampled),
+// include anything else the process runs meanwhile, and pause the shared
+// counters on return (a timing_run with --perf around the call is unaffected
+// as long as the multiply ends its timed body).
+void gemm_stats_set_sampling(int every);
+
+// Sum of every thread's counters so far (they only grow, like Prometheus
+// counters; compare two snapshots for rates).
+void gemm_stats_snapshot(gemm_stats_snapshot_t *out);
+
+// Latency at quantile q in [0, 1] in seconds, from the histogram (bucket
+// midpoint); 0 without calls.
+double gemm_stats_quantile(const gemm_stats_entry_t *e, double q);
+
+// "blocked", "plan", "recursive", "strassen", "batch", "sparse", "out_of_core".
+const char *gemm_stats_engine_name(int engine);
+
+// Human-readable table: one line per engine that has calls.
+void gemm_stats_print(FILE *out, const gemm_stats_snapshot_t *s);
+
+// Prometheus text exposition format (mxm_* metrics, engine label).
+void gemm_stats_print_prometheus(FILE *out, const gemm_stats_snapshot_t *s);
+
+// Hooks around an entry point's body. begin returns immediately when
+// recording is off; end takes the call's flop count.
+typedef struct {
+    uint64_t start;   // 0 = not recorded.
+    int engine;
+    int sampled;
+    perf_sample_t before;
+} gemm_stats_call_t;
+
+void gemm_stats_begin(gemm_stats_call_t *call, int engine);
+void gemm_stats_end(gemm_stats_call_t *call, double flops);
+
+#endif
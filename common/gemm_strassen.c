@@ -0,0 +1,190 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "arena.h"
+#include "gemm.h"
+#include "gemm_stats.h"
+#include "timing.h"
+
+// Strassen-Winograd on top of matrix_multiply_blocked: 7 half-size products
+// and 15 half-size additions per level. The schedule (Douglas et al., 1994)
+// computes C = A * B with two quadrant-sized temporaries per level, using the
+// quadrants of C itself as the remaining workspace.
+
+// Temporaries come from a bump allocator per call, over one scratch_get
+// buffer, so concurrent calls never share them. Levels release their two
+// matrices on return, so the arena only ever holds one chain of recursion.
+// The scratch pools keep the buffer after the call, so timed repetitions do
+// not allocate. Quadrant sizes are powers of two, exactly the strides
+// matrix_padded_ld() is there to break, so every temporary is padded.
+
+// View of quadrant (qi, qj) of a square matrix with even side.
+static matrix_t quadrant(const matrix_t *m, int qi, int qj) {
+    matrix_t q;
+    q.rows = m->rows / 2;
+    q.cols = m->cols / 2;
+    q.ld = m->ld;
+    q.data = m->data + (size_t)qi * q.rows * m->ld + (size_t)qj * q.cols;
+    return q;
+}
+
+// z = x + sign * y (z may alias x or y).
+static void mat_sum(matrix_t *z, const matrix_t *x, const matrix_t *y, double sign) {
+    for (int i = 0; i < z->rows; i++) {
+        const double *xr = &MAT(x, i, 0), *yr = &MAT(y, i, 0);
+        double *zr = &MAT(z, i, 0);
+        for (int j = 0; j < z->cols; j++) {
+            zr[j] = xr[j] + sign * yr[j];
+        }
+    }
+}
+
+// C = A * B (overwrites C), levels more levels of recursion.
+static void winograd(arena_t *arena, const matrix_t *A, const matrix_t *B, matrix_t *C,
+                     int levels) {
+    if (levels == 0) {
+        for (int i = 0; i < C->rows; i++) {
+            memset(&MAT(C, i, 0), 0, (size_t)C->cols * sizeof(double));
+        }
+        matrix_multiply_blocked(A, B, C, NULL);
+        return;
+    }
+
+    int h = A->rows / 2;
+    size_t mark = arena->used;
+    matrix_t X = arena_matrix(arena, h, h, 1), Y = arena_matrix(arena, h, h, 1);
+    matrix_t A11 = quadrant(A, 0, 0), A12 = quadrant(A, 0, 1);
+    matrix_t A21 = quadrant(A, 1, 0), A22 = quadrant(A, 1, 1);
+    matrix_t B11 = quadrant(B, 0, 0), B12 = quadrant(B, 0, 1);
+    matrix_t B21 = quadrant(B, 1, 0), B22 = quadrant(B, 1, 1);
+    matrix_t C11 = quadrant(C, 0, 0), C12 = quadrant(C, 0, 1);
+    matrix_t C21 = quadrant(C, 1, 0), C22 = quadrant(C, 1, 1);
+
+    mat_sum(&X, &A11, &A21, -1.0);                  // S3 = A11 - A21
+    mat_sum(&Y, &B22, &B12, -1.0);                  // T3 = B22 - B12
+    winograd(arena, &X, &Y, &C21, levels - 1);      // P7 = S3 T3
+    mat_sum(&X, &A21, &A22, 1.0);                   // S1 = A21 + A22
+    mat_sum(&Y, &B12, &B11, -1.0);                  // T1 = B12 - B11
+    winograd(arena, &X, &Y, &C22, levels - 1);      // P5 = S1 T1
+    mat_sum(&X, &X, &A11, -1.0);                    // S2 = S1 - A11
+    mat_sum(&Y, &B22, &Y, -1.0);                    // T2 = B22 - T1
+    winograd(arena, &X, &Y, &C12, levels - 1);      // P6 = S2 T2
+    mat_sum(&X, &A12, &X, -1.0);                    // S4 = A12 - S2
+    winograd(arena, &X, &B22, &C11, levels - 1);    // P3 = S4 B22
+    winograd(arena, &A11, &B11, &X, levels - 1);    // P1 = A11 B11
+    mat_sum(&C12, &X, &C12, 1.0);                   // U2 = P1 + P6
+    mat_sum(&C21, &C12, &C21, 1.0);                 // U3 = U2 + P7
+    mat_sum(&C12, &C12, &C22, 1.0);                 // U4 = U2 + P5
+    mat_sum(&C22, &C21, &C22, 1.0);                 // C22 = U3 + P5
+    mat_sum(&C12, &C12, &C11, 1.0);                 // C12 = U4 + P3
+    mat_sum(&Y, &Y, &B21, -1.0);                    // T4 = T2 - B21
+    winograd(arena, &A22, &Y, &C11, levels - 1);    // P4 = A22 T4
+    mat_sum(&C21, &C21, &C11, -1.0);                // C21 = U3 - P4
+    winograd(arena, &A12, &B21, &C11, levels - 1);  // P2 = A12 B21
+    mat_sum(&C11, &X, &C11, 1.0);                   // C11 = P1 + P2
+
+    arena_reset(arena, mark);
+}
+
+int gemm_strassen_levels(int n, int crossover) {
+    int levels = 0;
+    while (n > crossover && n > 1) {
+        n = (n + 1) / 2;
+        levels++;
+    }
+    return levels;
+}
+
+static int crossover_measured;
+static pthread_once_t crossover_once = PTHREAD_ONCE_INIT;
+
+static void measure_crossover(void) {
+    // A level at side n saves n^3 / 4 flops and costs 15 additions over
+    // (n/2)^2 elements, 24 bytes each (two loads, one store): 90 n^2 bytes.
+    // It pays off while n > 360 F / BW, for kernel rate F (flop/s) and
+    // addition bandwidth BW (bytes/s), both measured here at side 512.
+    const int n = 512;
+    matrix_t a = matrix_create(n, n, 1), b = matrix_create(n, n, 1), c = matrix_create(n, n, 1);
+    matrix_fill(&a, 1.0);
+    matrix_fill(&b, 1.0);
+    matrix_fill(&c, 0.0);
+    matrix_multiply_blocked(&a, &b, &c, NULL);   // Warm up caches and threads.
+    double t0 = timing_now();
+    matrix_multiply_blocked(&a, &b, &c, NULL);
+    double t1 = timing_now();
+    mat_sum(&c, &a, &b, 1.0);
+    double t2 = timing_now();
+    mat_sum(&c, &a, &b, 1.0);
+    double t3 = timing_now();
+
+    double flops = 2.0 * n * n * n / (t1 - t0);
+    double bandwidth = 24.0 * n * n / (t3 - t2);
+    double side = 360.0 * flops / bandwidth;
+    crossover_measured = side < 128 ? 128 : side > 4096 ? 4096 : (int)side / 64 * 64;
+
+    matrix_free(&a);
+    matrix_free(&b);
+    matrix_free(&c);
+}
+
+int gemm_strassen_crossover(void) {
+    pthread_once(&crossover_once, measure_crossover);
+    return crossover_measured;
+}
+
+void matrix_multiply_strassen(const matrix_t *A, const matrix_t *B, matrix_t *C, int crossover) {
+    int n = A->rows;
+    if (crossover <= 0) {
+        crossover = gemm_strassen_crossover();
+    }
+    // Counted as one classical product (2 n^3), like every other engine,
+    // so GFLOP/s figures compare directly.
+    double flops = 2.0 * C->rows * C->cols * A->cols;
+    gemm_stats_call_t call;
+    gemm_stats_begin(&call, GEMM_STATS_STRASSEN);
+    int levels = gemm_strassen_levels(n, crossover);
+    if (A->cols != n || B->rows != n || B->cols != n || levels == 0) {
+        matrix_multiply_blocked(A, B, C, NULL);
+        gemm_stats_end(&call, flops);
+        return;
+    }
+
+    // Pad to a multiple of 2^levels so every level halves evenly; the zero
+    // padding only adds zero terms.
+    int p = (n + (1 << levels) - 1) >> levels << levels;
+    int pad = p != n;
+    size_t bytes = (pad ? 2 : 0) * arena_matrix_bytes(p, p, 1) + arena_matrix_bytes(p, p, 1);
+    for (int l = 1, side = p / 2; l <= levels; l++, side /= 2) {
+        bytes += 2 * arena_matrix_bytes(side, side, 1);
+    }
+    void *block = scratch_get(bytes);
+    arena_t arena;
+    arena_init_block(&arena, block, bytes);
+
+    matrix_t a = *A, b = *B;
+    if (pad) {
+        a = arena_matrix(&arena, p, p, 1);
+        b = arena_matrix(&arena, p, p, 1);
+        matrix_fill(&a, 0.0);
+        matrix_fill(&b, 0.0);
+        for (int i = 0; i < n; i++) {
+            memcpy(&MAT(&a, i, 0), &MAT(A, i, 0), (size_t)n * sizeof(double));
+            memcpy(&MAT(&b, i, 0), &MAT(B, i, 0), (size_t)n * sizeof(double));
+        }
+    }
+    matrix_t product = arena_matrix(&arena, p, p, 1);
+    winograd(&arena, &a, &b, &product, levels);
+
+    // The other engines accumulate (C += A * B); keep that contract.
+    for (int i = 0; i < n; i++) {
+        double *c_row = &MAT(C, i, 0);
+        const double *p_row = &MAT(&product, i, 0);
+        for (int j = 0; j < n; j++) {
+            c_row[j] += p_row[j];
+        }
+    }
+    scratch_put(block);
+    gemm_stats_end(&call, flops);
+}
@@ -0,0 +1,264 @@
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "matfile.h"
+
+#define WRITE_BUFFER (1 << 20)   // stdio buffer of the streaming writer.
+
+// Same rule as typed_matrix_create(padded): whole cache lines, plus one line
+// on 1 KiB multiples (equal to matrix_padded_ld for doubles).
+static uint64_t file_ld(int cols, size_t elem_size) {
+    int per_line = MATRIX_ALIGNMENT / (int)elem_size;
+    uint64_t ld = (uint64_t)(cols + per_line - 1) / per_line * per_line;
+    if (ld * elem_size % 1024 == 0) {
+        ld += per_line;
+    }
+    return ld;
+}
+
+static size_t dtype_size(matfile_dtype_t dtype) {
+    switch (dtype) {
+    case MATFILE_F64: return sizeof(double);
+    case MATFILE_F32: return sizeof(float);
+    case MATFILE_BF16: return sizeof(bf16_t);
+    }
+    return 0;
+}
+
+const char *matfile_dtype_name(matfile_dtype_t dtype) {
+    switch (dtype) {
+    case MATFILE_F64: return "double";
+    case MATFILE_F32: return "float";
+    case MATFILE_BF16: return "bf16";
+    }
+    return "unknown";
+}
+
+matfile_dtype_t matfile_dtype_parse(const char *name) {
+    if (strcmp(name, "double") == 0) return MATFILE_F64;
+    if (strcmp(name, "float") == 0) return MATFILE_F32;
+    if (strcmp(name, "bf16") == 0) return MATFILE_BF16;
+    return (matfile_dtype_t)0;
+}
+
+static int header_init(matfile_header_t *h, int rows, int cols, matfile_dtype_t dtype) {
+    size_t size = dtype_size(dtype);
+    if (rows <= 0 || cols <= 0 || size == 0) {
+        return -1;
+    }
+    memset(h, 0, sizeof(*h));
+    memcpy(h->magic, MATFILE_MAGIC, sizeof(h->magic));
+    h->version = MATFILE_VERSION;
+    h->byte_order = MATFILE_BYTE_ORDER;
+    h->dtype = dtype;
+    h->elem_size = (uint32_t)size;
+    h->rows = rows;
+    h->cols = cols;
+    h->ld = file_ld(cols, size);
+    h->alignment = MATFILE_ALIGNMENT;
+    h->data_offset = MATFILE_ALIGNMENT;
+    h->data_bytes = h->rows * h->ld * size;
+    return 0;
+}
+
+// Check a header read from a file of file_bytes bytes.
+static const char *header_check(const matfile_header_t *h, uint64_t file_bytes) {
+    if (memcmp(h->magic, MATFILE_MAGIC, sizeof(h->magic)) != 0) {
+        return "not a matrix file";
+    }
+    if (h->byte_order != MATFILE_BYTE_ORDER) {
+        return "written with a different byte order";
+    }
+    if (h->version != MATFILE_VERSION) {
+        return "unsupported version";
+    }
+    if (dtype_size((matfile_dtype_t)h->dtype) != h->elem_size) {
+        return "unknown element type";
+    }
+    if (h->rows == 0 || h->cols == 0 || h->ld < h->cols || h->rows > INT32_MAX ||
+        h->ld > INT32_MAX || h->alignment == 0 || h->data_offset % h->alignment != 0 ||
+        h->data_offset < sizeof(*h) || h->data_bytes != h->rows * h->ld * h->elem_size) {
+        return "inconsistent header";
+    }
+    if (h->data_offset + h->data_bytes > file_bytes) {
+        return "truncated payload";
+    }
+    return NULL;
+}
+
+static void set_views(matfile_t *f) {
+    const matfile_header_t *h = &f->header;
+    f->view.data = (char *)f->map + h->data_offset;
+    f->view.rows = (int)h->rows;
+    f->view.cols = (int)h->cols;
+    f->view.ld = (int)h->ld;
+    f->view.elem_size = h->elem_size;
+    f->m.rows = f->view.rows;
+    f->m.cols = f->view.cols;
+    f->m.ld = f->view.ld;
+    f->m.data = h->dtype == MATFILE_F64 ? (double *)f->view.data : NULL;
+}
+
+int matfile_map(matfile_t *f, const char *path) {
+    memset(f, 0, sizeof(*f));
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "%s: cannot open\n", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    if ((uint64_t)st.st_size < sizeof(matfile_header_t)) {
+        fprintf(stderr, "%s: not a matrix file\n", path);
+        close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);   // The mapping keeps the file open.
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s: mmap failed\n", path);
+        return -1;
+    }
+    memcpy(&f->header, map, sizeof(f->header));
+    const char *problem = header_check(&f->header, st.st_size);
+    if (problem) {
+        fprintf(stderr, "%s: %s\n", path, problem);
+        munmap(map, st.st_size);
+        return -1;
+    }
+    f->map = map;
+    f->map_bytes = st.st_size;
+    set_views(f);
+    return 0;
+}
+
+int matfile_create(matfile_t *f, const char *path, int rows, int cols, matfile_dtype_t dtype) {
+    memset(f, 0, sizeof(*f));
+    if (header_init(&f->header, rows, cols, dtype) != 0) {
+        fprintf(stderr, "%s: invalid shape or element type\n", path);
+        return -1;
+    }
+    size_t bytes = f->header.data_offset + f->header.data_bytes;
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, bytes) != 0) {
+        fprintf(stderr, "%s: cannot create\n", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    void *map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        fprintf(stderr, "%s: mmap failed\n", path);
+        return -1;
+    }
+    memcpy(map, &f->header, sizeof(f->header));
+    f->map = map;
+    f->map_bytes = bytes;
+    set_views(f);
+    return 0;
+}
+
+void matfile_unmap(matfile_t *f) {
+    if (f->map) {
+        munmap(f->map, f->map_bytes);
+    }
+    memset(f, 0, sizeof(*f));
+}
+
+int matfile_read_header(int fd, const char *path, matfile_header_t *h) {
+    struct stat st;
+    if (fstat(fd, &st) != 0 || pread(fd, h, sizeof(*h), 0) != (ssize_t)sizeof(*h)) {
+        fprintf(stderr, "%s: not a matrix file\n", path);
+        return -1;
+    }
+    const char *problem = header_check(h, st.st_size);
+    if (problem) {
+        fprintf(stderr, "%s: %s\n", path, problem);
+        return -1;
+    }
+    return 0;
+}
+
+int matfile_create_fd(const char *path, int rows, int cols, matfile_dtype_t dtype,
+                      matfile_header_t *h) {
+    if (header_init(h, rows, cols, dtype) != 0) {
+        fprintf(stderr, "%s: invalid shape or element type\n", path);
+        return -1;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, h->data_offset + h->data_bytes) != 0 ||
+        pwrite(fd, h, sizeof(*h), 0) != (ssize_t)sizeof(*h)) {
+        fprintf(stderr, "%s: cannot create\n", path);
+        if (fd >= 0) close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int matfile_writer_open(matfile_writer_t *w, const char *path, int rows, int cols,
+                        matfile_dtype_t dtype) {
+    memset(w, 0, sizeof(*w));
+    if (header_init(&w->header, rows, cols, dtype) != 0) {
+        fprintf(stderr, "%s: invalid shape or element type\n", path);
+        return -1;
+    }
+    w->fp = fopen(path, "wb");
+    if (w->fp == NULL) {
+        fprintf(stderr, "%s: cannot create\n", path);
+        return -1;
+    }
+    setvbuf(w->fp, NULL, _IOFBF, WRITE_BUFFER);
+
+    // Header page: the header, zero-padded up to data_offset.
+    static const char zeros[MATFILE_ALIGNMENT];
+    if (fwrite(&w->header, sizeof(w->header), 1, w->fp) != 1 ||
+        fwrite(zeros, w->header.data_offset - sizeof(w->header), 1, w->fp) != 1) {
+        fclose(w->fp);
+        w->fp = NULL;
+        fprintf(stderr, "%s: write failed\n", path);
+        return -1;
+    }
+    return 0;
+}
+
+int matfile_writer_append(matfile_writer_t *w, const void *rows, int count, int ld) {
+    static const char zeros[2 * MATRIX_ALIGNMENT];   // Longer than any row padding.
+    const matfile_header_t *h = &w->header;
+    if (w->fp == NULL || count < 0 || (uint64_t)ld < h->cols || w->rows_written + count > h->rows) {
+        return -1;
+    }
+    size_t row_bytes = h->cols * h->elem_size, pad = (h->ld - h->cols) * h->elem_size;
+    const char *src = (const char *)rows;
+    for (int i = 0; i < count; i++) {
+        if (fwrite(src + (size_t)i * ld * h->elem_size, 1, row_bytes, w->fp) != row_bytes ||
+            (pad && fwrite(zeros, 1, pad, w->fp) != pad)) {
+            return -1;
+        }
+    }
+    w->rows_written += count;
+    return 0;
+}
+
+int matfile_writer_close(matfile_writer_t *w) {
+    if (w->fp == NULL) {
+        return -1;
+    }
+    int failed = ferror(w->fp) != 0;
+    failed |= fclose(w->fp) != 0;
+    w->fp = NULL;
+    return failed || w->rows_written != w->header.rows ? -1 : 0;
+}
+
+int matfile_save(const char *path, const matrix_t *m) {
+    matfile_writer_t w;
+    if (matfile_writer_open(&w, path, m->rows, m->cols, MATFILE_F64) != 0) {
+        return -1;
+    }
+    int status = matfile_writer_append(&w, m->data, m->rows, m->ld);
+    return matfile_writer_close(&w) != 0 || status != 0 ? -1 : 0;
+}
@@ -0,0 +1,101 @@
+#ifndef MATFILE_H
+#define MATFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "matrix.h"
+#include "precision.h"
+
+// Binary matrix file: a MATFILE_ALIGNMENT-byte header page followed by the
+// row-major payload, rows ld elements apart (ld follows the padded-stride
+// rule of matrix_padded_ld, so rows start on cache lines). The payload is
+// page aligned, so mapping the file gives matrices the kernels can use in
+// place: no parsing, no copy, and pages are read in on first touch. Fields
+// are in host byte order; byte_order tells a foreign file apart.
+#define MATFILE_MAGIC "MXMATRIX"
+#define MATFILE_VERSION 1
+#define MATFILE_ALIGNMENT 4096
+#define MATFILE_BYTE_ORDER 0x01020304u
+
+typedef enum {
+    MATFILE_F64 = 1,
+    MATFILE_F32 = 2,
+    MATFILE_BF16 = 3,
+} matfile_dtype_t;
+
+typedef struct {
+    char magic[8];          // MATFILE_MAGIC, not NUL terminated.
+    uint32_t version;       // MATFILE_VERSION.
+    uint32_t byte_order;    // MATFILE_BYTE_ORDER as written by the host.
+    uint32_t dtype;         // matfile_dtype_t.
+    uint32_t elem_size;     // Bytes per element.
+    uint64_t rows;
+    uint64_t cols;
+    uint64_t ld;            // Row stride in elements (>= cols).
+    uint64_t alignment;     // Payload alignment in bytes (MATFILE_ALIGNMENT).
+    uint64_t data_offset;   // Payload start, a multiple of alignment.
+    uint64_t data_bytes;    // rows * ld * elem_size.
+} matfile_header_t;
+
+// "double", "float" or "bf16" (the gemm_precision_t input names) and back;
+// matfile_dtype_parse returns 0 for an unknown name.
+const char *matfile_dtype_name(matfile_dtype_t dtype);
+matfile_dtype_t matfile_dtype_parse(const char *name);
+
+// A mapped file. view describes the payload for every dtype; for MATFILE_F64
+// m is the same matrix as a matrix_t (m.data is NULL otherwise). Never
+// matrix_free either of them: release the mapping with matfile_unmap.
+typedef struct {
+    matfile_header_t header;
+    void *map;
+    size_t map_bytes;
+    typed_matrix_t view;
+    matrix_t m;
+} matfile_t;
+
+// Map an existing file read-only. Returns 0, or -1 (with a message on
+// stderr) if it cannot be opened or is not a valid matrix file.
+int matfile_map(matfile_t *f, const char *path);
+
+// Create (or truncate) a file for a rows x cols result and map it
+// read-write. The payload starts zeroed (sparse on most file systems), so it
+// can be the C of C += A * B directly; writes reach the file through the
+// page cache. Returns 0 or -1 like matfile_map.
+int matfile_create(matfile_t *f, const char *path, int rows, int cols, matfile_dtype_t dtype);
+
+void matfile_unmap(matfile_t *f);
+
+// Descriptor-level access, for out-of-core readers that pread/pwrite tiles
+// of the payload instead of mapping it. matfile_read_header validates the
+// header of an open file (like matfile_map) and returns 0 or -1;
+// matfile_create_fd creates a sized, zeroed file with its header written
+// and returns a read-write descriptor, or -1.
+int matfile_read_header(int fd, const char *path, matfile_header_t *h);
+int matfile_create_fd(const char *path, int rows, int cols, matfile_dtype_t dtype,
+                      matfile_header_t *h);
+
+// Streaming writer: the header first, then rows appended in any number of
+// chunks, e.g. while a large operand is generated or a result is produced
+// block row by block row, without holding the whole matrix in memory.
+typedef struct {
+    FILE *fp;
+    matfile_header_t header;
+    uint64_t rows_written;
+} matfile_writer_t;
+
+int matfile_writer_open(matfile_writer_t *w, const char *path, int rows, int cols,
+                        matfile_dtype_t dtype);
+
+// Append count rows starting at rows, ld elements apart in memory (any ld
+// >= cols; the file's own padding is written as zeros). Returns 0 or -1.
+int matfile_writer_append(matfile_writer_t *w, const void *rows, int count, int ld);
+
+// Returns -1 if fewer rows than the header announces were appended or a
+// write failed (the file is then incomplete), 0 otherwise.
+int matfile_writer_close(matfile_writer_t *w);
+
+// Whole double matrix in one call (open, append, close).
+int matfile_save(const char *path, const matrix_t *m);
+
+#endif
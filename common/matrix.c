@@ -0,0 +1,209 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "buffer.h"
+#include "matrix.h"
+
+#define DOUBLES_PER_LINE (MATRIX_ALIGNMENT / (int)sizeof(double))
+#define CONFLICT_STRIDE 1024  // Row strides that are multiples of this (bytes) get one extra line.
+
+int matrix_padded_ld(int cols) {
+    // Round up to whole cache lines so every row starts aligned.
+    int ld = (cols + DOUBLES_PER_LINE - 1) / DOUBLES_PER_LINE * DOUBLES_PER_LINE;
+
+    // Break power-of-two strides: shifting each row by one line spreads
+    // column walks over all cache sets instead of a handful of them.
+    if (((size_t)ld * sizeof(double)) % CONFLICT_STRIDE == 0) {
+        ld += DOUBLES_PER_LINE;
+    }
+    return ld;
+}
+
+matrix_t matrix_create(int rows, int cols, int padded) {
+    matrix_t m;
+    m.rows = rows;
+    m.cols = cols;
+    m.ld = padded ? matrix_padded_ld(cols) : cols;
+
+    // Backing (malloc, huge pages, ...) as selected with buffer_set_backing;
+    // every backing is at least MATRIX_ALIGNMENT aligned and exits on failure.
+    m.data = (double *)buffer_alloc((size_t)rows * m.ld * sizeof(double));
+    return m;
+}
+
+void matrix_free(matrix_t *m) {
+    buffer_free(m->data);
+    m->data = NULL;
+    m->rows = m->cols = m->ld = 0;
+}
+
+void matrix_fill(matrix_t *m, double value) {
+    for (int i = 0; i < m->rows; i++) {
+        double *row = &MAT(m, i, 0);
+        for (int j = 0; j < m->cols; j++) {
+            row[j] = value;
+        }
+    }
+}
+
+void matrix_fill_random(matrix_t *m) {
+    for (int i = 0; i < m->rows; i++) {
+        double *row = &MAT(m, i, 0);
+        for (int j = 0; j < m->cols; j++) {
+            row[j] = (double)(rand() % 10) + 1.0;
+        }
+    }
+}
+
+void matrix_fill_uniform(matrix_t *m, double lo, double hi) {
+    for (int i = 0; i < m->rows; i++) {
+        double *row = &MAT(m, i, 0);
+        for (int j = 0; j < m->cols; j++) {
+            row[j] = lo + (hi - lo) * ((double)rand() / ((double)RAND_MAX + 1.0));
+        }
+    }
+}
+
+double matrix_max_rel_error(const matrix_t *X, const matrix_t *R) {
+    double diff = 0.0, scale = 0.0;
+    for (int i = 0; i < R->rows; i++) {
+        for (int j = 0; j < R->cols; j++) {
+            double d = fabs(MAT(X, i, j) - MAT(R, i, j)), r = fabs(MAT(R, i, j));
+            if (d > diff) diff = d;
+            if (r > scale) scale = r;
+        }
+    }
+    return scale > 0.0 ? diff / scale : 0.0;
+}
+
+// Smallest power of two >= the number of tile-sized blocks in side.
+static int morton_blocks(int side, int tile) {
+    int blocks = (side + tile - 1) / tile, grid = 1;
+    while (grid < blocks) {
+        grid *= 2;
+    }
+    return grid;
+}
+
+static size_t morton_bytes(const morton_matrix_t *m) {
+    return (size_t)m->grid_rows * m->grid_cols * m->tile * m->tile * sizeof(double);
+}
+
+morton_matrix_t morton_create(int rows, int cols, int tile) {
+    morton_matrix_t m;
+    m.rows = rows;
+    m.cols = cols;
+    m.tile = tile;
+    m.grid_rows = morton_blocks(rows, tile);
+    m.grid_cols = morton_blocks(cols, tile);
+    m.data = (double *)buffer_alloc(morton_bytes(&m));
+    morton_zero(&m);
+    return m;
+}
+
+void morton_free(morton_matrix_t *m) {
+    buffer_free(m->data);
+    m->data = NULL;
+    m->rows = m->cols = m->tile = m->grid_rows = m->grid_cols = 0;
+}
+
+void morton_zero(morton_matrix_t *m) {
+    memset(m->data, 0, morton_bytes(m));
+}
+
+double *morton_block(const morton_matrix_t *m, int bi, int bj) {
+    // Interleave the bits both coordinates have: row bits at odd positions,
+    // column bits at even ones. The longer side's remaining bits go on top.
+    size_t index = 0;
+    int bit = 0;
+    for (; (1 << bit) < m->grid_rows && (1 << bit) < m->grid_cols; bit++) {
+        index |= (size_t)((bi >> bit) & 1) << (2 * bit + 1);
+        index |= (size_t)((bj >> bit) & 1) << (2 * bit);
+    }
+    index |= (size_t)(bi >> bit) << (2 * bit);
+    index |= (size_t)(bj >> bit) << (2 * bit);
+    return m->data + index * m->tile * m->tile;
+}
+
+void morton_from_matrix(morton_matrix_t *dst, const matrix_t *src) {
+    int t = dst->tile;
+    for (int i = 0; i < src->rows; i++) {
+        for (int bj = 0; bj * t < src->cols; bj++) {
+            double *row = morton_block(dst, i / t, bj) + (size_t)(i % t) * t;
+            int cols = src->cols - bj * t < t ? src->cols - bj * t : t;
+            memcpy(row, &MAT(src, i, bj * t), (size_t)cols * sizeof(double));
+        }
+    }
+}
+
+void morton_to_matrix(matrix_t *dst, const morton_matrix_t *src) {
+    int t = src->tile;
+    for (int i = 0; i < dst->rows; i++) {
+        for (int bj = 0; bj * t < dst->cols; bj++) {
+            const double *row = morton_block(src, i / t, bj) + (size_t)(i % t) * t;
+            int cols = dst->cols - bj * t < t ? dst->cols - bj * t : t;
+            memcpy(&MAT(dst, i, bj * t), row, (size_t)cols * sizeof(double));
+        }
+    }
+}
+
+int matrix_parse_shape(const char *text, int *m, int *k, int *n) {
+    char tail;
+    int a, b, c;
+    if (sscanf(text, "%dx%dx%d%c", &a, &b, &c, &tail) == 3) {
+        // Rectangular M x K x N.
+    } else if (sscanf(text, "%d%c", &a, &tail) == 1) {
+        b = c = a;
+    } else {
+        return -1;
+    }
+    if (a <= 0 || b <= 0 || c <= 0) {
+        return -1;
+    }
+    *m = a;
+    *k = b;
+    *n = c;
+    return 0;
+}
+
+int parse_int_list(const char *text, int *values, int max) {
+    int count = 0;
+    const char *p = text;
+    while (*p) {
+        char *end;
+        long v = strtol(p, &end, 10);
+        if (end == p || v <= 0 || count == max) {
+            return -1;
+        }
+        values[count++] = (int)v;
+        p = end;
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return -1;
+        }
+    }
+    return count;
+}
+
+int parse_double_list(const char *text, double *values, int max) {
+    int count = 0;
+    const char *p = text;
+    while (*p) {
+        char *end;
+        double v = strtod(p, &end);
+        if (end == p || !(v > 0.0) || count == max) {
+            return -1;
+        }
+        values[count++] = v;
+        p = end;
+        if (*p == ',') {
+            p++;
+        } else if (*p != '\0') {
+            return -1;
+        }
+    }
+    return count;
+}
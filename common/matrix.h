@@ -0,0 +1,88 @@
+#ifndef MATRIX_H
+#define MATRIX_H
+
+#include <stddef.h>
+
+#define MATRIX_ALIGNMENT 64  // Buffer alignment in bytes (one cache line).
+
+// Dense row-major matrix stored in a single contiguous, aligned buffer.
+// Element (i, j) lives at data[i * ld + j]; ld (leading dimension) is the
+// row stride in elements and is always >= cols.
+typedef struct {
+    double *data;
+    int rows;
+    int cols;
+    int ld;
+} matrix_t;
+
+// Element access through a matrix_t pointer.
+#define MAT(m, i, j) ((m)->data[(size_t)(i) * (m)->ld + (j)])
+
+// Allocate a rows x cols matrix (contents undefined). With padded != 0 the
+// row stride is chosen by matrix_padded_ld() instead of being exactly cols.
+// Memory comes from buffer_alloc() (see buffer.h). Exits on allocation failure.
+matrix_t matrix_create(int rows, int cols, int padded);
+
+// Release the buffer and reset the descriptor.
+void matrix_free(matrix_t *m);
+
+// Set every element (padding columns excluded) to value.
+void matrix_fill(matrix_t *m, double value);
+
+// Fill with (rand() % 10) + 1, the value range used by all benchmarks.
+void matrix_fill_random(matrix_t *m);
+
+// Fill with uniform values in [lo, hi) from rand() (non-integer data, for
+// accuracy checks where the integer fill would round exactly).
+void matrix_fill_uniform(matrix_t *m, double lo, double hi);
+
+// Normwise relative difference max |X - R| / max |R| (0 if R is all zero).
+double matrix_max_rel_error(const matrix_t *X, const matrix_t *R);
+
+// Row stride for cols columns that starts every row on a cache line and
+// avoids large power-of-two strides (e.g. 512 doubles = 4 KiB), which map
+// consecutive rows to the same cache sets.
+int matrix_padded_ld(int cols);
+
+// Matrix stored as tile x tile blocks (row-major inside each block, ld =
+// tile) with the blocks laid out in Morton (Z) order of their (row, column)
+// block coordinates, so every aligned square quadrant of the block grid is
+// one contiguous range. Each side is padded to its own power of two blocks
+// (at most 4x the matrix in total); a tall or wide grid is a stack of square
+// Z-ordered grids along its longer side. Rows and columns past the matrix
+// are kept zero.
+typedef struct {
+    double *data;
+    int rows;
+    int cols;
+    int tile;        // Block side in elements.
+    int grid_rows;   // Block rows (power of two).
+    int grid_cols;   // Block columns (power of two).
+} morton_matrix_t;
+
+// Allocate a zeroed rows x cols Morton matrix (through buffer_alloc).
+morton_matrix_t morton_create(int rows, int cols, int tile);
+void morton_free(morton_matrix_t *m);
+
+// Zero every block, padding included.
+void morton_zero(morton_matrix_t *m);
+
+// Start of block (bi, bj).
+double *morton_block(const morton_matrix_t *m, int bi, int bj);
+
+// Copy between row-major and Morton storage (same rows and cols).
+void morton_from_matrix(morton_matrix_t *dst, const matrix_t *src);
+void morton_to_matrix(matrix_t *dst, const morton_matrix_t *src);
+
+// Parse a GEMM shape: "N" (square) or "MxKxN" (A is M x K, B is K x N).
+// Returns 0 on success, -1 on a malformed or non-positive shape.
+int matrix_parse_shape(const char *text, int *m, int *k, int *n);
+
+// Parse a comma-separated list of positive integers ("256,512,1023") into
+// values (at most max entries). Returns the count, or -1 on a malformed list.
+int parse_int_list(const char *text, int *values, int max);
+
+// Same for positive floating-point values ("0.01,0.1,0.5").
+int parse_double_list(const char *text, double *values, int max);
+
+#endif
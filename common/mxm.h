@@ -0,0 +1,22 @@
+#ifndef MXM_H
+#define MXM_H
+
+// Umbrella header for libmxm (built from common/ by the top-level Makefile):
+// matrices, their backing buffers, reuse allocators and file format, the
+// GEMM engines and plans (in memory and out of core), transposes, result
+// checks, call statistics, mixed precision, sparse operands and the tuning
+// cache.
+#include "arena.h"
+#include "buffer.h"
+#include "matrix.h"
+#include "matfile.h"
+#include "gemm.h"
+#include "gemm_ooc.h"
+#include "transpose.h"
+#include "verify.h"
+#include "gemm_stats.h"
+#include "precision.h"
+#include "sparse.h"
+#include "autotune.h"
+
+#endif
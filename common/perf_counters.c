@@ -0,0 +1,155 @@
+#include <linux/perf_event.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "perf_counters.h"
+
+// Intel FP_ARITH_INST_RETIRED (event 0xC7): one counter per vector width.
+// Each counts instructions, FMAs twice, so flops = count * doubles per vector.
+#define FP_ARITH_EVENT 0xC7
+#define NUM_FP_WIDTHS 4
+static const unsigned fp_umask[NUM_FP_WIDTHS] = {0x01, 0x04, 0x10, 0x40};  // scalar, 128, 256, 512 bit
+static const int fp_width[NUM_FP_WIDTHS] = {1, 2, 4, 8};
+
+// Every opened file descriptor and what it contributes to.
+#define MAX_FDS (PERF_NUM_EVENTS + NUM_FP_WIDTHS)
+static int fds[MAX_FDS];
+static int fd_event[MAX_FDS];
+static double fd_weight[MAX_FDS];
+static int nfds = 0;
+
+static const char *event_names[PERF_NUM_EVENTS] = {
+    "cycles", "instructions", "L1D misses", "LLC misses", "dTLB misses", "FP ops",
+};
+
+static uint64_t cache_config(unsigned cache, unsigned op, unsigned result) {
+    return cache | (op << 8) | (result << 16);
+}
+
+static int open_event(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.disabled = 1;
+    attr.inherit = 1;          // Also count threads created after opening.
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void add_fd(int fd, int event, double weight) {
+    if (fd >= 0 && nfds < MAX_FDS) {
+        fds[nfds] = fd;
+        fd_event[nfds] = event;
+        fd_weight[nfds] = weight;
+        nfds++;
+    }
+}
+
+int perf_counters_open(void) {
+    perf_counters_close();
+
+    add_fd(open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES), PERF_CYCLES, 1.0);
+    add_fd(open_event(PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS), PERF_INSTRUCTIONS, 1.0);
+    add_fd(open_event(PERF_TYPE_HW_CACHE, cache_config(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_OP_READ,
+                                                       PERF_COUNT_HW_CACHE_RESULT_MISS)),
+           PERF_L1D_MISSES, 1.0);
+    add_fd(open_event(PERF_TYPE_HW_CACHE, cache_config(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_OP_READ,
+                                                       PERF_COUNT_HW_CACHE_RESULT_MISS)),
+           PERF_LLC_MISSES, 1.0);
+    add_fd(open_event(PERF_TYPE_HW_CACHE, cache_config(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_OP_READ,
+                                                       PERF_COUNT_HW_CACHE_RESULT_MISS)),
+           PERF_DTLB_MISSES, 1.0);
+
+    // FP_ARITH is Intel-specific; other vendors simply report FP ops as n/a.
+    __builtin_cpu_init();
+    if (__builtin_cpu_is("intel")) {
+        for (int w = 0; w < NUM_FP_WIDTHS; w++) {
+            add_fd(open_event(PERF_TYPE_RAW, FP_ARITH_EVENT | (fp_umask[w] << 8)), PERF_FP_OPS,
+                   fp_width[w]);
+        }
+    }
+
+    int available[PERF_NUM_EVENTS] = {0};
+    for (int i = 0; i < nfds; i++) {
+        available[fd_event[i]] = 1;
+    }
+    int count = 0;
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        count += available[e];
+    }
+    return count;
+}
+
+void perf_counters_close(void) {
+    for (int i = 0; i < nfds; i++) {
+        close(fds[i]);
+    }
+    nfds = 0;
+}
+
+int perf_counters_enabled(void) {
+    return nfds > 0;
+}
+
+void perf_counters_reset(void) {
+    for (int i = 0; i < nfds; i++) {
+        ioctl(fds[i], PERF_EVENT_IOC_RESET, 0);
+    }
+}
+
+void perf_counters_resume(void) {
+    for (int i = 0; i < nfds; i++) {
+        ioctl(fds[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+void perf_counters_pause(void) {
+    for (int i = 0; i < nfds; i++) {
+        ioctl(fds[i], PERF_EVENT_IOC_DISABLE, 0);
+    }
+}
+
+void perf_counters_read(perf_sample_t *out) {
+    memset(out, 0, sizeof(*out));
+    for (int i = 0; i < nfds; i++) {
+        // value, time_enabled, time_running (see read_format above).
+        uint64_t buf[3];
+        if (read(fds[i], buf, sizeof(buf)) != (ssize_t)sizeof(buf) || buf[2] == 0) {
+            continue;
+        }
+        // More events than hardware counters: the kernel time-slices them,
+        // so extrapolate from the fraction of time each one was live.
+        double scaled = (double)buf[0] * ((double)buf[1] / (double)buf[2]);
+        out->value[fd_event[i]] += scaled * fd_weight[i];
+        out->valid[fd_event[i]] = 1;
+    }
+}
+
+void perf_print_header(FILE *out) {
+    if (!perf_counters_enabled()) {
+        return;
+    }
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        fprintf(out, ", %s", event_names[e]);
+    }
+}
+
+void perf_print_values(FILE *out, const perf_sample_t *sample) {
+    if (!perf_counters_enabled()) {
+        return;
+    }
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        if (sample->valid[e]) {
+            fprintf(out, ", %.0f", sample->value[e]);
+        } else {
+            fprintf(out, ", n/a");
+        }
+    }
+}
@@ -0,0 +1,49 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <stdio.h>
+
+// Hardware events recorded around timed regions (via perf_event_open).
+typedef enum {
+    PERF_CYCLES,
+    PERF_INSTRUCTIONS,
+    PERF_L1D_MISSES,     // L1 data cache read misses.
+    PERF_LLC_MISSES,     // Last-level cache read misses.
+    PERF_DTLB_MISSES,    // Data TLB read misses.
+    PERF_FP_OPS,         // Double-precision flops (Intel FP_ARITH_INST_RETIRED).
+    PERF_NUM_EVENTS
+} perf_event_id_t;
+
+// Event totals; valid[e] is 0 when the event could not be opened or never ran.
+typedef struct {
+    double value[PERF_NUM_EVENTS];
+    int valid[PERF_NUM_EVENTS];
+} perf_sample_t;
+
+// Open the counters for the calling thread, inherited by threads it creates
+// later, so call this before spawning worker pools. Counters start paused.
+// Returns the number of events available (0 if perf is not permitted).
+int perf_counters_open(void);
+
+void perf_counters_close(void);
+
+// 1 if perf_counters_open() found at least one event.
+int perf_counters_enabled(void);
+
+// Zero all counters (still paused).
+void perf_counters_reset(void);
+
+// Count only between resume and pause; calls may be repeated to accumulate
+// several disjoint regions.
+void perf_counters_resume(void);
+void perf_counters_pause(void);
+
+// Read the accumulated totals, scaled up if the kernel had to multiplex.
+void perf_counters_read(perf_sample_t *out);
+
+// CSV helpers: ", cycles, instructions, ..." and the matching values
+// ("n/a" for missing events). Both print nothing when counters are disabled.
+void perf_print_header(FILE *out);
+void perf_print_values(FILE *out, const perf_sample_t *sample);
+
+#endif
@@ -0,0 +1,418 @@
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "buffer.h"
+#include "cache_info.h"
+#include "precision.h"
+#include "timing.h"
+
+// One loop template (DEFINE_TYPED_GEMM) instantiated per element type. The
+// only per-type pieces are the element load (widening to the accumulator)
+// and the inner row update c[0:n] += a * b[0:n], which has a scalar and an
+// AVX2/FMA version like the kernels in gemm_kernels.c.
+
+static float bf16_to_float(bf16_t x) {
+    uint32_t bits = (uint32_t)x << 16;
+    float f;
+    memcpy(&f, &bits, sizeof(f));
+    return f;
+}
+
+// Round to nearest even; NaNs stay NaN.
+static bf16_t float_to_bf16(float f) {
+    uint32_t bits;
+    memcpy(&bits, &f, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u) {
+        return (bf16_t)((bits >> 16) | 0x40);
+    }
+    bits += 0x7fffu + ((bits >> 16) & 1);
+    return (bf16_t)(bits >> 16);
+}
+
+static int have_avx2(void) {
+    static int cached = -1;
+    if (cached < 0) {
+        __builtin_cpu_init();
+        cached = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    }
+    return cached;
+}
+
+// ---- Row updates: c[0:n] += a * b[0:n] ----
+
+static void row_f64(double *c, double a, const double *b, int n) {
+    for (int j = 0; j < n; j++) {
+        c[j] += a * b[j];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void row_f64_avx2(double *c, double a, const double *b, int n) {
+    __m256d av = _mm256_set1_pd(a);
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        _mm256_storeu_pd(c + j, _mm256_fmadd_pd(av, _mm256_loadu_pd(b + j), _mm256_loadu_pd(c + j)));
+        _mm256_storeu_pd(c + j + 4,
+                         _mm256_fmadd_pd(av, _mm256_loadu_pd(b + j + 4), _mm256_loadu_pd(c + j + 4)));
+    }
+    for (; j < n; j++) {
+        c[j] += a * b[j];
+    }
+}
+
+static void row_f32(float *c, float a, const float *b, int n) {
+    for (int j = 0; j < n; j++) {
+        c[j] += a * b[j];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void row_f32_avx2(float *c, float a, const float *b, int n) {
+    __m256 av = _mm256_set1_ps(a);
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+        _mm256_storeu_ps(c + j, _mm256_fmadd_ps(av, _mm256_loadu_ps(b + j), _mm256_loadu_ps(c + j)));
+        _mm256_storeu_ps(c + j + 8,
+                         _mm256_fmadd_ps(av, _mm256_loadu_ps(b + j + 8), _mm256_loadu_ps(c + j + 8)));
+    }
+    for (; j < n; j++) {
+        c[j] += a * b[j];
+    }
+}
+
+static void row_bf16(float *c, float a, const bf16_t *b, int n) {
+    for (int j = 0; j < n; j++) {
+        c[j] += a * bf16_to_float(b[j]);
+    }
+}
+
+// Widening bf16 -> fp32 is a zero-extend and a 16-bit shift.
+__attribute__((target("avx2,fma")))
+static inline __m256 load_bf16x8(const bf16_t *p) {
+    __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i *)p));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(w, 16));
+}
+
+__attribute__((target("avx2,fma")))
+static void row_bf16_avx2(float *c, float a, const bf16_t *b, int n) {
+    __m256 av = _mm256_set1_ps(a);
+    int j = 0;
+    for (; j + 16 <= n; j += 16) {
+        _mm256_storeu_ps(c + j, _mm256_fmadd_ps(av, load_bf16x8(b + j), _mm256_loadu_ps(c + j)));
+        _mm256_storeu_ps(c + j + 8,
+                         _mm256_fmadd_ps(av, load_bf16x8(b + j + 8), _mm256_loadu_ps(c + j + 8)));
+    }
+    for (; j < n; j++) {
+        c[j] += a * bf16_to_float(b[j]);
+    }
+}
+
+// ---- Loop template ----
+
+#define LOAD_SAME(x) (x)
+#define LOAD_BF16(x) bf16_to_float(x)
+
+#define DEFINE_TYPED_GEMM(NAME, T, ACC, LOAD, ROW, ROW_AVX2)                                      \
+    static void NAME##_multiply(const typed_matrix_t *A, const typed_matrix_t *B,                 \
+                                typed_matrix_t *C, int order, const gemm_blocking_t *blocking) {  \
+        const T *a = (const T *)A->data;                                                          \
+        const T *b = (const T *)B->data;                                                          \
+        ACC *c = (ACC *)C->data;                                                                  \
+        size_t lda = A->ld, ldb = B->ld, ldc = C->ld;                                             \
+        int m = C->rows, n = C->cols, kdim = A->cols;                                             \
+        void (*row)(ACC *, ACC, const T *, int) = have_avx2() ? ROW_AVX2 : ROW;                   \
+                                                                                                  \
+        if (order == GEMM_ORDER_IJK) {                                                            \
+            for (int i = 0; i < m; i++) {                                                         \
+                for (int j = 0; j < n; j++) {                                                     \
+                    ACC sum = c[i * ldc + j];                                                     \
+                    for (int k = 0; k < kdim; k++) {                                              \
+                        sum += LOAD(a[i * lda + k]) * LOAD(b[k * ldb + j]);                       \
+                    }                                                                             \
+                    c[i * ldc + j] = sum;                                                         \
+                }                                                                                 \
+            }                                                                                     \
+        } else if (order == GEMM_ORDER_IKJ) {                                                     \
+            for (int i = 0; i < m; i++) {                                                         \
+                for (int k = 0; k < kdim; k++) {                                                  \
+                    row(c + i * ldc, LOAD(a[i * lda + k]), b + k * ldb, n);                       \
+                }                                                                                 \
+            }                                                                                     \
+        } else {                                                                                  \
+            gemm_blocking_t blk = blocking ? *blocking : gemm_precision_blocking(&NAME##_type);   \
+            for (int jj = 0; jj < n; jj += blk.nc) {                                              \
+                int jn = n - jj < blk.nc ? n - jj : blk.nc;                                       \
+                for (int kk = 0; kk < kdim; kk += blk.kc) {                                       \
+                    int k_end = kdim - kk < blk.kc ? kdim : kk + blk.kc;                          \
+                    for (int ii = 0; ii < m; ii += blk.mc) {                                      \
+                        int i_end = m - ii < blk.mc ? m : ii + blk.mc;                            \
+                        for (int i = ii; i < i_end; i++) {                                        \
+                            for (int k = kk; k < k_end; k++) {                                    \
+                                row(c + i * ldc + jj, LOAD(a[i * lda + k]), b + k * ldb + jj, jn); \
+                            }                                                                     \
+                        }                                                                         \
+                    }                                                                             \
+                }                                                                                 \
+            }                                                                                     \
+        }                                                                                         \
+    }
+
+// Conversions to the input type and back from the accumulator type.
+static void f64_from_double(void *dst, const double *src, size_t count) {
+    memcpy(dst, src, count * sizeof(double));
+}
+
+static void f64_to_double(double *dst, const void *src, size_t count) {
+    memcpy(dst, src, count * sizeof(double));
+}
+
+static void f32_from_double(void *dst, const double *src, size_t count) {
+    float *d = (float *)dst;
+    for (size_t i = 0; i < count; i++) {
+        d[i] = (float)src[i];
+    }
+}
+
+static void f32_to_double(double *dst, const void *src, size_t count) {
+    const float *s = (const float *)src;
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = s[i];
+    }
+}
+
+static void bf16_from_double(void *dst, const double *src, size_t count) {
+    bf16_t *d = (bf16_t *)dst;
+    for (size_t i = 0; i < count; i++) {
+        d[i] = float_to_bf16((float)src[i]);
+    }
+}
+
+static const gemm_precision_t f64_type, f32_type, bf16_type;
+
+DEFINE_TYPED_GEMM(f64, double, double, LOAD_SAME, row_f64, row_f64_avx2)
+DEFINE_TYPED_GEMM(f32, float, float, LOAD_SAME, row_f32, row_f32_avx2)
+DEFINE_TYPED_GEMM(bf16, bf16_t, float, LOAD_BF16, row_bf16, row_bf16_avx2)
+
+static const gemm_precision_t f64_type = {
+    "double", "double", sizeof(double), sizeof(double), 53,
+    f64_multiply, f64_from_double, f64_to_double,
+};
+static const gemm_precision_t f32_type = {
+    "float", "float", sizeof(float), sizeof(float), 24,
+    f32_multiply, f32_from_double, f32_to_double,
+};
+static const gemm_precision_t bf16_type = {
+    "bf16", "float", sizeof(bf16_t), sizeof(float), 8,
+    bf16_multiply, bf16_from_double, f32_to_double,
+};
+
+static const gemm_precision_t *const precisions[] = {&f64_type, &f32_type, &bf16_type};
+
+const gemm_precision_t *gemm_precision_find(const char *name) {
+    for (size_t i = 0; i < sizeof(precisions) / sizeof(precisions[0]); i++) {
+        if (strcmp(precisions[i]->name, name) == 0) {
+            return precisions[i];
+        }
+    }
+    return NULL;
+}
+
+int gemm_precision_parse_list(const char *text, const gemm_precision_t **out, int max) {
+    char name[32];
+    int count = 0;
+    const char *p = text;
+    while (*p) {
+        size_t len = strcspn(p, ",");
+        if (len == 0 || len >= sizeof(name) || count == max) {
+            return -1;
+        }
+        memcpy(name, p, len);
+        name[len] = '\0';
+        if ((out[count++] = gemm_precision_find(name)) == NULL) {
+            return -1;
+        }
+        p += len;
+        if (*p == ',') {
+            p++;
+        }
+    }
+    return count;
+}
+
+// Largest multiple of step in [lo, hi] not above value.
+static int fit(long value, int step, int lo, int hi) {
+    long v = value / step * step;
+    return v < lo ? lo : v > hi ? hi : (int)v;
+}
+
+gemm_blocking_t gemm_precision_blocking(const gemm_precision_t *p) {
+    const cache_info_t *cache = cache_info_get();
+    gemm_blocking_t blk;
+    // Half of L1 for the C row segment; the B row streaming past uses the rest.
+    blk.nc = fit(cache->l1d / 2 / (long)p->acc_size, 64, 64, 8192);
+    // Half of L2 for the KC x NC tile of B that every row of the block re-reads.
+    blk.kc = fit(cache->l2 / 2 / ((long)blk.nc * (long)p->in_size), 8, 8, 4096);
+    blk.mc = 64;
+    return blk;
+}
+
+typed_matrix_t typed_matrix_create(int rows, int cols, size_t elem_size, int padded) {
+    typed_matrix_t m;
+    m.rows = rows;
+    m.cols = cols;
+    m.elem_size = elem_size;
+    m.ld = cols;
+    if (padded) {
+        // As matrix_padded_ld: whole cache lines, plus one line on 1 KiB multiples.
+        int per_line = MATRIX_ALIGNMENT / (int)elem_size;
+        m.ld = (cols + per_line - 1) / per_line * per_line;
+        if ((size_t)m.ld * elem_size % 1024 == 0) {
+            m.ld += per_line;
+        }
+    }
+    m.data = buffer_alloc((size_t)rows * m.ld * elem_size);
+    return m;
+}
+
+void typed_matrix_free(typed_matrix_t *m) {
+    buffer_free(m->data);
+    m->data = NULL;
+    m->rows = m->cols = m->ld = 0;
+}
+
+void typed_matrix_zero(typed_matrix_t *m) {
+    for (int i = 0; i < m->rows; i++) {
+        memset((char *)m->data + (size_t)i * m->ld * m->elem_size, 0, (size_t)m->cols * m->elem_size);
+    }
+}
+
+void typed_matrix_from_double(const gemm_precision_t *p, typed_matrix_t *dst, const matrix_t *src) {
+    for (int i = 0; i < src->rows; i++) {
+        p->from_double((char *)dst->data + (size_t)i * dst->ld * p->in_size, &MAT(src, i, 0),
+                       (size_t)src->cols);
+    }
+}
+
+double typed_matrix_error(const gemm_precision_t *p, const typed_matrix_t *C, const matrix_t *ref) {
+    matrix_t wide = matrix_create(C->rows, C->cols, 0);
+    for (int i = 0; i < C->rows; i++) {
+        p->acc_to_double(&MAT(&wide, i, 0), (const char *)C->data + (size_t)i * C->ld * p->acc_size,
+                         (size_t)C->cols);
+    }
+    double error = matrix_max_rel_error(&wide, ref);
+    matrix_free(&wide);
+    return error;
+}
+
+typedef struct {
+    const gemm_precision_t *p;
+    const typed_matrix_t *A;
+    const typed_matrix_t *B;
+    typed_matrix_t *C;
+    int order;
+} typed_ctx_t;
+
+static void typed_body(void *p) {
+    typed_ctx_t *ctx = (typed_ctx_t *)p;
+    ctx->p->multiply(ctx->A, ctx->B, ctx->C, ctx->order, NULL);
+}
+
+static void typed_reset(void *p) {
+    typed_matrix_zero(((typed_ctx_t *)p)->C);
+}
+
+// Largest 2-norm of a row of A (by_rows) or of a column.
+static double max_norm(const matrix_t *X, int by_rows) {
+    int outer = by_rows ? X->rows : X->cols, inner = by_rows ? X->cols : X->rows;
+    double worst = 0.0;
+    for (int a = 0; a < outer; a++) {
+        double sum = 0.0;
+        for (int b = 0; b < inner; b++) {
+            double v = by_rows ? MAT(X, a, b) : MAT(X, b, a);
+            sum += v * v;
+        }
+        worst = sum > worst ? sum : worst;
+    }
+    return sqrt(worst);
+}
+
+int gemm_precision_benchmark(const gemm_precision_t **list, int count, const int *orders,
+                             int order_count, int m, int k, int n, int padded, int warmup,
+                             int reps, gemm_precision_run_t *out) {
+    matrix_t A = matrix_create(m, k, padded), B = matrix_create(k, n, padded);
+    matrix_t R = matrix_create(m, n, padded);
+    srand(7);
+    matrix_fill_uniform(&A, -1.0, 1.0);
+    matrix_fill_uniform(&B, -1.0, 1.0);
+    matrix_fill(&R, 0.0);
+    matrix_multiply_standard(&A, &B, &R);
+    double r_max = 0.0;
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            r_max = fabs(MAT(&R, i, j)) > r_max ? fabs(MAT(&R, i, j)) : r_max;
+        }
+    }
+    double scale = r_max > 0.0 ? max_norm(&A, 1) * max_norm(&B, 0) / r_max : 0.0;
+
+    int failed = 0;
+    for (int t = 0; t < count; t++) {
+        const gemm_precision_t *p = list[t];
+        double u_in = ldexp(1.0, -p->significand_bits);
+        double u_acc = ldexp(1.0, p->acc_size == sizeof(double) ? -53 : -24);
+        double bound = (2.0 * u_in + 2.0 * k * u_acc / (1.0 - k * u_acc)) * scale;
+        typed_matrix_t TA = typed_matrix_create(m, k, p->in_size, padded);
+        typed_matrix_t TB = typed_matrix_create(k, n, p->in_size, padded);
+        typed_matrix_t TC = typed_matrix_create(m, n, p->acc_size, padded);
+        typed_matrix_from_double(p, &TA, &A);
+        typed_matrix_from_double(p, &TB, &B);
+        for (int o = 0; o < order_count; o++) {
+            typed_ctx_t ctx = {p, &TA, &TB, &TC, orders[o]};
+            gemm_precision_run_t *run = &out[t * order_count + o];
+            run->ms = timing_run(typed_body, typed_reset, &ctx, warmup, reps).median;
+            run->error = typed_matrix_error(p, &TC, &R);
+            run->bound = bound;
+            run->passed = run->error <= bound;
+            failed += !run->passed;
+        }
+        typed_matrix_free(&TA);
+        typed_matrix_free(&TB);
+        typed_matrix_free(&TC);
+    }
+
+    matrix_free(&A);
+    matrix_free(&B);
+    matrix_free(&R);
+    return failed;
+}
+
+void gemm_precision_print(FILE *out, const gemm_precision_t **list, int count,
+                          const char **order_names, int order_count, int m, int k, int n,
+                          const gemm_precision_run_t *runs) {
+    double gflop = 2.0 * m * k * n / 1e9;
+    int double_index = -1;
+    for (int t = 0; t < count; t++) {
+        if (strcmp(list[t]->name, "double") == 0) {
+            double_index = t;
+        }
+    }
+    fprintf(out, "\nPrecision (input/accumulator), Order, Time (msec), GFLOP/s, "
+                 "Speedup vs double, Max relative error, Unit roundoff, Error bound, Result\n");
+    for (int t = 0; t < count; t++) {
+        for (int o = 0; o < order_count; o++) {
+            const gemm_precision_run_t *run = &runs[t * order_count + o];
+            fprintf(out, "%s/%s, %s, %.4f, %.2f, ", list[t]->name, list[t]->acc_name,
+                    order_names[o], run->ms, gflop / (run->ms / 1000.0));
+            if (double_index >= 0) {
+                fprintf(out, "%.2fx", runs[double_index * order_count + o].ms / run->ms);
+            } else {
+                fprintf(out, "-");
+            }
+            fprintf(out, ", %.3e, %.1e, %.1e, %s\n", run->error,
+                    ldexp(1.0, -list[t]->significand_bits), run->bound,
+                    run->passed ? "PASSED" : "FAILED");
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#ifndef PRECISION_H
+#define PRECISION_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "gemm.h"
+
+// bfloat16: the upper half of an IEEE binary32 (same exponent range, 8-bit
+// significand). Stored as raw bits; arithmetic happens in float.
+typedef uint16_t bf16_t;
+
+// Row-major matrix of any element type: A and B hold the precision's input
+// type, C its accumulator type. Same layout rules as matrix_t (64-byte
+// aligned rows with padded != 0), ld in elements.
+typedef struct {
+    void *data;
+    int rows;
+    int cols;
+    int ld;
+    size_t elem_size;
+} typed_matrix_t;
+
+// Loop structures every precision provides (same loops as mxm.c / mxm_bloc.c).
+enum { GEMM_ORDER_IJK, GEMM_ORDER_IKJ, GEMM_ORDER_BLOCKED };
+
+// C += A * B in the given order. blk is used by GEMM_ORDER_BLOCKED only
+// (NULL = gemm_precision_blocking()).
+typedef void (*typed_multiply_fn)(const typed_matrix_t *A, const typed_matrix_t *B,
+                                  typed_matrix_t *C, int order, const gemm_blocking_t *blk);
+
+// One element/accumulator type pair. All of them are generated from the
+// same loop template in precision.c; the inner row update is AVX2/FMA when
+// the CPU has it, scalar otherwise. Single-threaded.
+typedef struct {
+    const char *name;          // Input type: "double", "float", "bf16".
+    const char *acc_name;      // Accumulator (and C) type.
+    size_t in_size;            // Bytes per element of A and B.
+    size_t acc_size;           // Bytes per element of C.
+    int significand_bits;      // Of the input type (53, 24, 8): unit roundoff 2^-bits.
+    typed_multiply_fn multiply;
+    void (*from_double)(void *dst, const double *src, size_t count);   // Round to the input type.
+    void (*acc_to_double)(double *dst, const void *src, size_t count);
+} gemm_precision_t;
+
+#define GEMM_PRECISION_NAMES "double, float, bf16"
+
+// Look up a precision by name (one of GEMM_PRECISION_NAMES); NULL if unknown.
+const gemm_precision_t *gemm_precision_find(const char *name);
+
+// Parse a comma-separated list of precision names ("float,bf16") into out
+// (at most max entries). Returns the count, or -1 on an unknown name.
+int gemm_precision_parse_list(const char *text, const gemm_precision_t **out, int max);
+
+// Tile sizes for GEMM_ORDER_BLOCKED: an NC-wide row segment of C stays in
+// L1 while a KC x NC tile of B, reused by every row, stays in L2. Narrower
+// types get proportionally larger tiles.
+gemm_blocking_t gemm_precision_blocking(const gemm_precision_t *p);
+
+// Allocate (through buffer_alloc) a rows x cols matrix of elem_size-byte
+// elements, contents undefined. Exits on allocation failure.
+typed_matrix_t typed_matrix_create(int rows, int cols, size_t elem_size, int padded);
+void typed_matrix_free(typed_matrix_t *m);
+void typed_matrix_zero(typed_matrix_t *m);
+
+// Round a double matrix into the input type of p (A and B).
+void typed_matrix_from_double(const gemm_precision_t *p, typed_matrix_t *dst, const matrix_t *src);
+
+// Normwise relative error (matrix_max_rel_error) of an accumulator-type C
+// against a double reference of the same shape.
+double typed_matrix_error(const gemm_precision_t *p, const typed_matrix_t *C, const matrix_t *ref);
+
+// One precision in one loop order: median time and the error of its C.
+typedef struct {
+    double ms;
+    double error;   // typed_matrix_error() against the double reference.
+    double bound;   // Largest error rounding alone can explain (see below).
+    int passed;     // error <= bound.
+} gemm_precision_run_t;
+
+// Time each of the count precisions in each of the order_count orders
+// (timing_run, single thread) on uniform [-1, 1) m x k and k x n inputs
+// (integers would be exact in every type), and compare every run's C with a
+// double reference from matrix_multiply_standard. Precision t in orders[o]
+// goes to out[t * order_count + o]. Rounding the inputs moves each
+// product a b by up to 2 u_in |a b|, and any summation order adds
+// gamma(k) = k u_acc / (1 - k u_acc) of sum |a b| <= |a_i|_2 |b_j|_2, so
+// bound = (2 u_in + 2 gamma(k)) max_i |a_i|_2 max_j |b_j|_2 / max |R|.
+// Returns the number of runs over their bound.
+int gemm_precision_benchmark(const gemm_precision_t **list, int count, const int *orders,
+                              int order_count, int m, int k, int n, int padded, int warmup,
+                              int reps, gemm_precision_run_t *out);
+
+// Table of gemm_precision_benchmark's runs, one line per precision and
+// order. Speedups are against the double row of the same order, when double
+// is in the list.
+void gemm_precision_print(FILE *out, const gemm_precision_t **list, int count,
+                          const char **order_names, int order_count, int m, int k, int n,
+                          const gemm_precision_run_t *runs);
+
+#endif
@@ -0,0 +1,185 @@
+#include <string.h>
+#include <immintrin.h>
+
+#include "reduce.h"
+
+// Like gemm_kernels.c, the SIMD variants carry their own target attribute so
+// the file builds with plain -O2; reduce_kernel_find checks the CPU.
+
+// One accumulator: every add waits for the previous one (the original loop).
+static double reduce_scalar(const double *a, size_t count, size_t stride) {
+    double sum = 0.0;
+    size_t end_index = count * stride;
+    for (size_t i = 0; i < end_index; i += stride) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+// Independent scalar chains, combined at the end.
+static double reduce_acc4(const double *a, size_t count, size_t stride) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+    const double *p = a;
+    size_t i = 0;
+    for (; i + 4 <= count; i += 4, p += 4 * stride) {
+        s0 += p[0];
+        s1 += p[stride];
+        s2 += p[2 * stride];
+        s3 += p[3 * stride];
+    }
+    for (; i < count; i++, p += stride) {
+        s0 += *p;
+    }
+    return (s0 + s1) + (s2 + s3);
+}
+
+static double reduce_acc8(const double *a, size_t count, size_t stride) {
+    double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0, s4 = 0.0, s5 = 0.0, s6 = 0.0, s7 = 0.0;
+    const double *p = a;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, p += 8 * stride) {
+        s0 += p[0];
+        s1 += p[stride];
+        s2 += p[2 * stride];
+        s3 += p[3 * stride];
+        s4 += p[4 * stride];
+        s5 += p[5 * stride];
+        s6 += p[6 * stride];
+        s7 += p[7 * stride];
+    }
+    for (; i < count; i++, p += stride) {
+        s0 += *p;
+    }
+    return ((s0 + s1) + (s2 + s3)) + ((s4 + s5) + (s6 + s7));
+}
+
+// AVX2: full-width loads at stride 1, otherwise vectors assembled from
+// scalar loads. Four ymm chains either way.
+__attribute__((target("avx2")))
+static double reduce_avx2(const double *a, size_t count, size_t stride) {
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    __m256d s2 = _mm256_setzero_pd(), s3 = _mm256_setzero_pd();
+    const double *p = a;
+    size_t i = 0;
+    if (stride == 1) {
+        for (; i + 16 <= count; i += 16, p += 16) {
+            s0 = _mm256_add_pd(s0, _mm256_loadu_pd(p));
+            s1 = _mm256_add_pd(s1, _mm256_loadu_pd(p + 4));
+            s2 = _mm256_add_pd(s2, _mm256_loadu_pd(p + 8));
+            s3 = _mm256_add_pd(s3, _mm256_loadu_pd(p + 12));
+        }
+    } else {
+        const size_t s = stride;
+        for (; i + 16 <= count; i += 16, p += 16 * s) {
+            s0 = _mm256_add_pd(s0, _mm256_set_pd(p[3 * s], p[2 * s], p[s], p[0]));
+            s1 = _mm256_add_pd(s1, _mm256_set_pd(p[7 * s], p[6 * s], p[5 * s], p[4 * s]));
+            s2 = _mm256_add_pd(s2, _mm256_set_pd(p[11 * s], p[10 * s], p[9 * s], p[8 * s]));
+            s3 = _mm256_add_pd(s3, _mm256_set_pd(p[15 * s], p[14 * s], p[13 * s], p[12 * s]));
+        }
+    }
+    __m256d v = _mm256_add_pd(_mm256_add_pd(s0, s1), _mm256_add_pd(s2, s3));
+    __m128d h = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    for (; i < count; i++, p += stride) {
+        sum += *p;
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+static double reduce_avx512(const double *a, size_t count, size_t stride) {
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    __m512d s2 = _mm512_setzero_pd(), s3 = _mm512_setzero_pd();
+    const double *p = a;
+    size_t i = 0;
+    if (stride == 1) {
+        for (; i + 32 <= count; i += 32, p += 32) {
+            s0 = _mm512_add_pd(s0, _mm512_loadu_pd(p));
+            s1 = _mm512_add_pd(s1, _mm512_loadu_pd(p + 8));
+            s2 = _mm512_add_pd(s2, _mm512_loadu_pd(p + 16));
+            s3 = _mm512_add_pd(s3, _mm512_loadu_pd(p + 24));
+        }
+    } else {
+        const size_t s = stride;
+        for (; i + 16 <= count; i += 16, p += 16 * s) {
+            s0 = _mm512_add_pd(s0, _mm512_set_pd(p[7 * s], p[6 * s], p[5 * s], p[4 * s],
+                                                 p[3 * s], p[2 * s], p[s], p[0]));
+            s1 = _mm512_add_pd(s1, _mm512_set_pd(p[15 * s], p[14 * s], p[13 * s], p[12 * s],
+                                                 p[11 * s], p[10 * s], p[9 * s], p[8 * s]));
+        }
+    }
+    double sum = _mm512_reduce_add_pd(_mm512_add_pd(_mm512_add_pd(s0, s1), _mm512_add_pd(s2, s3)));
+    for (; i < count; i++, p += stride) {
+        sum += *p;
+    }
+    return sum;
+}
+
+// Hardware gathers: one instruction fetches a whole strided vector.
+__attribute__((target("avx2")))
+static double reduce_gather_avx2(const double *a, size_t count, size_t stride) {
+    const long long s = (long long)stride;
+    const __m256i idx = _mm256_set_epi64x(3 * s, 2 * s, s, 0);
+    __m256d s0 = _mm256_setzero_pd(), s1 = _mm256_setzero_pd();
+    const double *p = a;
+    size_t i = 0;
+    for (; i + 8 <= count; i += 8, p += 8 * stride) {
+        s0 = _mm256_add_pd(s0, _mm256_i64gather_pd(p, idx, 8));
+        s1 = _mm256_add_pd(s1, _mm256_i64gather_pd(p + 4 * stride, idx, 8));
+    }
+    __m256d v = _mm256_add_pd(s0, s1);
+    __m128d h = _mm_add_pd(_mm256_castpd256_pd128(v), _mm256_extractf128_pd(v, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(h, _mm_unpackhi_pd(h, h)));
+    for (; i < count; i++, p += stride) {
+        sum += *p;
+    }
+    return sum;
+}
+
+__attribute__((target("avx512f")))
+static double reduce_gather_avx512(const double *a, size_t count, size_t stride) {
+    const long long s = (long long)stride;
+    const __m512i idx = _mm512_set_epi64(7 * s, 6 * s, 5 * s, 4 * s, 3 * s, 2 * s, s, 0);
+    __m512d s0 = _mm512_setzero_pd(), s1 = _mm512_setzero_pd();
+    const double *p = a;
+    size_t i = 0;
+    for (; i + 16 <= count; i += 16, p += 16 * stride) {
+        s0 = _mm512_add_pd(s0, _mm512_i64gather_pd(idx, p, 8));
+        s1 = _mm512_add_pd(s1, _mm512_i64gather_pd(idx, p + 8 * stride, 8));
+    }
+    double sum = _mm512_reduce_add_pd(_mm512_add_pd(s0, s1));
+    for (; i < count; i++, p += stride) {
+        sum += *p;
+    }
+    return sum;
+}
+
+static const reduce_kernel_t kernel_scalar = {"scalar", reduce_scalar};
+static const reduce_kernel_t kernel_acc4 = {"acc4", reduce_acc4};
+static const reduce_kernel_t kernel_acc8 = {"acc8", reduce_acc8};
+static const reduce_kernel_t kernel_avx2 = {"avx2", reduce_avx2};
+static const reduce_kernel_t kernel_avx512 = {"avx512", reduce_avx512};
+static const reduce_kernel_t kernel_gather_avx512 = {"gather", reduce_gather_avx512};
+static const reduce_kernel_t kernel_gather_avx2 = {"gather", reduce_gather_avx2};
+
+static int kernel_supported(const reduce_kernel_t *kernel) {
+    if (kernel->fn == reduce_avx512 || kernel->fn == reduce_gather_avx512) {
+        return __builtin_cpu_supports("avx512f");
+    }
+    if (kernel->fn == reduce_avx2 || kernel->fn == reduce_gather_avx2) {
+        return __builtin_cpu_supports("avx2");
+    }
+    return 1;
+}
+
+const reduce_kernel_t *reduce_kernel_find(const char *name) {
+    // Preferred variant first when two share a name.
+    const reduce_kernel_t *all[] = {&kernel_scalar, &kernel_acc4, &kernel_acc8, &kernel_avx2,
+                                    &kernel_avx512, &kernel_gather_avx512, &kernel_gather_avx2};
+    for (size_t i = 0; i < sizeof(all) / sizeof(all[0]); i++) {
+        if (strcmp(all[i]->name, name) == 0 && kernel_supported(all[i])) {
+            return all[i];
+        }
+    }
+    return NULL;
+}
@@ -0,0 +1,24 @@
+#ifndef REDUCE_H
+#define REDUCE_H
+
+#include <stddef.h>
+
+// Sum of a[0], a[stride], ..., a[(count - 1) * stride].
+typedef double (*reduce_fn)(const double *a, size_t count, size_t stride);
+
+// One strided-sum implementation. They differ in how many independent
+// dependency chains they keep in flight, which decides whether the loop is
+// bound by FP add latency or by the memory system.
+typedef struct {
+    const char *name;
+    reduce_fn fn;
+} reduce_kernel_t;
+
+#define REDUCE_KERNEL_NAMES "scalar, acc4, acc8, avx2, avx512, gather"
+
+// Look up a kernel by name (one of REDUCE_KERNEL_NAMES). Returns NULL if the
+// name is unknown or the CPU lacks the instruction set it needs. "gather"
+// uses AVX-512 gathers when available, AVX2 gathers otherwise.
+const reduce_kernel_t *reduce_kernel_find(const char *name);
+
+#endif
@@ -0,0 +1,299 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <immintrin.h>
+
+#include "arena.h"
+#include "buffer.h"
+#include "cache_info.h"
+#include "gemm.h"
+#include "gemm_stats.h"
+#include "sparse.h"
+
+#define TASKS_PER_THREAD 4   // Row ranges per worker, so stealing can even out the tail.
+
+static int min(int a, int b) {
+    return a < b ? a : b;
+}
+
+// Never ask buffer_alloc for zero bytes (an all-zero matrix has nnz = 0).
+static void *alloc_array(size_t count, size_t size) {
+    return buffer_alloc((count ? count : 1) * size);
+}
+
+double matrix_density(const matrix_t *A) {
+    if (A->rows == 0 || A->cols == 0) {
+        return 0.0;
+    }
+    size_t nonzero = 0;
+    for (int i = 0; i < A->rows; i++) {
+        const double *row = &MAT(A, i, 0);
+        for (int j = 0; j < A->cols; j++) {
+            nonzero += row[j] != 0.0;
+        }
+    }
+    return (double)nonzero / ((double)A->rows * A->cols);
+}
+
+csr_matrix_t csr_from_dense(const matrix_t *A) {
+    csr_matrix_t S;
+    S.rows = A->rows;
+    S.cols = A->cols;
+    S.row_ptr = (int *)alloc_array((size_t)A->rows + 1, sizeof(int));
+    S.row_ptr[0] = 0;
+    for (int i = 0; i < A->rows; i++) {
+        int count = 0;
+        for (int j = 0; j < A->cols; j++) {
+            count += MAT(A, i, j) != 0.0;
+        }
+        S.row_ptr[i + 1] = S.row_ptr[i] + count;
+    }
+    S.nnz = S.row_ptr[A->rows];
+    S.col_idx = (int *)alloc_array((size_t)S.nnz, sizeof(int));
+    S.values = (double *)alloc_array((size_t)S.nnz, sizeof(double));
+    for (int i = 0; i < A->rows; i++) {
+        int p = S.row_ptr[i];
+        for (int j = 0; j < A->cols; j++) {
+            if (MAT(A, i, j) != 0.0) {
+                S.col_idx[p] = j;
+                S.values[p++] = MAT(A, i, j);
+            }
+        }
+    }
+    return S;
+}
+
+bsr_matrix_t bsr_from_dense(const matrix_t *A, int block) {
+    bsr_matrix_t S;
+    int b = block;
+    S.rows = A->rows;
+    S.cols = A->cols;
+    S.block = b;
+    S.block_rows = (A->rows + b - 1) / b;
+    int block_cols = (A->cols + b - 1) / b;
+
+    // First pass: which tiles hold any nonzero.
+    S.row_ptr = (int *)alloc_array((size_t)S.block_rows + 1, sizeof(int));
+    S.row_ptr[0] = 0;
+    for (int bi = 0; bi < S.block_rows; bi++) {
+        int count = 0;
+        for (int bj = 0; bj < block_cols; bj++) {
+            int found = 0;
+            for (int i = bi * b; i < min(A->rows, (bi + 1) * b) && !found; i++) {
+                for (int j = bj * b; j < min(A->cols, (bj + 1) * b); j++) {
+                    if (MAT(A, i, j) != 0.0) {
+                        found = 1;
+                        break;
+                    }
+                }
+            }
+            count += found;
+        }
+        S.row_ptr[bi + 1] = S.row_ptr[bi] + count;
+    }
+    S.nnz_blocks = S.row_ptr[S.block_rows];
+    S.col_idx = (int *)alloc_array((size_t)S.nnz_blocks, sizeof(int));
+    S.values = (double *)alloc_array((size_t)S.nnz_blocks * b * b, sizeof(double));
+
+    // Second pass: copy each nonzero tile (zero-padded at the edges).
+    for (int bi = 0; bi < S.block_rows; bi++) {
+        int p = S.row_ptr[bi];
+        for (int bj = 0; bj < block_cols && p < S.row_ptr[bi + 1]; bj++) {
+            double *tile = S.values + (size_t)p * b * b;
+            int found = 0;
+            for (int r = 0; r < b; r++) {
+                for (int c = 0; c < b; c++) {
+                    int i = bi * b + r, j = bj * b + c;
+                    tile[r * b + c] = i < A->rows && j < A->cols ? MAT(A, i, j) : 0.0;
+                    found |= tile[r * b + c] != 0.0;
+                }
+            }
+            if (found) {
+                S.col_idx[p++] = bj;
+            }
+        }
+    }
+    return S;
+}
+
+void csr_free(csr_matrix_t *A) {
+    buffer_free(A->row_ptr);
+    buffer_free(A->col_idx);
+    buffer_free(A->values);
+    memset(A, 0, sizeof(*A));
+}
+
+void bsr_free(bsr_matrix_t *A) {
+    buffer_free(A->row_ptr);
+    buffer_free(A->col_idx);
+    buffer_free(A->values);
+    memset(A, 0, sizeof(*A));
+}
+
+int sparse_panel_cols(int k) {
+    k = k > 1 ? k : 1;   // K = 0 reads no rows of B; any width will do.
+    long cols = cache_info_get()->l2 / 2 / ((long)k * (long)sizeof(double));
+    cols = cols / 8 * 8;
+    return cols < 8 ? 8 : cols > 1 << 20 ? 1 << 20 : (int)cols;
+}
+
+// ---- Row update c[0:n] += v * b[0:n], the whole inner loop of SpMM ----
+
+static void axpy_scalar(double *c, double v, const double *b, int n) {
+    for (int j = 0; j < n; j++) {
+        c[j] += v * b[j];
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void axpy_avx2(double *c, double v, const double *b, int n) {
+    __m256d vv = _mm256_set1_pd(v);
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        _mm256_storeu_pd(c + j, _mm256_fmadd_pd(vv, _mm256_loadu_pd(b + j), _mm256_loadu_pd(c + j)));
+        _mm256_storeu_pd(c + j + 4,
+                         _mm256_fmadd_pd(vv, _mm256_loadu_pd(b + j + 4), _mm256_loadu_pd(c + j + 4)));
+    }
+    for (; j < n; j++) {
+        c[j] += v * b[j];
+    }
+}
+
+typedef void (*axpy_fn)(double *c, double v, const double *b, int n);
+
+// Same rule as gemm_fixed_kernel: any SIMD GEMM kernel implies AVX2 + FMA.
+static axpy_fn select_axpy(void) {
+    return gemm_kernel_select()->fn ? axpy_avx2 : axpy_scalar;
+}
+
+// ---- Multiply ----
+
+typedef struct {
+    const csr_matrix_t *csr;   // Exactly one of csr / bsr is set.
+    const bsr_matrix_t *bsr;
+    const matrix_t *B;
+    matrix_t *C;
+    int nc;
+    axpy_fn axpy;
+    const int *bounds;   // Task t covers (block) rows bounds[t] .. bounds[t + 1].
+} spmm_job_t;
+
+static void csr_rows(const spmm_job_t *job, int r0, int r1) {
+    const csr_matrix_t *A = job->csr;
+    const matrix_t *B = job->B;
+    matrix_t *C = job->C;
+    for (int jj = 0; jj < C->cols; jj += job->nc) {
+        int jn = min(job->nc, C->cols - jj);
+        for (int i = r0; i < r1; i++) {
+            double *c_row = &MAT(C, i, jj);
+            for (int p = A->row_ptr[i]; p < A->row_ptr[i + 1]; p++) {
+                job->axpy(c_row, A->values[p], &MAT(B, A->col_idx[p], jj), jn);
+            }
+        }
+    }
+}
+
+static void bsr_rows(const spmm_job_t *job, int r0, int r1) {
+    const bsr_matrix_t *A = job->bsr;
+    const matrix_t *B = job->B;
+    matrix_t *C = job->C;
+    int b = A->block;
+    for (int jj = 0; jj < C->cols; jj += job->nc) {
+        int jn = min(job->nc, C->cols - jj);
+        for (int bi = r0; bi < r1; bi++) {
+            int rows = min(b, A->rows - bi * b);
+            for (int p = A->row_ptr[bi]; p < A->row_ptr[bi + 1]; p++) {
+                const double *tile = A->values + (size_t)p * b * b;
+                int k0 = A->col_idx[p] * b, depth = min(b, A->cols - k0);
+                // The tile's rows of C stay in L1 across its b x b updates.
+                for (int r = 0; r < rows; r++) {
+                    double *c_row = &MAT(C, bi * b + r, jj);
+                    for (int k = 0; k < depth; k++) {
+                        if (tile[r * b + k] != 0.0) {
+                            job->axpy(c_row, tile[r * b + k], &MAT(B, k0 + k, jj), jn);
+                        }
+                    }
+                }
+            }
+        }
+    }
+}
+
+static void spmm_task(void *ctx, int task, int worker) {
+    (void)worker;
+    const spmm_job_t *job = (const spmm_job_t *)ctx;
+    if (job->csr) {
+        csr_rows(job, job->bounds[task], job->bounds[task + 1]);
+    } else {
+        bsr_rows(job, job->bounds[task], job->bounds[task + 1]);
+    }
+}
+
+// Split rows into tasks of about equal nonzero count: task t starts at the
+// first row whose row_ptr reaches t * nnz / tasks.
+static void balanced_bounds(const int *row_ptr, int rows, int tasks, int *bounds) {
+    long long nnz = row_ptr[rows];
+    bounds[0] = 0;
+    int r = 0;
+    for (int t = 1; t < tasks; t++) {
+        long long target = nnz * t / tasks;
+        while (r < rows && row_ptr[r] < target) {
+            r++;
+        }
+        bounds[t] = r;
+    }
+    bounds[tasks] = rows;
+}
+
+static void spmm_run(spmm_job_t *job, const int *row_ptr, int rows, int k, int nc) {
+    job->nc = nc > 0 ? nc : sparse_panel_cols(k);
+    job->axpy = select_axpy();
+    thread_pool_t *pool = gemm_get_pool();
+    int tasks = pool ? min(rows, gemm_get_num_threads() * TASKS_PER_THREAD) : 1;
+    tasks = tasks > 0 ? tasks : 1;
+    int *bounds = (int *)scratch_get(((size_t)tasks + 1) * sizeof(int));
+    balanced_bounds(row_ptr, rows, tasks, bounds);
+    job->bounds = bounds;
+    if (pool && tasks > 1) {
+        thread_pool_run(pool, tasks, spmm_task, job);
+    } else {
+        spmm_task(job, 0, 0);
+    }
+    scratch_put(bounds);
+}
+
+void csr_multiply(const csr_matrix_t *A, const matrix_t *B, matrix_t *C, int nc) {
+    if (C->rows == 0 || C->cols == 0 || B->rows == 0) {
+        return;   // C += nothing.
+    }
+    gemm_stats_call_t call;
+    gemm_stats_begin(&call, GEMM_STATS_SPARSE);
+    spmm_job_t job = {A, NULL, B, C, 0, NULL, NULL};
+    spmm_run(&job, A->row_ptr, A->rows, B->rows, nc);
+    gemm_stats_end(&call, 2.0 * A->nnz * B->cols);
+}
+
+void bsr_multiply(const bsr_matrix_t *A, const matrix_t *B, matrix_t *C, int nc) {
+    if (C->rows == 0 || C->cols == 0 || B->rows == 0) {
+        return;
+    }
+    gemm_stats_call_t call;
+    gemm_stats_begin(&call, GEMM_STATS_SPARSE);
+    spmm_job_t job = {NULL, A, B, C, 0, NULL, NULL};
+    spmm_run(&job, A->row_ptr, A->block_rows, B->rows, nc);
+    gemm_stats_end(&call, 2.0 * A->nnz_blocks * A->block * A->block * B->cols);
+}
+
+int matrix_multiply_adaptive(const matrix_t *A, const matrix_t *B, matrix_t *C, double crossover) {
+    if (C->rows == 0 || C->cols == 0 || A->cols == 0) {
+        return 0;
+    }
+    if (matrix_density(A) >= crossover) {
+        matrix_multiply_blocked(A, B, C, NULL);
+        return 0;
+    }
+    csr_matrix_t S = csr_from_dense(A);
+    csr_multiply(&S, B, C, 0);
+    csr_free(&S);
+    return 1;
+}
@@ -0,0 +1,58 @@
+#ifndef SPARSE_H
+#define SPARSE_H
+
+#include "matrix.h"
+
+// Compressed sparse row: the nonzeros of row i are values[row_ptr[i] ..
+// row_ptr[i + 1]) in columns col_idx[...], columns ascending.
+typedef struct {
+    int rows;
+    int cols;
+    int nnz;
+    int *row_ptr;     // rows + 1 entries.
+    int *col_idx;     // nnz entries.
+    double *values;   // nnz entries.
+} csr_matrix_t;
+
+// Block CSR: the same structure over block x block tiles. Every stored tile
+// is dense (row-major, block * block values, zeros included) and tiles past
+// the matrix edge are zero-padded.
+typedef struct {
+    int rows;
+    int cols;
+    int block;
+    int block_rows;   // ceil(rows / block).
+    int nnz_blocks;
+    int *row_ptr;     // block_rows + 1 entries.
+    int *col_idx;     // Block column of each stored tile.
+    double *values;   // nnz_blocks * block * block entries.
+} bsr_matrix_t;
+
+// Fraction of entries of A that are not exactly zero (0 for an empty A).
+double matrix_density(const matrix_t *A);
+
+// Convert from dense storage (exact zeros are dropped). Buffers come from
+// buffer_alloc; exits on allocation failure.
+csr_matrix_t csr_from_dense(const matrix_t *A);
+bsr_matrix_t bsr_from_dense(const matrix_t *A, int block);
+void csr_free(csr_matrix_t *A);
+void bsr_free(bsr_matrix_t *A);
+
+// Sparse x dense: C += A * B, B and C dense. Like the tiled dense engine, the
+// columns of B and C are processed in panels of nc (0 = sparse_panel_cols())
+// so the rows of B a panel touches stay cached while every row of A reuses
+// them. With gemm_set_num_threads > 1, rows are split into ranges of equal
+// nonzero count (not equal row count) on the GEMM pool.
+void csr_multiply(const csr_matrix_t *A, const matrix_t *B, matrix_t *C, int nc);
+void bsr_multiply(const bsr_matrix_t *A, const matrix_t *B, matrix_t *C, int nc);
+
+// Panel width for a B with k rows: the k x nc panel gets half of L2, as a
+// multiple of 8 columns (at least 8).
+int sparse_panel_cols(int k);
+
+// C += A * B, sparse (CSR, conversion included) if A's density is below
+// crossover and matrix_multiply_blocked otherwise. Returns 1 if the sparse
+// path ran (0 for an empty product, which does nothing).
+int matrix_multiply_adaptive(const matrix_t *A, const matrix_t *B, matrix_t *C, double crossover);
+
+#endif
@@ -0,0 +1,252 @@
+#define _GNU_SOURCE
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "thread_pool.h"
+#include "topology.h"
+
+// A worker's remaining task range [begin, end), packed into one 64-bit word
+// so the owner (taking from the front) and thieves (taking from the back)
+// both claim tasks with a single compare-and-swap.
+typedef struct {
+    _Atomic uint64_t range;
+    char pad[64 - sizeof(uint64_t)];   // One deque per cache line.
+} task_deque_t;
+
+struct thread_pool {
+    int nthreads;
+    pthread_t *threads;
+    task_deque_t *deques;
+
+    pthread_mutex_t run_lock;   // Held by the caller whose job owns the pool.
+    pthread_mutex_t lock;
+    pthread_cond_t start_cv;
+    pthread_cond_t done_cv;
+    unsigned long generation;   // Bumped for every thread_pool_run().
+    int running;                // Spawned workers still busy with this generation.
+    int shutdown;
+
+    thread_task_fn fn;
+    void *ctx;
+    int stealing;               // 0 for thread_pool_run_static().
+};
+
+typedef struct {
+    thread_pool_t *pool;
+    int worker;
+} worker_arg_t;
+
+static uint64_t pack_range(uint32_t begin, uint32_t end) {
+    return ((uint64_t)end << 32) | begin;
+}
+
+static int pop_front(task_deque_t *dq) {
+    uint64_t r = atomic_load(&dq->range);
+    for (;;) {
+        uint32_t begin = (uint32_t)r, end = (uint32_t)(r >> 32);
+        if (begin >= end) {
+            return -1;
+        }
+        if (atomic_compare_exchange_weak(&dq->range, &r, pack_range(begin + 1, end))) {
+            return (int)begin;
+        }
+    }
+}
+
+// Move the back half of some other worker's range into our (empty) deque.
+static int steal(thread_pool_t *pool, int self) {
+    for (int offset = 1; offset < pool->nthreads; offset++) {
+        task_deque_t *victim = &pool->deques[(self + offset) % pool->nthreads];
+        uint64_t r = atomic_load(&victim->range);
+        for (;;) {
+            uint32_t begin = (uint32_t)r, end = (uint32_t)(r >> 32);
+            if (begin >= end) {
+                break;
+            }
+            uint32_t take = (end - begin + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &r, pack_range(begin, end - take))) {
+                atomic_store(&pool->deques[self].range, pack_range(end - take, end));
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
+
+static void drain(thread_pool_t *pool, int self) {
+    for (;;) {
+        int task = pop_front(&pool->deques[self]);
+        if (task < 0) {
+            if (!pool->stealing || !steal(pool, self)) {
+                return;
+            }
+            continue;
+        }
+        pool->fn(pool->ctx, task, self);
+    }
+}
+
+static void *worker_main(void *p) {
+    worker_arg_t *arg = (worker_arg_t *)p;
+    thread_pool_t *pool = arg->pool;
+    int self = arg->worker;
+    free(arg);
+
+    unsigned long seen = 0;
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->start_cv, &pool->lock);
+        }
+        if (pool->shutdown) {
+            break;
+        }
+        seen = pool->generation;
+        pthread_mutex_unlock(&pool->lock);
+
+        drain(pool, self);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->running == 0) {
+            pthread_cond_signal(&pool->done_cv);
+        }
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+thread_pool_t *thread_pool_create(int nthreads) {
+    if (nthreads <= 0) {
+        long online = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = online > 0 ? (int)online : 1;
+    }
+
+    thread_pool_t *pool = (thread_pool_t *)calloc(1, sizeof(*pool));
+    task_deque_t *deques = (task_deque_t *)aligned_alloc(64, nthreads * sizeof(task_deque_t));
+    pthread_t *threads = (pthread_t *)calloc(nthreads, sizeof(pthread_t));
+    if (!pool || !deques || !threads) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    pool->nthreads = nthreads;
+    pool->deques = deques;
+    pool->threads = threads;
+    for (int w = 0; w < nthreads; w++) {
+        atomic_init(&deques[w].range, 0);
+    }
+    pthread_mutex_init(&pool->run_lock, NULL);
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start_cv, NULL);
+    pthread_cond_init(&pool->done_cv, NULL);
+
+    for (int w = 1; w < nthreads; w++) {
+        worker_arg_t *arg = (worker_arg_t *)malloc(sizeof(*arg));
+        if (!arg) {
+            fprintf(stderr, "Memory allocation failed\n");
+            exit(EXIT_FAILURE);
+        }
+        arg->pool = pool;
+        arg->worker = w;
+        if (pthread_create(&threads[w], NULL, worker_main, arg) != 0) {
+            fprintf(stderr, "Thread creation failed\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    return pool;
+}
+
+void thread_pool_destroy(thread_pool_t *pool) {
+    if (!pool) {
+        return;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start_cv);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int w = 1; w < pool->nthreads; w++) {
+        pthread_join(pool->threads[w], NULL);
+    }
+    pthread_mutex_destroy(&pool->run_lock);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->start_cv);
+    pthread_cond_destroy(&pool->done_cv);
+    free(pool->threads);
+    free(pool->deques);
+    free(pool);
+}
+
+int thread_pool_size(const thread_pool_t *pool) {
+    return pool->nthreads;
+}
+
+static void run_tasks(thread_pool_t *pool, int ntasks, thread_task_fn fn, void *ctx, int stealing) {
+    if (ntasks <= 0) {
+        return;
+    }
+    // A lone task runs on the caller (worker 0) in both modes, so static
+    // first touch and the stealing compute agree on where it runs.
+    // The pool holds one job at a time. A caller that finds it busy (another
+    // thread's multiply) runs its own tasks serially as worker 0 rather than
+    // overwrite that job; task scratch is per job, so this is safe.
+    if (pool->nthreads == 1 || ntasks == 1 ||
+        pthread_mutex_trylock(&pool->run_lock) != 0) {
+        for (int t = 0; t < ntasks; t++) {
+            fn(ctx, t, 0);
+        }
+        return;
+    }
+
+    // Contiguous initial shares keep neighbouring tiles on the same worker.
+    int n = pool->nthreads;
+    for (int w = 0; w < n; w++) {
+        uint32_t begin = (uint32_t)((long)ntasks * w / n);
+        uint32_t end = (uint32_t)((long)ntasks * (w + 1) / n);
+        atomic_store(&pool->deques[w].range, pack_range(begin, end));
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    pool->fn = fn;
+    pool->ctx = ctx;
+    pool->stealing = stealing;
+    pool->running = n - 1;
+    pool->generation++;
+    pthread_cond_broadcast(&pool->start_cv);
+    pthread_mutex_unlock(&pool->lock);
+
+    drain(pool, 0);
+
+    pthread_mutex_lock(&pool->lock);
+    while (pool->running > 0) {
+        pthread_cond_wait(&pool->done_cv, &pool->lock);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    pthread_mutex_unlock(&pool->run_lock);
+}
+
+void thread_pool_run(thread_pool_t *pool, int ntasks, thread_task_fn fn, void *ctx) {
+    run_tasks(pool, ntasks, fn, ctx, 1);
+}
+
+void thread_pool_run_static(thread_pool_t *pool, int ntasks, thread_task_fn fn, void *ctx) {
+    run_tasks(pool, ntasks, fn, ctx, 0);
+}
+
+int thread_pool_pin(thread_pool_t *pool) {
+    const topology_t *topo = topology_get();
+    int rc = topology_pin_self(0);
+    for (int w = 1; w < pool->nthreads; w++) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(topo->cpus[w % topo->ncpus], &set);
+        if (pthread_setaffinity_np(pool->threads[w], sizeof(set), &set) != 0) {
+            rc = -1;
+        }
+    }
+    return rc;
+}
@@ -0,0 +1,37 @@
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+// Persistent pool of worker threads that run indexed tasks with work stealing.
+typedef struct thread_pool thread_pool_t;
+
+// Task body: task is in [0, ntasks), worker in [0, thread_pool_size()).
+typedef void (*thread_task_fn)(void *ctx, int task, int worker);
+
+// Create a pool with nthreads workers in total (the calling thread counts as
+// worker 0, so nthreads - 1 threads are spawned). nthreads <= 0 means one per
+// online CPU. Exits on failure.
+thread_pool_t *thread_pool_create(int nthreads);
+
+void thread_pool_destroy(thread_pool_t *pool);
+
+int thread_pool_size(const thread_pool_t *pool);
+
+// Run fn for every task index and return once all of them have finished.
+// Each worker starts with a contiguous share of the indices; a worker whose
+// share runs out steals the back half of another worker's remaining range,
+// so faster cores pick up work from slower ones. The pool runs one call at
+// a time; a concurrent call from another thread runs all of its tasks on
+// that thread (as worker 0) instead of waiting.
+void thread_pool_run(thread_pool_t *pool, int ntasks, thread_task_fn fn, void *ctx);
+
+// Same as thread_pool_run but without stealing: worker w runs exactly the
+// contiguous share it would start with in thread_pool_run (a single task
+// runs on worker 0 in both). Used to first-touch memory with the same
+// task-to-worker mapping as the compute.
+void thread_pool_run_static(thread_pool_t *pool, int ntasks, thread_task_fn fn, void *ctx);
+
+// Pin worker w (the caller is worker 0) to the w-th CPU of the node-major
+// order from topology_get(). Returns 0 if every pin succeeded.
+int thread_pool_pin(thread_pool_t *pool);
+
+#endif
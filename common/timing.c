@@ -0,0 +1,124 @@
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "timing.h"
+
+double timing_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static int compare_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Linear interpolation between closest ranks of a sorted sample.
+static double percentile(const double *sorted, int n, double p) {
+    double pos = p * (n - 1);
+    int lo = (int)pos;
+    int hi = lo + 1 < n ? lo + 1 : lo;
+    return sorted[lo] + (pos - lo) * (sorted[hi] - sorted[lo]);
+}
+
+timing_stats_t timing_run(timing_fn body, timing_fn reset, void *ctx, int warmup, int reps) {
+    if (reps < 1) {
+        reps = 1;
+    }
+    double *samples = (double *)malloc(reps * sizeof(double));
+    if (!samples) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Warmup runs fault pages in and settle caches, branch predictors and clocks.
+    for (int w = 0; w < warmup; w++) {
+        if (reset) reset(ctx);
+        body(ctx);
+    }
+
+    int counting = perf_counters_enabled();
+    if (counting) {
+        perf_counters_reset();
+    }
+    for (int r = 0; r < reps; r++) {
+        if (reset) reset(ctx);
+        if (counting) perf_counters_resume();
+        double start = timing_now();
+        body(ctx);
+        double end = timing_now();
+        if (counting) perf_counters_pause();
+        samples[r] = (end - start) * 1000.0;
+    }
+
+    timing_stats_t st;
+    st.reps = reps;
+    perf_counters_read(&st.perf);
+    for (int e = 0; e < PERF_NUM_EVENTS; e++) {
+        st.perf.value[e] /= reps;
+    }
+    double sum = 0.0;
+    for (int r = 0; r < reps; r++) {
+        sum += samples[r];
+    }
+    st.mean = sum / reps;
+    double var = 0.0;
+    for (int r = 0; r < reps; r++) {
+        var += (samples[r] - st.mean) * (samples[r] - st.mean);
+    }
+    st.stddev = reps > 1 ? sqrt(var / (reps - 1)) : 0.0;
+
+    qsort(samples, reps, sizeof(double), compare_double);
+    st.min = samples[0];
+    st.median = percentile(samples, reps, 0.5);
+    st.p95 = percentile(samples, reps, 0.95);
+
+    free(samples);
+    return st;
+}
+
+// Whole-string integer in [min, INT_MAX], or -1.
+static int parse_count(const char *text, int min) {
+    char *end;
+    long v = strtol(text, &end, 10);
+    if (end == text || *end != '\0' || v < min || v > INT_MAX) {
+        return -1;
+    }
+    return (int)v;
+}
+
+int timing_parse_arg(int argc, char **argv, int *i, int *warmup, int *reps) {
+    if (strcmp(argv[*i], "--perf") == 0) {
+        if (perf_counters_open() == 0) {
+            fprintf(stderr, "Warning: no hardware counters available (check perf_event_paranoid)\n");
+        }
+        return 1;
+    }
+    if (*i + 1 >= argc) {
+        return 0;
+    }
+    if (strcmp(argv[*i], "--warmup") == 0) {
+        int v = parse_count(argv[*i + 1], 0);
+        if (v < 0) {
+            return 0;
+        }
+        *warmup = v;
+        ++*i;
+        return 1;
+    }
+    if (strcmp(argv[*i], "--reps") == 0) {
+        int v = parse_count(argv[*i + 1], 1);
+        if (v < 0) {
+            return 0;
+        }
+        *reps = v;
+        ++*i;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,39 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+#include "perf_counters.h"
+
+// Wall-clock seconds from CLOCK_MONOTONIC (unaffected by clock changes and,
+// unlike clock(), not summed over threads).
+double timing_now(void);
+
+// Summary of the timed repetitions, in milliseconds.
+typedef struct {
+    int reps;
+    double min;
+    double median;
+    double mean;
+    double stddev;
+    double p95;
+    perf_sample_t perf;   // Per-run average over the timed runs (if --perf).
+} timing_stats_t;
+
+typedef void (*timing_fn)(void *ctx);
+
+// Run body `warmup` times untimed, then `reps` times timed (reps >= 1).
+// reset, if not NULL, runs untimed before every call of body (e.g. to clear
+// an output matrix), so each repetition starts from the same state. When
+// hardware counters are open, they count only the timed body calls.
+timing_stats_t timing_run(timing_fn body, timing_fn reset, void *ctx, int warmup, int reps);
+
+// Parse --warmup N / --reps N / --perf at argv[*i]. Returns 1 (and advances
+// *i past any value) if the argument was one of them, 0 otherwise,
+// including for a missing or malformed value, a negative --warmup or a
+// --reps below 1, so the caller's usage() rejects those. --perf opens the
+// hardware counters, so it must be parsed before threads start.
+int timing_parse_arg(int argc, char **argv, int *i, int *warmup, int *reps);
+
+#define TIMING_DEFAULT_WARMUP 1
+#define TIMING_DEFAULT_REPS 5
+
+#endif
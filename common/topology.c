@@ -0,0 +1,157 @@
+#define _GNU_SOURCE
+#include <sched.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "topology.h"
+
+#define MAX_SAMPLED_PAGES 4096
+
+// Parse a sysfs cpulist ("0-3,8,10-11") into node_of_cpu[] for one node.
+static void parse_cpulist(const char *list, int node, int *node_of_cpu, int max_cpu) {
+    const char *p = list;
+    while (*p) {
+        char *end;
+        long lo = strtol(p, &end, 10);
+        if (end == p) {
+            break;
+        }
+        long hi = lo;
+        p = end;
+        if (*p == '-') {
+            hi = strtol(p + 1, &end, 10);
+            p = end;
+        }
+        for (long c = lo; c <= hi && c < max_cpu; c++) {
+            node_of_cpu[c] = node;
+        }
+        if (*p == ',') {
+            p++;
+        } else {
+            break;
+        }
+    }
+}
+
+const topology_t *topology_get(void) {
+    static topology_t topo;
+    static int initialized = 0;
+    if (initialized) {
+        return &topo;
+    }
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+        CPU_SET(0, &allowed);
+    }
+
+    int node_of_cpu[CPU_SETSIZE];
+    for (int c = 0; c < CPU_SETSIZE; c++) {
+        node_of_cpu[c] = 0;
+    }
+    for (int node = 0; node < TOPOLOGY_MAX_NODES; node++) {
+        char path[96], list[4096];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *fp = fopen(path, "r");
+        if (fp == NULL) {
+            continue;
+        }
+        if (fgets(list, sizeof(list), fp) != NULL) {
+            parse_cpulist(list, node, node_of_cpu, CPU_SETSIZE);
+        }
+        fclose(fp);
+    }
+
+    int ncpus = CPU_COUNT(&allowed);
+    topo.cpus = (int *)malloc(ncpus * sizeof(int));
+    topo.node_of = (int *)malloc(ncpus * sizeof(int));
+    if (!topo.cpus || !topo.node_of) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Node-major order: all allowed CPUs of node 0, then node 1, ...
+    topo.ncpus = 0;
+    topo.nnodes = 0;
+    for (int node = 0; node < TOPOLOGY_MAX_NODES; node++) {
+        int found = 0;
+        for (int c = 0; c < CPU_SETSIZE; c++) {
+            if (CPU_ISSET(c, &allowed) && node_of_cpu[c] == node) {
+                topo.cpus[topo.ncpus] = c;
+                topo.node_of[topo.ncpus] = node;
+                topo.ncpus++;
+                found = 1;
+            }
+        }
+        topo.nnodes += found;
+    }
+
+    initialized = 1;
+    return &topo;
+}
+
+int topology_pin_self(int worker) {
+    const topology_t *topo = topology_get();
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(topo->cpus[worker % topo->ncpus], &set);
+    return sched_setaffinity(0, sizeof(set), &set) == 0 ? 0 : -1;
+}
+
+long topology_page_nodes(const void *p, size_t bytes, long *counts) {
+    for (int n = 0; n < TOPOLOGY_MAX_NODES; n++) {
+        counts[n] = 0;
+    }
+    long page = sysconf(_SC_PAGESIZE);
+    uintptr_t first = (uintptr_t)p / page * page;
+    long npages = (long)(((uintptr_t)p + bytes - first + page - 1) / page);
+    if (npages <= 0) {
+        return 0;
+    }
+    long step = npages > MAX_SAMPLED_PAGES ? npages / MAX_SAMPLED_PAGES : 1;
+    long nsample = (npages + step - 1) / step;
+
+    void **pages = (void **)malloc(nsample * sizeof(void *));
+    int *status = (int *)malloc(nsample * sizeof(int));
+    if (!pages || !status) {
+        fprintf(stderr, "Memory allocation failed\n");
+        exit(EXIT_FAILURE);
+    }
+    for (long i = 0; i < nsample; i++) {
+        pages[i] = (void *)(first + (uintptr_t)(i * step) * page);
+    }
+
+    // move_pages with nodes == NULL only queries where each page lives.
+    long rc = syscall(SYS_move_pages, 0, nsample, pages, NULL, status, 0);
+    if (rc == 0) {
+        for (long i = 0; i < nsample; i++) {
+            if (status[i] >= 0 && status[i] < TOPOLOGY_MAX_NODES) {
+                counts[status[i]]++;
+            }
+        }
+    }
+    free(pages);
+    free(status);
+    return rc == 0 ? nsample : -1;
+}
+
+void topology_report_buffer(FILE *out, const char *name, const void *p, size_t bytes) {
+    long counts[TOPOLOGY_MAX_NODES];
+    long total = topology_page_nodes(p, bytes, counts);
+
+    fprintf(out, "NUMA placement %s:", name);
+    if (total < 0) {
+        fprintf(out, " unknown");
+    }
+    for (int n = 0; n < TOPOLOGY_MAX_NODES && total > 0; n++) {
+        if (counts[n] > 0) {
+            fprintf(out, " node%d %.0f%%", n, 100.0 * counts[n] / total);
+        }
+    }
+    fprintf(out, "\n");
+}
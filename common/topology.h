@@ -0,0 +1,34 @@
+#ifndef TOPOLOGY_H
+#define TOPOLOGY_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#define TOPOLOGY_MAX_NODES 64
+
+// CPUs this process may run on, ordered node by node (node 0's CPUs first),
+// so that consecutive worker indices share a NUMA node.
+typedef struct {
+    int ncpus;
+    int *cpus;      // Pin order: worker w runs on cpus[w % ncpus].
+    int *node_of;   // node_of[w] = NUMA node of cpus[w].
+    int nnodes;     // Number of nodes with at least one usable CPU.
+} topology_t;
+
+// Detect once from sched_getaffinity and /sys/devices/system/node; a host
+// without NUMA information is reported as a single node.
+const topology_t *topology_get(void);
+
+// Pin the calling thread to the CPU assigned to worker. Returns 0 on success.
+int topology_pin_self(int worker);
+
+// Count the pages of [p, p + bytes) resident on each node (sampling at most
+// a few thousand pages). counts must hold TOPOLOGY_MAX_NODES entries; pages
+// not yet faulted in or not queryable are not counted. Returns the number
+// of pages inspected, or -1 if the kernel cannot report placement.
+long topology_page_nodes(const void *p, size_t bytes, long *counts);
+
+// Write "NUMA placement name: node0 NN% node1 NN%" for a buffer to out.
+void topology_report_buffer(FILE *out, const char *name, const void *p, size_t bytes);
+
+#endif
@@ -0,0 +1,86 @@
+#include <immintrin.h>
+
+#include "transpose.h"
+
+static int min(int a, int b) {
+    return a < b ? a : b;
+}
+
+static int have_avx2(void) {
+    static int cached = -1;
+    if (cached < 0) {
+        __builtin_cpu_init();
+        cached = __builtin_cpu_supports("avx2");
+    }
+    return cached;
+}
+
+const char *transpose_impl_name(int impl) {
+    switch (impl) {
+    case TRANSPOSE_NAIVE: return "naive";
+    case TRANSPOSE_BLOCKED: return "blocked";
+    case TRANSPOSE_AVX2: return "avx2 4x4";
+    }
+    return "unknown";
+}
+
+int transpose_impl_supported(int impl) {
+    return impl == TRANSPOSE_AVX2 ? have_avx2() : impl >= 0 && impl < TRANSPOSE_IMPLS;
+}
+
+// dst[j][i] = src[i][j] for i in [i0, i1), j in [j0, j1).
+static void tile_scalar(const matrix_t *src, matrix_t *dst, int i0, int i1, int j0, int j1) {
+    for (int i = i0; i < i1; i++) {
+        const double *row = &MAT(src, i, 0);
+        for (int j = j0; j < j1; j++) {
+            MAT(dst, j, i) = row[j];
+        }
+    }
+}
+
+__attribute__((target("avx2")))
+static void tile_avx2(const matrix_t *src, matrix_t *dst, int i0, int i1, int j0, int j1) {
+    int i4 = i0 + (i1 - i0) / 4 * 4, j4 = j0 + (j1 - j0) / 4 * 4;
+    for (int i = i0; i < i4; i += 4) {
+        for (int j = j0; j < j4; j += 4) {
+            __m256d r0 = _mm256_loadu_pd(&MAT(src, i, j));       // a0 a1 a2 a3
+            __m256d r1 = _mm256_loadu_pd(&MAT(src, i + 1, j));   // b0 b1 b2 b3
+            __m256d r2 = _mm256_loadu_pd(&MAT(src, i + 2, j));
+            __m256d r3 = _mm256_loadu_pd(&MAT(src, i + 3, j));
+            __m256d t0 = _mm256_unpacklo_pd(r0, r1);              // a0 b0 a2 b2
+            __m256d t1 = _mm256_unpackhi_pd(r0, r1);              // a1 b1 a3 b3
+            __m256d t2 = _mm256_unpacklo_pd(r2, r3);              // c0 d0 c2 d2
+            __m256d t3 = _mm256_unpackhi_pd(r2, r3);              // c1 d1 c3 d3
+            _mm256_storeu_pd(&MAT(dst, j, i), _mm256_permute2f128_pd(t0, t2, 0x20));
+            _mm256_storeu_pd(&MAT(dst, j + 1, i), _mm256_permute2f128_pd(t1, t3, 0x20));
+            _mm256_storeu_pd(&MAT(dst, j + 2, i), _mm256_permute2f128_pd(t0, t2, 0x31));
+            _mm256_storeu_pd(&MAT(dst, j + 3, i), _mm256_permute2f128_pd(t1, t3, 0x31));
+        }
+    }
+    // Strips left over when the tile is not a multiple of 4 on a side.
+    tile_scalar(src, dst, i0, i4, j4, j1);
+    tile_scalar(src, dst, i4, i1, j0, j1);
+}
+
+void matrix_transpose_impl(const matrix_t *src, matrix_t *dst, int impl) {
+    if (impl == TRANSPOSE_NAIVE) {
+        tile_scalar(src, dst, 0, src->rows, 0, src->cols);
+        return;
+    }
+    int simd = impl == TRANSPOSE_AVX2 && have_avx2();
+    for (int ii = 0; ii < src->rows; ii += TRANSPOSE_BLOCK) {
+        int i1 = min(ii + TRANSPOSE_BLOCK, src->rows);
+        for (int jj = 0; jj < src->cols; jj += TRANSPOSE_BLOCK) {
+            int j1 = min(jj + TRANSPOSE_BLOCK, src->cols);
+            if (simd) {
+                tile_avx2(src, dst, ii, i1, jj, j1);
+            } else {
+                tile_scalar(src, dst, ii, i1, jj, j1);
+            }
+        }
+    }
+}
+
+void matrix_transpose(const matrix_t *src, matrix_t *dst) {
+    matrix_transpose_impl(src, dst, have_avx2() ? TRANSPOSE_AVX2 : TRANSPOSE_BLOCKED);
+}
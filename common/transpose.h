@@ -0,0 +1,27 @@
+#ifndef TRANSPOSE_H
+#define TRANSPOSE_H
+
+#include "matrix.h"
+
+// Out-of-place transpose, dst (cols x rows) = src^T, in three versions:
+// the plain double loop (one of the two sides is walked down columns), the
+// same loop over TRANSPOSE_BLOCK x TRANSPOSE_BLOCK tiles so both sides of a
+// tile stay in L1, and the tiled loop with each tile done as 4x4 register
+// blocks (four row loads, unpack and 128-bit lane permutes, four row stores).
+enum { TRANSPOSE_NAIVE, TRANSPOSE_BLOCKED, TRANSPOSE_AVX2, TRANSPOSE_IMPLS };
+
+#define TRANSPOSE_BLOCK 32   // Tile side: two 8 KiB tiles fit comfortably in L1.
+
+// "naive", "blocked", "avx2 4x4".
+const char *transpose_impl_name(int impl);
+
+// 0 if the CPU lacks the instructions (TRANSPOSE_AVX2 without AVX2).
+int transpose_impl_supported(int impl);
+
+// dst must be src->cols x src->rows; any leading dimensions.
+void matrix_transpose_impl(const matrix_t *src, matrix_t *dst, int impl);
+
+// Fastest supported version.
+void matrix_transpose(const matrix_t *src, matrix_t *dst);
+
+#endif
@@ -0,0 +1,198 @@
+#include <float.h>
+#include <math.h>
+#include <string.h>
+
+#include "arena.h"
+#include "verify.h"
+
+// Bound on the relative rounding error of an n-term sum of products.
+static double gamma_n(int n) {
+    double nu = n * (DBL_EPSILON / 2);
+    return nu / (1.0 - nu);
+}
+
+// Distance from |r| to the next double up.
+static double ulp(double r) {
+    r = fabs(r);
+    return r > 0.0 ? nextafter(r, INFINITY) - r : DBL_TRUE_MIN;
+}
+
+// error / bound, with an exact zero bound only satisfied by a zero error.
+static double ratio(double error, double bound) {
+    if (bound > 0.0) {
+        return error / bound;
+    }
+    return error > 0.0 ? INFINITY : 0.0;
+}
+
+int verify_reference(const matrix_t *A, const matrix_t *B, const matrix_t *C, const matrix_t *R,
+                     double slack, verify_result_t *out) {
+    int m = C->rows, n = C->cols, k = A->cols;
+    if (A->rows != m || B->rows != k || B->cols != n || R->rows != m || R->cols != n) {
+        return -1;
+    }
+    double *row_norm = (double *)scratch_get((size_t)(m + n) * sizeof(double));
+    double *col_norm = row_norm + m;
+
+    for (int i = 0; i < m; i++) {
+        double s = 0.0;
+        for (int p = 0; p < k; p++) {
+            s += MAT(A, i, p) * MAT(A, i, p);
+        }
+        row_norm[i] = sqrt(s);
+    }
+    memset(col_norm, 0, (size_t)n * sizeof(double));
+    for (int p = 0; p < k; p++) {
+        const double *b_row = &MAT(B, p, 0);
+        for (int j = 0; j < n; j++) {
+            col_norm[j] += b_row[j] * b_row[j];
+        }
+    }
+    for (int j = 0; j < n; j++) {
+        col_norm[j] = sqrt(col_norm[j]);
+    }
+
+    // A little above 2 gamma(K) for the rounding of the norms themselves.
+    double scale = slack * 2.0 * gamma_n(k + 2);
+    verify_result_t r = {1, 1, 0.0, 0.0, 0.0, 0.0};
+    double r_max = 0.0;
+    for (int i = 0; i < m; i++) {
+        for (int j = 0; j < n; j++) {
+            double c = MAT(C, i, j), ref = MAT(R, i, j);
+            double d = fabs(c - ref);
+            if (d != d) {
+                d = INFINITY;   // NaN in either matrix.
+            }
+            double q = ratio(d, scale * row_norm[i] * col_norm[j]);
+            if (d > r.max_error) r.max_error = d;
+            if (q > r.max_ratio) r.max_ratio = q;
+            if (d / ulp(ref) > r.max_ulps) r.max_ulps = d / ulp(ref);
+            if (fabs(ref) > r_max) r_max = fabs(ref);
+        }
+    }
+    scratch_put(row_norm);
+
+    r.rel_error = ratio(r.max_error, r_max);
+    r.passed = r.max_ratio <= 1.0;
+    *out = r;
+    return r.passed ? 0 : 1;
+}
+
+// xorshift64: a private stream, so checks do not move the rand() sequence
+// the benchmarks fill their inputs from.
+static unsigned long long next_random(unsigned long long *state) {
+    unsigned long long x = *state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return *state = x;
+}
+
+int verify_freivalds(const matrix_t *A, const matrix_t *B, const matrix_t *C, int rounds,
+                     unsigned long seed, double slack, verify_result_t *out) {
+    int m = C->rows, n = C->cols, k = A->cols;
+    if (A->rows != m || B->rows != k || B->cols != n || rounds < 1) {
+        return -1;
+    }
+    // x (n), B x and |B| 1 (k each), then A (B x), C x, |A| |B| 1 and |C| 1 (m each).
+    double *x = (double *)scratch_get((size_t)(n + 2 * k + 4 * m) * sizeof(double));
+    double *y = x + n, *abs_b = y + k;
+    double *z = abs_b + k, *w = z + m, *abs_ab = w + m, *abs_c = abs_ab + m;
+
+    // With |x| = 1, the magnitudes are the same for every round.
+    memset(abs_b, 0, (size_t)k * sizeof(double));
+    for (int p = 0; p < k; p++) {
+        for (int j = 0; j < n; j++) {
+            abs_b[p] += fabs(MAT(B, p, j));
+        }
+    }
+    for (int i = 0; i < m; i++) {
+        double s = 0.0, c = 0.0;
+        for (int p = 0; p < k; p++) {
+            s += fabs(MAT(A, i, p)) * abs_b[p];
+        }
+        for (int j = 0; j < n; j++) {
+            c += fabs(MAT(C, i, j));
+        }
+        abs_ab[i] = s;
+        abs_c[i] = c;
+    }
+
+    // Rounding in C itself, in B x and A (B x), and in C x.
+    double ab_scale = slack * (2.0 * gamma_n(k) + 2.0 * gamma_n(n + 1));
+    double c_scale = slack * gamma_n(n + 1);
+    unsigned long long state = seed * 0x9E3779B97F4A7C15ULL + 1;
+    verify_result_t r = {1, 1, 0.0, 0.0, 0.0, 0.0};
+    for (int round = 0; round < rounds; round++) {
+        for (int j = 0; j < n; j++) {
+            x[j] = (next_random(&state) >> 63) ? 1.0 : -1.0;
+        }
+        for (int p = 0; p < k; p++) {
+            const double *b_row = &MAT(B, p, 0);
+            double s = 0.0;
+            for (int j = 0; j < n; j++) {
+                s += b_row[j] * x[j];
+            }
+            y[p] = s;
+        }
+        for (int i = 0; i < m; i++) {
+            const double *a_row = &MAT(A, i, 0), *c_row = &MAT(C, i, 0);
+            double s = 0.0, t = 0.0;
+            for (int p = 0; p < k; p++) {
+                s += a_row[p] * y[p];
+            }
+            for (int j = 0; j < n; j++) {
+                t += c_row[j] * x[j];
+            }
+            z[i] = s;
+            w[i] = t;
+        }
+        for (int i = 0; i < m; i++) {
+            double d = fabs(z[i] - w[i]);
+            if (d != d) {
+                d = INFINITY;
+            }
+            double q = ratio(d, ab_scale * abs_ab[i] + c_scale * abs_c[i]);
+            if (d > r.max_error) r.max_error = d;
+            if (q > r.max_ratio) r.max_ratio = q;
+        }
+    }
+    scratch_put(x);
+
+    r.passed = r.max_ratio <= 1.0;
+    *out = r;
+    return r.passed ? 0 : 1;
+}
+
+int verify_parse_mode(const char *text) {
+    if (strcmp(text, "none") == 0) return 0;
+    if (strcmp(text, "freivalds") == 0) return VERIFY_FREIVALDS;
+    if (strcmp(text, "reference") == 0) return VERIFY_REFERENCE;
+    if (strcmp(text, "both") == 0) return VERIFY_FREIVALDS | VERIFY_REFERENCE;
+    return -1;
+}
+
+void verify_print_header(FILE *out) {
+    fprintf(out, ", Freivalds error, Freivalds / bound, Reference error, Reference / bound, "
+                 "Max ULPs, Relative error, Result");
+}
+
+void verify_print_values(FILE *out, const verify_result_t *freivalds,
+                         const verify_result_t *reference) {
+    const verify_result_t *checks[] = {freivalds, reference};
+    int passed = 1;
+    for (int c = 0; c < 2; c++) {
+        if (checks[c] && checks[c]->checked) {
+            fprintf(out, ", %.3e, %.2e", checks[c]->max_error, checks[c]->max_ratio);
+            passed &= checks[c]->passed;
+        } else {
+            fprintf(out, ", -, -");
+        }
+    }
+    if (reference && reference->checked) {
+        fprintf(out, ", %.0f, %.3e", reference->max_ulps, reference->rel_error);
+    } else {
+        fprintf(out, ", -, -");
+    }
+    fprintf(out, ", %s", passed ? "PASSED" : "FAILED");
+}
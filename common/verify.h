@@ -0,0 +1,53 @@
+#ifndef VERIFY_H
+#define VERIFY_H
+
+#include <stdio.h>
+
+#include "matrix.h"
+
+// Checks that a computed product C = A * B is right, with bounds that allow
+// for the rounding of any summation order (so a blocked or threaded kernel
+// is not failed for adding in a different order than the reference):
+//
+// - verify_reference compares every element with a reference product R.
+//   Each of C and R is within gamma(K) * (|A| |B|)_ij of the exact value
+//   (gamma(K) = K u / (1 - K u), u = 2^-53), so they may differ by twice
+//   that. (|A| |B|)_ij is bounded by |a_i|_2 |b_j|_2 (row i of A, column j
+//   of B), which costs O(N^2) instead of another product.
+// - verify_freivalds compares A (B x) with C x for random x of +-1 entries
+//   in O(N^2), so it can stay on at any size. A wrong element moves (C x)_i
+//   by its full error for every x; several wrong elements cancel in a
+//   round with probability at most 1/2.
+//
+// slack multiplies the bounds: 1 for the classical O(N^3) orders, more for
+// engines with a weaker error bound (Strassen).
+typedef struct {
+    int checked;        // 0 if this check was not run.
+    int passed;
+    double max_error;   // Max |C - R| (reference) or max |A (B x) - C x| (Freivalds).
+    double max_ratio;   // Max of error / bound over all elements; passes when <= 1.
+    double max_ulps;    // Reference only: max |C - R| in units in the last place of R.
+    double rel_error;   // Reference only: max |C - R| / max |R|.
+} verify_result_t;
+
+// Check flags for verify_parse_mode.
+enum { VERIFY_FREIVALDS = 1, VERIFY_REFERENCE = 2 };
+
+#define VERIFY_DEFAULT_ROUNDS 2   // Freivalds vectors per check.
+
+// Both return 0 if C passes, 1 if it fails, -1 on mismatched shapes.
+int verify_reference(const matrix_t *A, const matrix_t *B, const matrix_t *C, const matrix_t *R,
+                     double slack, verify_result_t *out);
+int verify_freivalds(const matrix_t *A, const matrix_t *B, const matrix_t *C, int rounds,
+                     unsigned long seed, double slack, verify_result_t *out);
+
+// "none", "freivalds", "reference" or "both" to a set of flags; -1 if unknown.
+int verify_parse_mode(const char *text);
+
+// CSV helpers in the style of perf_print_header/values: ", Freivalds ..."
+// columns and the matching values ("-" for a check that was not run).
+void verify_print_header(FILE *out);
+void verify_print_values(FILE *out, const verify_result_t *freivalds,
+                         const verify_result_t *reference);
+
+#endif
@@ -1,38 +1,633 @@
 #include "stdio.h"
 #include "stdlib.h"
-#include "time.h"
+#include "string.h"
 
-#define MAX_STRIDE 20
+#include "unistd.h"
+#include "emmintrin.h"
 
-int main()
+#include "../common/buffer.h"
+#include "../common/cache_info.h"
+#include "../common/matrix.h"
+#include "../common/reduce.h"
+#include "../common/thread_pool.h"
+#include "../common/topology.h"
+#include "../common/timing.h"
+
+#define DEFAULT_N 1000000    // Elements touched per stride.
+#define DEFAULT_MAX_STRIDE 20
+#define MAX_STRIDES 64
+#define DEFAULT_SWEEP_STRIDES "1,2,4,8,16,32"
+#define DEFAULT_MIN_WS 4096L
+#define SWEEP_MAX_DEFAULT (4LL << 30) // Capped at half of physical memory.
+#define MAX_WORKING_SETS 128
+#define STREAM_MIN_ELEMS (10L * 1000 * 1000) // Arrays are also at least 4x the L3.
+#define STREAM_SCALAR 3.0
+#define PREFETCH_CHUNK 64  // Accesses summed between prefetch bursts.
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--length N] [--min-stride S] [--max-stride S] [--reduce K] "
+                    "[--prefetch D1,D2,...] [--warmup N] [--reps N] [--perf]\n"
+                    "       %s --sweep [--min-ws SIZE] [--max-ws SIZE] [--strides S1,S2,...] "
+                    "[--reduce K] [--length N] [--warmup N] [--reps N] [--perf]\n"
+                    "       %s --chase [--granularity line|page] [--min-ws SIZE] [--max-ws SIZE] "
+                    "[--length N] [--warmup N] [--reps N] [--perf]\n"
+                    "       %s --stream [--length N] [--threads N] [--nt] [--pin] "
+                    "[--warmup N] [--reps N] [--perf]\n"
+                    "SIZE is in bytes, with an optional K, M or G suffix.\n"
+                    "K is the reduction kernel: " REDUCE_KERNEL_NAMES " (default scalar).\n"
+                    "Every mode also takes --alloc malloc|memalign|thp|huge2m|huge1g and --populate.\n",
+            prog, prog, prog, prog);
+    exit(EXIT_FAILURE);
+}
+
+// Parse "4096", "32K", "256M" or "4G". Returns 0 on a malformed size.
+static long long parse_size(const char *text)
+{
+    char *end;
+    long long v = strtoll(text, &end, 10);
+    if (end == text || v <= 0)
+        return 0;
+    switch (*end)
+    {
+    case 'K': case 'k': v <<= 10; end++; break;
+    case 'M': case 'm': v <<= 20; end++; break;
+    case 'G': case 'g': v <<= 30; end++; break;
+    default: break;
+    }
+    return *end == '\0' ? v : 0;
+}
+
+typedef struct
+{
+    const double *a;
+    long n;
+    long stride;
+    reduce_fn reduce;
+    long distance;  // Software prefetch distance in accesses (0 = none).
+    double sum;
+} stride_ctx_t;
+
+// Software-prefetch variant: before each chunk of PREFETCH_CHUNK accesses,
+// prefetch the accesses `distance` ahead of it (one per cache line), then
+// sum the chunk with the selected kernel.
+static double stride_sum_prefetch(const stride_ctx_t *ctx)
+{
+    const double *a = ctx->a;
+    long n = ctx->n, stride = ctx->stride, distance = ctx->distance;
+    long line = cache_info_get()->line / (long)sizeof(double);
+    long step = stride >= line ? 1 : line / stride;
+    double sum = 0.0;
+    for (long i = 0; i < n; i += PREFETCH_CHUNK)
+    {
+        long count = n - i < PREFETCH_CHUNK ? n - i : PREFETCH_CHUNK;
+        long ahead_end = i + distance + count < n ? i + distance + count : n;
+        for (long t = i + distance; t < ahead_end; t += step)
+            __builtin_prefetch(a + t * stride);
+        sum += ctx->reduce(a + i * stride, count, stride);
+    }
+    return sum;
+}
+
+// Visit exactly n elements but with a varying stride (summed by the
+// selected reduction kernel; "scalar" is the original single-chain loop).
+static void stride_sum(void *p)
+{
+    stride_ctx_t *ctx = (stride_ctx_t *)p;
+    if (ctx->distance > 0)
+        ctx->sum = stride_sum_prefetch(ctx);
+    else
+        ctx->sum = ctx->reduce(ctx->a, ctx->n, ctx->stride); // Stored so the loop cannot be optimized away.
+}
+
+// Stride x prefetch distance: every stride is run without prefetch (distance
+// 0) and then at each requested distance, so the rows show how much of the
+// large-stride bandwidth loss software prefetch recovers.
+static void run_prefetch_sweep(const double *a, long n, long min_stride, long max_stride,
+                               const reduce_kernel_t *kernel, const int *distances, int count,
+                               int warmup, int reps)
+{
+    printf("stride, prefetch distance, sum, time (msec), rate (MB/s), min (msec), mean (msec), "
+           "stddev (msec), p95 (msec)");
+    perf_print_header(stdout);
+    printf("\n");
+
+    for (long i_stride = min_stride; i_stride <= max_stride; i_stride++)
+    {
+        for (int d = -1; d < count; d++)
+        {
+            long distance = d < 0 ? 0 : distances[d];
+            stride_ctx_t ctx = {a, n, i_stride, kernel->fn, distance, 0.0};
+            timing_stats_t st = timing_run(stride_sum, NULL, &ctx, warmup, reps);
+            double rate = sizeof(double) * n * (1000.0 / st.median) / (1024 * 1024);
+            printf("%ld, %ld, %f, %f, %f, %f, %f, %f, %f", i_stride, distance, ctx.sum, st.median,
+                   rate, st.min, st.mean, st.stddev, st.p95);
+            perf_print_values(stdout, &st.perf);
+            printf("\n");
+        }
+    }
+}
+
+// Cache sizes go in a comment line so the plot script can mark them.
+static void print_cache_comment(void)
+{
+    const cache_info_t *ci = cache_info_get();
+    printf("# caches: L1d %ld KiB, L2 %ld KiB, L3 %ld KiB, line %d B%s\n", ci->l1d / 1024,
+           ci->l2 / 1024, ci->l3 / 1024, ci->line, ci->detected ? "" : " (defaults)");
+}
+
+// Working sets from min_ws to max_ws, two points per octave (ws and 1.5 ws).
+// Returns the count (at most MAX_WORKING_SETS).
+static int working_set_sizes(long long min_ws, long long max_ws, long long *sizes)
+{
+    int count = 0;
+    for (long long octave = min_ws; octave <= max_ws && count < MAX_WORKING_SETS; octave *= 2)
+    {
+        sizes[count++] = octave;
+        if (octave + octave / 2 <= max_ws && count < MAX_WORKING_SETS)
+            sizes[count++] = octave + octave / 2;
+    }
+    return count;
+}
+
+typedef struct
+{
+    const double *a;
+    size_t elems;   // Working set in elements.
+    long stride;
+    long passes;
+    reduce_fn reduce;
+    double sum;
+} sweep_ctx_t;
+
+// Same loop as stride_sum, confined to the first elems elements and repeated
+// so that cache-resident working sets still run long enough to time.
+static void sweep_sum(void *p)
+{
+    sweep_ctx_t *ctx = (sweep_ctx_t *)p;
+    size_t count = (ctx->elems + ctx->stride - 1) / ctx->stride;
+    double sum = 0.0;
+    for (long r = 0; r < ctx->passes; r++)
+        sum += ctx->reduce(ctx->a, count, ctx->stride);
+    ctx->sum = sum;
+}
+
+// Memory-hierarchy probe: working set (min_ws to max_ws, two points per
+// octave) x stride. Each cell makes at least `touches` loads and reports the
+// time per load, so the L1/L2/L3/DRAM plateaus show up as steps along the
+// working-set axis.
+static void run_sweep(long long min_ws, long long max_ws, const int *strides, int nstrides,
+                      const reduce_kernel_t *kernel, long touches, int warmup, int reps)
+{
+    size_t total = (size_t)max_ws / sizeof(double);
+    double *a = buffer_alloc(total * sizeof(double));
+    for (size_t i = 0; i < total; i++)
+        a[i] = 1.;
+
+    print_cache_comment();
+    printf("# reduction: %s\n", kernel->name);
+    printf("# backing: %s\n", buffer_backing_name());
+    printf("working set (KiB), stride, time (msec), ns/access, rate (MB/s), min (msec), "
+           "mean (msec), stddev (msec), p95 (msec)");
+    perf_print_header(stdout);
+    printf("\n");
+
+    long long sizes[MAX_WORKING_SETS];
+    int nsizes = working_set_sizes(min_ws, max_ws, sizes);
+    for (int w = 0; w < nsizes; w++)
+    {
+        size_t elems = (size_t)sizes[w] / sizeof(double);
+        for (int s = 0; s < nstrides; s++)
+        {
+            long stride = strides[s];
+            long per_pass = (long)((elems + stride - 1) / stride);
+            long passes = (touches + per_pass - 1) / per_pass;
+            sweep_ctx_t ctx = {a, elems, stride, passes, kernel->fn, 0.0};
+            timing_stats_t st = timing_run(sweep_sum, NULL, &ctx, warmup, reps);
+
+            double accesses = (double)passes * per_pass;
+            double ns = st.median * 1e6 / accesses;
+            double rate = sizeof(double) * accesses * (1000.0 / st.median) / (1024 * 1024);
+            printf("%lld, %ld, %f, %f, %f, %f, %f, %f, %f", sizes[w] / 1024, stride, st.median, ns,
+                   rate, st.min, st.mean, st.stddev, st.p95);
+            perf_print_values(stdout, &st.perf);
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    buffer_free(a);
+}
+
+typedef struct
+{
+    void **p;   // Current position in the cycle; carried over between runs.
+    long loads;
+} chase_ctx_t;
+
+// Every load depends on the previous one, so nothing can overlap: the time
+// per iteration is the load-to-use latency of wherever the cycle lives.
+static void chase(void *p)
+{
+    chase_ctx_t *ctx = (chase_ctx_t *)p;
+    void **q = ctx->p;
+    for (long r = 0; r < ctx->loads; r++)
+        q = (void **)*q;
+    ctx->p = q; // Stored so the loop cannot be optimized away.
+}
+
+// xorshift64*: rand() is too short-periodic (and too slow) for 10^8 swaps.
+static unsigned long long next_random(unsigned long long *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ULL;
+}
+
+// Link `nodes` nodes, `gran` bytes apart, into one random cycle (Sattolo's
+// algorithm, so every ordering is a single cycle covering all nodes). The
+// permutation is built in place in the first word of each node. With page
+// granularity the pointer moves one line further into each successive page,
+// so the nodes do not all fall into the same cache sets.
+static void **build_cycle(char *base, size_t nodes, size_t gran, int line)
+{
+    size_t lines_per_node = gran / line;
+    #define NODE(i) ((size_t *)(base + (i) * gran + ((i) % lines_per_node) * line))
+    for (size_t i = 0; i < nodes; i++)
+        *NODE(i) = i;
+
+    unsigned long long state = 0x9E3779B97F4A7C15ULL;
+    for (size_t i = nodes - 1; i > 0; i--)
+    {
+        size_t j = next_random(&state) % i; // j < i: Sattolo, not Fisher-Yates.
+        size_t t = *NODE(i);
+        *NODE(i) = *NODE(j);
+        *NODE(j) = t;
+    }
+
+    // Node i's successor is the node whose index it now holds.
+    for (size_t i = 0; i < nodes; i++)
+        *(void **)NODE(i) = NODE(*NODE(i));
+    void **start = (void **)NODE(0);
+    #undef NODE
+    return start;
+}
+
+// Latency probe: for each working set, chase a random cycle through it,
+// one node per cache line (or per page, which also exposes TLB reach), and
+// report ns per load.
+static void run_chase(long long min_ws, long long max_ws, size_t gran, long loads,
+                      int warmup, int reps)
+{
+    const cache_info_t *ci = cache_info_get();
+    char *base = buffer_alloc((size_t)max_ws);
+
+    print_cache_comment();
+    printf("# backing: %s\n", buffer_backing_name());
+    printf("working set (KiB), granularity (B), time (msec), ns/load, min (msec), mean (msec), "
+           "stddev (msec), p95 (msec)");
+    perf_print_header(stdout);
+    printf("\n");
+
+    long long sizes[MAX_WORKING_SETS];
+    int nsizes = working_set_sizes(min_ws, max_ws, sizes);
+    for (int w = 0; w < nsizes; w++)
+    {
+        size_t nodes = (size_t)sizes[w] / gran;
+        if (nodes < 2)
+            continue;
+        chase_ctx_t ctx = {build_cycle(base, nodes, gran, ci->line), loads};
+        timing_stats_t st = timing_run(chase, NULL, &ctx, warmup, reps);
+
+        printf("%lld, %zu, %f, %f, %f, %f, %f, %f", sizes[w] / 1024, gran, st.median,
+               st.median * 1e6 / loads, st.min, st.mean, st.stddev, st.p95);
+        perf_print_values(stdout, &st.perf);
+        printf("\n");
+        fflush(stdout);
+    }
+    buffer_free(base);
+}
+
+// STREAM kernels (McCalpin): copy c = a, scale b = q c, add c = a + b,
+// triad a = b + q c, each over one thread's slice of the arrays.
+enum { STREAM_COPY, STREAM_SCALE, STREAM_ADD, STREAM_TRIAD, STREAM_KERNELS };
+static const char *stream_names[STREAM_KERNELS] = {"copy", "scale", "add", "triad"};
+static const int stream_arrays[STREAM_KERNELS] = {2, 2, 3, 3}; // Arrays moved per element.
+
+typedef struct
+{
+    double *a, *b, *c;
+    long n;
+    int nthreads;
+    int kernel;
+    int nontemporal;
+    thread_pool_t *pool;
+} stream_ctx_t;
+
+// Slice of task out of nthreads, in whole cache lines so that every slice
+// starts 64-byte aligned for the streaming stores.
+static void stream_slice(const stream_ctx_t *ctx, int task, long *lo, long *hi)
+{
+    long lines = (ctx->n + 7) / 8;
+    *lo = lines * task / ctx->nthreads * 8;
+    *hi = lines * (task + 1) / ctx->nthreads * 8;
+    if (*hi > ctx->n)
+        *hi = ctx->n;
+}
+
+// Regular stores: the compiler vectorizes these; the destination lines are
+// read into cache first (write-allocate), which STREAM does not count.
+static void stream_cached(const stream_ctx_t *ctx, long lo, long hi)
+{
+    double *restrict a = ctx->a, *restrict b = ctx->b, *restrict c = ctx->c;
+    const double q = STREAM_SCALAR;
+    switch (ctx->kernel)
+    {
+    case STREAM_COPY:  for (long i = lo; i < hi; i++) c[i] = a[i]; break;
+    case STREAM_SCALE: for (long i = lo; i < hi; i++) b[i] = q * c[i]; break;
+    case STREAM_ADD:   for (long i = lo; i < hi; i++) c[i] = a[i] + b[i]; break;
+    case STREAM_TRIAD: for (long i = lo; i < hi; i++) a[i] = b[i] + q * c[i]; break;
+    }
+}
+
+// Non-temporal stores (SSE2, so no target attribute is needed): full lines
+// go straight to memory without the write-allocate read.
+static void stream_nontemporal(const stream_ctx_t *ctx, long lo, long hi)
+{
+    double *a = ctx->a, *b = ctx->b, *c = ctx->c;
+    const __m128d q = _mm_set1_pd(STREAM_SCALAR);
+    long i = lo;
+    switch (ctx->kernel)
+    {
+    case STREAM_COPY:
+        for (; i + 2 <= hi; i += 2)
+            _mm_stream_pd(c + i, _mm_load_pd(a + i));
+        break;
+    case STREAM_SCALE:
+        for (; i + 2 <= hi; i += 2)
+            _mm_stream_pd(b + i, _mm_mul_pd(q, _mm_load_pd(c + i)));
+        break;
+    case STREAM_ADD:
+        for (; i + 2 <= hi; i += 2)
+            _mm_stream_pd(c + i, _mm_add_pd(_mm_load_pd(a + i), _mm_load_pd(b + i)));
+        break;
+    case STREAM_TRIAD:
+        for (; i + 2 <= hi; i += 2)
+            _mm_stream_pd(a + i, _mm_add_pd(_mm_load_pd(b + i), _mm_mul_pd(q, _mm_load_pd(c + i))));
+        break;
+    }
+    _mm_sfence(); // Streaming stores are weakly ordered.
+    stream_cached(ctx, i, hi); // Odd last element.
+}
+
+static void stream_task(void *p, int task, int worker)
+{
+    (void)worker;
+    const stream_ctx_t *ctx = (const stream_ctx_t *)p;
+    long lo, hi;
+    stream_slice(ctx, task, &lo, &hi);
+    if (ctx->nontemporal)
+        stream_nontemporal(ctx, lo, hi);
+    else
+        stream_cached(ctx, lo, hi);
+}
+
+// First touch by the thread that will stream the slice, so its pages are
+// placed on that thread's NUMA node.
+static void stream_init_task(void *p, int task, int worker)
+{
+    (void)worker;
+    const stream_ctx_t *ctx = (const stream_ctx_t *)p;
+    long lo, hi;
+    stream_slice(ctx, task, &lo, &hi);
+    for (long i = lo; i < hi; i++)
+    {
+        ctx->a[i] = 1.0;
+        ctx->b[i] = 2.0;
+        ctx->c[i] = 0.0;
+    }
+}
+
+static void stream_run(void *p)
+{
+    stream_ctx_t *ctx = (stream_ctx_t *)p;
+    // Static mapping: slice t always runs on the worker that first-touched it.
+    thread_pool_run_static(ctx->pool, ctx->nthreads, stream_task, ctx);
+}
+
+// Aggregate bandwidth for 1..max_threads threads. The arrays are reallocated
+// and first-touched for every thread count so placement matches the workers.
+// Bytes count STREAM-style: arrays read plus arrays written, per element.
+static void run_stream(long n, int max_threads, int nontemporal, int pin, int warmup, int reps)
+{
+    printf("# stream: %ld elements per array (%.1f MiB each), %s stores, threads %s\n", n,
+           n * sizeof(double) / (1024.0 * 1024.0), nontemporal ? "non-temporal" : "regular",
+           pin ? "pinned" : "not pinned");
+    printf("# backing: %s\n", buffer_backing_name());
+    printf("threads, kernel, time (msec), bandwidth (GB/s), best (GB/s), min (msec), mean (msec), "
+           "stddev (msec), p95 (msec)");
+    perf_print_header(stdout);
+    printf("\n");
+
+    for (int t = 1; t <= max_threads; t++)
+    {
+        stream_ctx_t ctx = {buffer_alloc(n * sizeof(double)), buffer_alloc(n * sizeof(double)),
+                            buffer_alloc(n * sizeof(double)), n, t, 0,
+                            nontemporal, thread_pool_create(t)};
+        if (pin && thread_pool_pin(ctx.pool) != 0)
+            fprintf(stderr, "Warning: could not pin every thread\n");
+        thread_pool_run_static(ctx.pool, t, stream_init_task, &ctx);
+
+        for (int k = 0; k < STREAM_KERNELS; k++)
+        {
+            ctx.kernel = k;
+            timing_stats_t st = timing_run(stream_run, NULL, &ctx, warmup, reps);
+            double gb = (double)stream_arrays[k] * n * sizeof(double) / 1e9;
+            printf("%d, %s, %f, %f, %f, %f, %f, %f, %f", t, stream_names[k], st.median,
+                   gb / (st.median / 1000.0), gb / (st.min / 1000.0), st.min, st.mean,
+                   st.stddev, st.p95);
+            perf_print_values(stdout, &st.perf);
+            printf("\n");
+            fflush(stdout);
+        }
+
+        // Each kernel is idempotent given its inputs, so however many runs:
+        // copy c = 1, scale b = q, add c = 1 + q, triad a = q + q (1 + q).
+        double ea = STREAM_SCALAR + STREAM_SCALAR * (1.0 + STREAM_SCALAR);
+        double eb = STREAM_SCALAR, ec = 1.0 + STREAM_SCALAR;
+        for (long i = 0; i < n; i += n / 16 + 1)
+        {
+            if (ctx.a[i] != ea || ctx.b[i] != eb || ctx.c[i] != ec)
+            {
+                fprintf(stderr, "STREAM validation failed at element %ld\n", i);
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        thread_pool_destroy(ctx.pool);
+        buffer_free(ctx.a);
+        buffer_free(ctx.b);
+        buffer_free(ctx.c);
+    }
+}
+
+int main(int argc, char **argv)
 {
     // Simple stride experiment: keep the number of touches constant (N) while
     // increasing the distance between successive accesses to highlight cache effects.
-    int N = 1000000;
-    double *a;
-    a = malloc(N * MAX_STRIDE * sizeof(double));
-    double sum, rate, msec, start, end;
+    // --length sets N; --min-stride/--max-stride set the stride range.
+    long N = DEFAULT_N;
+    long min_stride = 1, max_stride = DEFAULT_MAX_STRIDE;
+    int warmup = TIMING_DEFAULT_WARMUP, reps = TIMING_DEFAULT_REPS;
+    // --sweep switches to the working-set x stride probe (see run_sweep),
+    // --chase to the dependent-load latency probe (see run_chase).
+    // --stream runs the multi-threaded bandwidth test (see run_stream).
+    int sweep = 0, chase_mode = 0, page_granularity = 0;
+    int stream = 0, nontemporal = 0, pin = 0, max_threads = 0;
+    int length_set = 0;
+    // --prefetch adds software-prefetch runs at each distance to the stride mode.
+    int prefetch[MAX_STRIDES], prefetch_count = 0;
+    const reduce_kernel_t *kernel = reduce_kernel_find("scalar");
+    long long min_ws = DEFAULT_MIN_WS, max_ws = 0;
+    int strides[MAX_STRIDES];
+    int nstrides = parse_int_list(DEFAULT_SWEEP_STRIDES, strides, MAX_STRIDES);
+    for (int i = 1; i < argc; i++)
+    {
+        if (timing_parse_arg(argc, argv, &i, &warmup, &reps) || buffer_parse_arg(argc, argv, &i))
+            continue;
+        else if (strcmp(argv[i], "--sweep") == 0)
+            sweep = 1;
+        else if (strcmp(argv[i], "--reduce") == 0 && i + 1 < argc)
+        {
+            if (!(kernel = reduce_kernel_find(argv[++i])))
+            {
+                fprintf(stderr, "Unknown or unsupported reduction kernel: %s\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc)
+        {
+            if ((prefetch_count = parse_int_list(argv[++i], prefetch, MAX_STRIDES)) <= 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[i], "--chase") == 0)
+            chase_mode = 1;
+        else if (strcmp(argv[i], "--granularity") == 0 && i + 1 < argc)
+        {
+            i++;
+            if (strcmp(argv[i], "page") == 0)
+                page_granularity = 1;
+            else if (strcmp(argv[i], "line") == 0)
+                page_granularity = 0;
+            else
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[i], "--min-ws") == 0 && i + 1 < argc)
+        {
+            if ((min_ws = parse_size(argv[++i])) < (long long)sizeof(double))
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[i], "--max-ws") == 0 && i + 1 < argc)
+        {
+            if ((max_ws = parse_size(argv[++i])) == 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[i], "--strides") == 0 && i + 1 < argc)
+        {
+            if ((nstrides = parse_int_list(argv[++i], strides, MAX_STRIDES)) <= 0)
+                usage(argv[0]);
+        }
+        else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc)
+        {
+            N = atol(argv[++i]);
+            length_set = 1;
+        }
+        else if (strcmp(argv[i], "--stream") == 0)
+            stream = 1;
+        else if (strcmp(argv[i], "--nt") == 0)
+            nontemporal = 1;
+        else if (strcmp(argv[i], "--pin") == 0)
+            pin = 1;
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc)
+            max_threads = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--min-stride") == 0 && i + 1 < argc)
+            min_stride = atol(argv[++i]);
+        else if (strcmp(argv[i], "--max-stride") == 0 && i + 1 < argc)
+            max_stride = atol(argv[++i]);
+        else
+            usage(argv[0]);
+    }
+    if (N <= 0 || min_stride <= 0 || max_stride < min_stride)
+        usage(argv[0]);
+
+    if (sweep + chase_mode + stream > 1)
+        usage(argv[0]);
+    if (stream)
+    {
+        // Default size follows the STREAM rule: each array at least 4x the L3.
+        if (!length_set)
+        {
+            long l3_elems = 4 * cache_info_get()->l3 / (long)sizeof(double);
+            N = l3_elems > STREAM_MIN_ELEMS ? l3_elems : STREAM_MIN_ELEMS;
+        }
+        if (max_threads <= 0)
+            max_threads = topology_get()->ncpus;
+        run_stream(N, max_threads, nontemporal, pin, warmup, reps);
+        return 0;
+    }
+    if (sweep || chase_mode)
+    {
+        if (max_ws == 0)
+        {
+            long long half_ram = (long long)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+            max_ws = half_ram > 0 && half_ram < SWEEP_MAX_DEFAULT ? half_ram : SWEEP_MAX_DEFAULT;
+        }
+        if (max_ws < min_ws)
+            usage(argv[0]);
+        if (sweep)
+            run_sweep(min_ws, max_ws, strides, nstrides, kernel, N, warmup, reps);
+        else
+        {
+            size_t gran = page_granularity ? (size_t)sysconf(_SC_PAGESIZE)
+                                           : (size_t)cache_info_get()->line;
+            run_chase(min_ws, max_ws, gran, N, warmup, reps);
+        }
+        return 0;
+    }
+
+    // The largest stride walks N * max_stride elements.
+    size_t total = (size_t)N * max_stride;
+    double *a = buffer_alloc(total * sizeof(double));
+    double rate;
 
     // Initialize the whole buffer so pages are mapped and values are defined.
-    for (int i = 0; i < N * MAX_STRIDE; i++)
+    for (size_t i = 0; i < total; i++)
         a[i] = 1.;
 
-    printf("stride , sum, time (msec), rate (MB/s)\n");
-
-    for (int i_stride = 1; i_stride <= MAX_STRIDE; i_stride++)
+    // Time column = median over the repetitions (wall clock); spread columns follow.
+    printf("# reduction: %s\n", kernel->name);
+    printf("# backing: %s\n", buffer_backing_name());
+    if (prefetch_count > 0)
     {
-        sum = 0.0;
-        start = (double)clock() / CLOCKS_PER_SEC;
-
-        // Visit exactly N elements but with a varying stride.
-        for (int i = 0; i < N * i_stride; i += i_stride)
-            sum += a[i];
+        run_prefetch_sweep(a, N, min_stride, max_stride, kernel, prefetch, prefetch_count,
+                           warmup, reps);
+        buffer_free(a);
+        return 0;
+    }
+    printf("stride , sum, time (msec), rate (MB/s), min (msec), mean (msec), stddev (msec), p95 (msec)");
+    perf_print_header(stdout); // Per-run hardware counters with --perf.
+    printf("\n");
 
-        end = (double)clock() / CLOCKS_PER_SEC;
-        msec = (end - start) * 1000.0; // Elapsed time in milliseconds.
-        rate = sizeof(double) * N * (1000.0 / msec) / (1024 * 1024);
+    for (long i_stride = min_stride; i_stride <= max_stride; i_stride++)
+    {
+        stride_ctx_t ctx = {a, N, i_stride, kernel->fn, 0, 0.0};
+        timing_stats_t st = timing_run(stride_sum, NULL, &ctx, warmup, reps);
+        rate = sizeof(double) * N * (1000.0 / st.median) / (1024 * 1024);
 
-        printf("%d, %f, %f, %f\n", i_stride, sum, msec, rate);
+        printf("%ld, %f, %f, %f, %f, %f, %f, %f", i_stride, ctx.sum, st.median, rate,
+               st.min, st.mean, st.stddev, st.p95);
+        perf_print_values(stdout, &st.perf);
+        printf("\n");
     }
-    free(a);
+    buffer_free(a);
 }
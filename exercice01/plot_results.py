@@ -4,10 +4,12 @@ import argparse
 import csv
 import math
 from pathlib import Path
+import re
 from typing import Iterable, NamedTuple
 
 import matplotlib.pyplot as plt
 import numpy as np
+from matplotlib.colors import LogNorm
 
 
 class StrideRow(NamedTuple):
@@ -17,6 +19,17 @@ class StrideRow(NamedTuple):
     bandwidth_mb_s: float
 
 
+class SurfaceRow(NamedTuple):
+    working_set_kib: int
+    stride: int
+    ns_per_access: float
+    bandwidth_mb_s: float
+
+
+# Knee = latency at least this much higher than at the previous working set.
+KNEE_RATIO = 1.3
+
+
 def _read_text_lines(path: Path, encoding: str | None = None) -> list[str]:
     if encoding:
         return path.read_text(encoding=encoding).splitlines()
@@ -61,6 +74,112 @@ def read_stride_results(path: Path, encoding: str | None = None) -> list[StrideR
     return rows
 
 
+def read_surface_results(
+    path: Path, encoding: str | None = None
+) -> tuple[list[SurfaceRow], dict[str, int]]:
+    """Parse `exercice1 --sweep` output and the cache sizes (bytes) from its comment line."""
+    lines = _read_text_lines(path, encoding=encoding)
+
+    # Expected: "# caches: L1d 48 KiB, L2 2048 KiB, L3 107520 KiB, line 64 B"
+    caches: dict[str, int] = {}
+    data_lines: list[str] = []
+    for line in lines:
+        if line.startswith("#"):
+            for name, kib in re.findall(r"(L1d|L2|L3) (\d+) KiB", line):
+                caches[name] = int(kib) * 1024
+        else:
+            data_lines.append(line)
+
+    # Expected header: "working set (KiB), stride, time (msec), ns/access, rate (MB/s), ..."
+    rows: list[SurfaceRow] = []
+    for parts in csv.reader(data_lines):
+        parts = [p.strip() for p in parts if p is not None]
+        if len(parts) < 5:
+            continue
+        try:
+            rows.append(SurfaceRow(int(parts[0]), int(parts[1]), float(parts[3]), float(parts[4])))
+        except ValueError:
+            continue
+    return rows, caches
+
+
+def detect_knees(rows: Iterable[SurfaceRow]) -> list[SurfaceRow]:
+    """Points where ns/access jumps by KNEE_RATIO over the next smaller working set."""
+    by_stride: dict[int, list[SurfaceRow]] = {}
+    for r in rows:
+        by_stride.setdefault(r.stride, []).append(r)
+
+    knees: list[SurfaceRow] = []
+    for series in by_stride.values():
+        series.sort(key=lambda r: r.working_set_kib)
+        for prev, cur in zip(series, series[1:]):
+            if prev.ns_per_access > 0 and cur.ns_per_access / prev.ns_per_access >= KNEE_RATIO:
+                knees.append(cur)
+    return knees
+
+
+def _format_size(kib: float) -> str:
+    for unit, scale in (("G", 1024 * 1024), ("M", 1024)):
+        if kib >= scale:
+            return f"{kib / scale:g}{unit}"
+    return f"{kib:g}K"
+
+
+def plot_surface(rows: list[SurfaceRow], caches: dict[str, int], out_path: Path) -> None:
+    sizes = sorted({r.working_set_kib for r in rows})
+    strides = sorted({r.stride for r in rows})
+    grid = np.full((len(sizes), len(strides)), np.nan)
+    for r in rows:
+        grid[sizes.index(r.working_set_kib), strides.index(r.stride)] = r.ns_per_access
+
+    fig, ax = plt.subplots(figsize=(9, 8))
+    mesh = ax.pcolormesh(
+        np.arange(len(strides) + 1) - 0.5,
+        np.arange(len(sizes) + 1) - 0.5,
+        np.ma.masked_invalid(grid),
+        norm=LogNorm(),
+        cmap="viridis",
+        shading="flat",
+    )
+    fig.colorbar(mesh, ax=ax, label="Time per access (ns)")
+
+    ax.set_xticks(range(len(strides)))
+    ax.set_xticklabels([str(s) for s in strides])
+    ax.set_yticks(range(len(sizes)))
+    ax.set_yticklabels([_format_size(s) for s in sizes], fontsize=7)
+    ax.set_xlabel("Stride (elements)")
+    ax.set_ylabel("Working set")
+    ax.set_title("Memory hierarchy: time per access vs working set and stride")
+
+    # Cache capacities, placed on the (log-spaced) working-set index axis.
+    log_sizes = np.log2(np.array(sizes, dtype=float) * 1024)
+    for name, size in sorted(caches.items(), key=lambda kv: kv[1]):
+        y = float(np.interp(np.log2(size), log_sizes, np.arange(len(sizes))))
+        if log_sizes[0] <= np.log2(size) <= log_sizes[-1]:
+            ax.axhline(y, color="white", linestyle="--", linewidth=1.2)
+            ax.text(len(strides) - 0.55, y, f" {name} {_format_size(size / 1024)}",
+                    color="white", ha="right", va="bottom", fontsize=8)
+
+    knees = detect_knees(rows)
+    if knees:
+        ax.scatter(
+            [strides.index(k.stride) for k in knees],
+            [sizes.index(k.working_set_kib) for k in knees],
+            marker="x",
+            color="red",
+            label=f"knee (latency x{KNEE_RATIO:g})",
+        )
+        ax.legend(loc="upper left")
+
+    fig.tight_layout()
+    fig.savefig(out_path, dpi=300, bbox_inches="tight")
+    print(f"Plot saved to: {out_path}")
+
+    print("\n=== Knees (working set where time per access jumps) ===")
+    for k in sorted(knees, key=lambda k: (k.stride, k.working_set_kib)):
+        print(f"stride {k.stride:>4}: {_format_size(k.working_set_kib):>6}  {k.ns_per_access:.2f} ns/access")
+
+
 def _as_arrays(rows: Iterable[StrideRow]):
     strides = np.array([r.stride for r in rows], dtype=int)
     times = np.array([r.time_ms for r in rows], dtype=float)
@@ -70,14 +189,21 @@ def _as_arrays(rows: Iterable[StrideRow]):
 
 def main() -> int:
     parser = argparse.ArgumentParser(
-        description="Plot stride experiment results (time and bandwidth vs stride)."
+        description="Plot stride experiment results (time and bandwidth vs stride), "
+        "or a working-set x stride heatmap with --surface."
     )
     parser.add_argument("--o0", default="results_O0.txt", help="Input results file for -O0.")
     parser.add_argument("--o2", default="results_O2.txt", help="Input results file for -O2.")
+    parser.add_argument(
+        "--surface",
+        default=None,
+        help="Results of `exercice1 --sweep`; plots the heatmap instead of the -O0/-O2 curves.",
+    )
     parser.add_argument(
         "--output",
-        default="stride_analysis.png",
-        help="Output image path (PNG).",
+        default=None,
+        help="Output image path (PNG). Default: stride_analysis.png, "
+        "or memory_hierarchy.png with --surface.",
     )
     parser.add_argument(
         "--encoding",
@@ -91,6 +217,16 @@ def main() -> int:
     )
     args = parser.parse_args()
 
+    if args.surface:
+        surface_path = Path(args.surface)
+        rows, caches = read_surface_results(surface_path, encoding=args.encoding)
+        if not rows:
+            raise SystemExit(f"No usable rows parsed from: {surface_path}")
+        plot_surface(rows, caches, Path(args.output or "memory_hierarchy.png"))
+        if not args.no_show:
+            plt.show()
+        return 0
+
     o0_path = Path(args.o0)
     o2_path = Path(args.o2)
 
@@ -154,7 +290,7 @@ def main() -> int:
     ax_bw.legend()
     ax_bw.grid(True, alpha=0.3)
 
-    out_path = Path(args.output)
+    out_path = Path(args.output or "stride_analysis.png")
     fig.tight_layout()
     fig.savefig(out_path, dpi=300, bbox_inches="tight")
     print(f"Plot saved to: {out_path}")
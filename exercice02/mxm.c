@@ -1,137 +1,467 @@
-#include "stdio.h"
-#include "stdlib.h"
-#include "time.h"
-
-#define R1 512 // number of rows in Matrix-1
-#define C1 512 // number of columns in Matrix-1
-#define R2 512 // number of rows in Matrix-2
-#define C2 512 // number of columns in Matrix-2
-
-
-
-int main() {
-    // Compare two loop orderings for dense matrix multiplication (512x512)
+#include "math.h"
+#include "stdarg.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "../common/buffer.h"
+#include "../common/gemm.h"
+#include "../common/matrix.h"
+#include "../common/precision.h"
+#include "../common/timing.h"
+#include "../common/transpose.h"
+#include "../common/verify.h"
+
+#define DEFAULT_SIZE 512 // Square dimension used when no --shape is given.
+#define MAX_PRECISIONS 8 // Maximum number of entries in --precision.
+#define MAX_RESULTS 8    // Versions checked by verify_results().
+#define MAX_SWEEP 64     // Maximum number of entries in --sizes.
+
+// C += A * B with the classic i-j-k order: B is walked down its columns.
+static void multiply_ijk(const matrix_t *A, const matrix_t *B, matrix_t *C) {
+    int lda = A->ld, ldb = B->ld, ldc = C->ld;
+    const double *restrict a = A->data;
+    const double *restrict b = B->data;
+    double *restrict c = C->data;
+
+    for (int i = 0; i < C->rows; i++) {
+        for (int j = 0; j < C->cols; j++) {
+            for (int k = 0; k < A->cols; k++) {
+                c[(size_t)i * ldc + j] += a[(size_t)i * lda + k] * b[(size_t)k * ldb + j];
+            }
+        }
+    }
+}
+
+// C += A * B with the i-k-j order: the inner loop streams rows of B and C.
+static void multiply_ikj(const matrix_t *A, const matrix_t *B, matrix_t *C) {
+    int lda = A->ld, ldb = B->ld, ldc = C->ld;
+    const double *restrict a = A->data;
+    const double *restrict b = B->data;
+    double *restrict c = C->data;
+
+    for (int i = 0; i < C->rows; i++) {
+        double *c_row = c + (size_t)i * ldc;
+        for (int k = 0; k < A->cols; k++) {
+            double a_ik = a[(size_t)i * lda + k];
+            const double *b_row = b + (size_t)k * ldb;
+            for (int j = 0; j < C->cols; j++) {
+                c_row[j] += a_ik * b_row[j];
+            }
+        }
+    }
+}
+
+static matrix_t b_transposed;  // N x K copy of B for multiply_ijk_bt, allocated once in main.
+
+// C += A * B in the i-j-k order on a transposed copy of B: B is first
+// transposed (cache-blocked, counted in the time), then every C[i][j] is a
+// dot product of two contiguous rows, kept in four partial sums so the adds
+// do not wait on each other.
+static void multiply_ijk_bt(const matrix_t *A, const matrix_t *B, matrix_t *C) {
+    matrix_transpose(B, &b_transposed);
+    int K = A->cols;
+    for (int i = 0; i < C->rows; i++) {
+        const double *restrict a_row = &MAT(A, i, 0);
+        double *restrict c_row = &MAT(C, i, 0);
+        for (int j = 0; j < C->cols; j++) {
+            const double *restrict bt_row = &MAT(&b_transposed, j, 0);
+            double s0 = 0.0, s1 = 0.0, s2 = 0.0, s3 = 0.0;
+            int k = 0;
+            for (; k + 4 <= K; k += 4) {
+                s0 += a_row[k] * bt_row[k];
+                s1 += a_row[k + 1] * bt_row[k + 1];
+                s2 += a_row[k + 2] * bt_row[k + 2];
+                s3 += a_row[k + 3] * bt_row[k + 3];
+            }
+            for (; k < K; k++) {
+                s0 += a_row[k] * bt_row[k];
+            }
+            c_row[j] += (s0 + s1) + (s2 + s3);
+        }
+    }
+}
+
+// C += A * B with the shared blocked GEMM (packed tiles, auto blocking).
+static void multiply_tiled(const matrix_t *A, const matrix_t *B, matrix_t *C) {
+    matrix_multiply_blocked(A, B, C, NULL);
+}
+
+static int warmup = TIMING_DEFAULT_WARMUP;  // Untimed runs before measuring (--warmup).
+static int reps = TIMING_DEFAULT_REPS;      // Timed repetitions per version (--reps).
+static int verify_mode = VERIFY_FREIVALDS;  // Checks of every result (--verify).
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--shape N|MxKxN] [--sizes N1,N2,...] [--pad] "
+                    "[--precision double,float,bf16] [--warmup N] [--reps N] [--perf]\n"
+                    "       [--alloc malloc|memalign|thp|huge2m|huge1g] [--populate] [--output FILE]"
+                    " [--verify none|freivalds|reference|both]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+// Write the same text to stdout and to the results file.
+static void print_both(FILE *fp, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    va_start(args, fmt);
+    vfprintf(fp, fmt, args);
+    va_end(args);
+}
+
+typedef void (*multiply_fn)(const matrix_t *, const matrix_t *, matrix_t *);
+
+typedef struct {
+    multiply_fn multiply;
+    const matrix_t *A;
+    const matrix_t *B;
+    matrix_t *C;
+} order_ctx_t;
+
+static void order_body(void *p) {
+    order_ctx_t *ctx = (order_ctx_t *)p;
+    ctx->multiply(ctx->A, ctx->B, ctx->C);
+}
+
+// Each repetition accumulates into C, so clear it (untimed) first.
+static void order_reset(void *p) {
+    matrix_fill(((order_ctx_t *)p)->C, 0.0);
+}
+
+// Time one loop order over warmup + reps runs (wall clock, milliseconds).
+static timing_stats_t time_order(multiply_fn multiply, const matrix_t *A, const matrix_t *B,
+                                 matrix_t *C) {
+    order_ctx_t ctx = {multiply, A, B, C};
+    return timing_run(order_body, order_reset, &ctx, warmup, reps);
+}
+
+// With --perf, write "label, cycles, ..." as its own line (nothing otherwise).
+static void print_counters(FILE *fp, const char *label, const timing_stats_t *st) {
+    if (!perf_counters_enabled()) {
+        return;
+    }
+    print_both(fp, "%s", label);
+    perf_print_values(stdout, &st->perf);
+    perf_print_values(fp, &st->perf);
+    print_both(fp, "\n");
+}
+
+// Reference product for --verify reference|both (an empty matrix otherwise).
+static matrix_t reference_product(const matrix_t *A, const matrix_t *B) {
+    matrix_t R = {NULL, 0, 0, 0};
+    if (verify_mode & VERIFY_REFERENCE) {
+        R = matrix_create(A->rows, B->cols, 0);
+        matrix_fill(&R, 0.0);
+        matrix_multiply_standard(A, B, &R);
+    }
+    return R;
+}
+
+// Run the --verify checks on C (f and ref stay unchecked for the others);
+// returns 1 if one of them failed.
+static int verify_one(const matrix_t *A, const matrix_t *B, const matrix_t *C, const matrix_t *R,
+                      unsigned long seed, verify_result_t *f, verify_result_t *ref) {
+    f->checked = ref->checked = 0;
+    if (verify_mode & VERIFY_FREIVALDS) {
+        verify_freivalds(A, B, C, VERIFY_DEFAULT_ROUNDS, seed, 1.0, f);
+    }
+    if (verify_mode & VERIFY_REFERENCE) {
+        verify_reference(A, B, C, R, 1.0, ref);
+    }
+    return (f->checked && !f->passed) || (ref->checked && !ref->passed);
+}
+
+// Print the checks of count results as a table; returns the number of failures.
+static int print_verify_table(FILE *fp, const char **names, const verify_result_t *f,
+                              const verify_result_t *ref, int count) {
+    print_both(fp, "\nVerification (%d Freivalds rounds)", VERIFY_DEFAULT_ROUNDS);
+    verify_print_header(stdout);
+    verify_print_header(fp);
+    print_both(fp, "\n");
+
+    int failed = 0;
+    for (int r = 0; r < count; r++) {
+        failed += (f[r].checked && !f[r].passed) || (ref[r].checked && !ref[r].passed);
+        print_both(fp, "%s", names[r]);
+        verify_print_values(stdout, &f[r], &ref[r]);
+        verify_print_values(fp, &f[r], &ref[r]);
+        print_both(fp, "\n");
+    }
+    if (failed) {
+        print_both(fp, "%d of %d versions FAILED verification\n", failed, count);
+    }
+    return failed;
+}
+
+// Check each result (the product of its version's last timed run) with the
+// --verify checks; prints a table and returns the number of failures.
+static int verify_results(FILE *fp, const matrix_t *A, const matrix_t *B,
+                          const matrix_t *const *results, const char **names, int count) {
+    if (verify_mode == 0) {
+        return 0;
+    }
+    matrix_t R = reference_product(A, B);
+    verify_result_t f[MAX_RESULTS], ref[MAX_RESULTS];
+    for (int r = 0; r < count; r++) {
+        verify_one(A, B, results[r], &R, (unsigned long)r + 1, &f[r], &ref[r]);
+    }
+    matrix_free(&R);
+    return print_verify_table(fp, names, f, ref, count);
+}
+
+typedef struct {
+    const matrix_t *src;
+    matrix_t *dst;
+    int impl;
+} transpose_ctx_t;
+
+static void transpose_body(void *p) {
+    transpose_ctx_t *ctx = (transpose_ctx_t *)p;
+    matrix_transpose_impl(ctx->src, ctx->dst, ctx->impl);
+}
+
+// Time each transpose version on its own: one read and one write of every
+// element, reported in GB/s. Each result is compared with the naive one.
+static void run_transpose(FILE *fp, const matrix_t *src, int padded) {
+    matrix_t ref = matrix_create(src->cols, src->rows, padded);
+    matrix_t dst = matrix_create(src->cols, src->rows, padded);
+    matrix_transpose_impl(src, &ref, TRANSPOSE_NAIVE);
+    double gbytes = 2.0 * src->rows * src->cols * sizeof(double) / 1e9;
+
+    print_both(fp, "\nTranspose (%d x %d, %dx%d tiles), Time (msec), GB/s, Min (msec), P95 (msec), "
+                   "Matches naive\n", src->rows, src->cols, TRANSPOSE_BLOCK, TRANSPOSE_BLOCK);
+    for (int impl = 0; impl < TRANSPOSE_IMPLS; impl++) {
+        if (!transpose_impl_supported(impl)) {
+            print_both(fp, "%s, -, -, -, -, unsupported on this CPU\n", transpose_impl_name(impl));
+            continue;
+        }
+        transpose_ctx_t ctx = {src, &dst, impl};
+        timing_stats_t st = timing_run(transpose_body, NULL, &ctx, warmup, reps);
+        print_both(fp, "%s, %.4f, %.2f, %.4f, %.4f, %s\n", transpose_impl_name(impl), st.median,
+                   gbytes / (st.median / 1000.0), st.min, st.p95,
+                   matrix_max_rel_error(&dst, &ref) == 0.0 ? "yes" : "NO");
+    }
+
+    matrix_free(&ref);
+    matrix_free(&dst);
+}
+
+// Square size sweep: the i-j-k order degrades each time a column walk of B
+// (N rows, one line each) stops fitting in a cache level. Each order's
+// result is checked after it is timed; returns the number of failures.
+static int run_size_sweep(FILE *fp, const int *sizes, int count, int padded) {
+    char labels[MAX_SWEEP * 2][32];
+    const char *names[MAX_SWEEP * 2];
+    verify_result_t f[MAX_SWEEP * 2], ref[MAX_SWEEP * 2];
+    print_both(fp, "Size, i-j-k (msec), i-k-j (msec), i-j-k (GFLOP/s), i-k-j (GFLOP/s), "
+                   "Working set (KiB), i-j-k P95 (msec), i-k-j P95 (msec)\n");
+    // With --perf, each size gets one counter row per loop order below its timing row.
+
+    for (int s = 0; s < count; s++) {
+        int n = sizes[s];
+        matrix_t m1 = matrix_create(n, n, padded);
+        matrix_t m2 = matrix_create(n, n, padded);
+        matrix_t result = matrix_create(n, n, padded);
+        matrix_fill_random(&m1);
+        matrix_fill_random(&m2);
+
+        double gflop = 2.0 * n * n * n / 1e9;
+        matrix_t R = reference_product(&m1, &m2);
+        timing_stats_t ijk = time_order(multiply_ijk, &m1, &m2, &result);
+        verify_one(&m1, &m2, &result, &R, 2 * s + 1, &f[2 * s], &ref[2 * s]);
+        timing_stats_t ikj = time_order(multiply_ikj, &m1, &m2, &result);
+        verify_one(&m1, &m2, &result, &R, 2 * s + 2, &f[2 * s + 1], &ref[2 * s + 1]);
+        // "Size" rather than "N=", which the plot scripts read as timing rows.
+        snprintf(labels[2 * s], sizeof(labels[0]), "Size %d i-j-k", n);
+        snprintf(labels[2 * s + 1], sizeof(labels[0]), "Size %d i-k-j", n);
+        names[2 * s] = labels[2 * s];
+        names[2 * s + 1] = labels[2 * s + 1];
+        double working_set_kib = 3.0 * n * n * sizeof(double) / 1024;
+
+        print_both(fp, "N=%d, %.4f, %.4f, %.2f, %.2f, %.0f, %.4f, %.4f\n", n, ijk.median, ikj.median,
+                   gflop / (ijk.median / 1000.0), gflop / (ikj.median / 1000.0), working_set_kib,
+                   ijk.p95, ikj.p95);
+        print_counters(fp, "  i-j-k counters", &ijk);
+        print_counters(fp, "  i-k-j counters", &ikj);
+
+        matrix_free(&m1);
+        matrix_free(&m2);
+        matrix_free(&result);
+        matrix_free(&R);
+    }
+    return verify_mode ? print_verify_table(fp, names, f, ref, 2 * count) : 0;
+}
+
+int main(int argc, char **argv) {
+    // Compare two loop orderings for dense matrix multiplication (default 512x512)
     // and measure how access patterns impact cache behavior.
 
-    // Use dynamic allocation to avoid large stack arrays.
-    double **m1 = (double **)malloc(R1 * sizeof(double *));
-    double **m2 = (double **)malloc(R2 * sizeof(double *));
-    double **result_ijk = (double **)malloc(R1 * sizeof(double *));
-    double **result_ikj = (double **)malloc(R1 * sizeof(double *));
-    
-    for (int i = 0; i < R1; i++) {
-        m1[i] = (double *)malloc(C1 * sizeof(double));
-        result_ijk[i] = (double *)malloc(C2 * sizeof(double));
-        result_ikj[i] = (double *)malloc(C2 * sizeof(double));
-    }
-    for (int i = 0; i < R2; i++) {
-        m2[i] = (double *)malloc(C2 * sizeof(double));
-    }
-
-    // Fill inputs with small pseudo-random values (not focusing on numerical accuracy here).
-    for (int i = 0; i < R1; i++) {
-        for (int j = 0; j < C1; j++) {
-            m1[i][j] = (double)(rand() % 10) + 1.0;
+    // --shape sets the problem: N for N x N, or MxKxN for (M x K) * (K x N).
+    // --sizes runs a square size sweep of both orders instead.
+    // --pad selects a padded row stride so 512-wide rows do not share cache sets.
+    // --precision also times both orders for each listed element type.
+    // --output names the results file (default mxm_results.txt).
+    int R1 = DEFAULT_SIZE, C1 = DEFAULT_SIZE, C2 = DEFAULT_SIZE;
+    int sweep[MAX_SWEEP], sweep_count = 0;
+    int padded = 0;
+    const gemm_precision_t *precision_list[MAX_PRECISIONS];
+    int precision_count = 0;
+    const char *output = "mxm_results.txt";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--shape") == 0 && i + 1 < argc) {
+            if (matrix_parse_shape(argv[++i], &R1, &C1, &C2) != 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sweep_count = parse_int_list(argv[++i], sweep, MAX_SWEEP);
+            if (sweep_count <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--pad") == 0) {
+            padded = 1;
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            precision_count = gemm_precision_parse_list(argv[++i], precision_list, MAX_PRECISIONS);
+            if (precision_count <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+            verify_mode = verify_parse_mode(argv[++i]);
+            if (verify_mode < 0) {
+                usage(argv[0]);
+            }
+        } else if (timing_parse_arg(argc, argv, &i, &warmup, &reps) ||
+                   buffer_parse_arg(argc, argv, &i)) {
+            continue;
+        } else {
+            usage(argv[0]);
         }
-    }
-    
-    for (int i = 0; i < R2; i++) {
-        for (int j = 0; j < C2; j++) {
-            m2[i][j] = (double)(rand() % 10) + 1.0;
-        }
-    }
-
-
-     if (C1 != R2) {
-        printf("The number of columns in Matrix-1 must be "
-               "equal to the number of rows in "
-               "Matrix-2\n");
-        exit(EXIT_FAILURE);
     }
-    
+    int R2 = C1; // The shape format guarantees columns of Matrix-1 == rows of Matrix-2.
+
     // Write results to a CSV-like text file for later plotting/reporting.
-    FILE *fp = fopen("mxm_results.txt", "w");
+    FILE *fp = fopen(output, "w");
     if (fp == NULL) {
         printf("Error opening file!\n");
         exit(EXIT_FAILURE);
     }
-    
-    fprintf(fp, "Matrix Multiplication Performance Analysis\n");
-    fprintf(fp, "Matrix size: %d x %d\n\n", R1, C2);
-    fprintf(fp, "Version, Time (msec), Bandwidth (MB/s)\n");
-    
-    printf("Matrix Multiplication Performance Analysis\n");
-    printf("Matrix size: %d x %d\n\n", R1, C2);
-    printf("Version, Time (msec), Bandwidth (MB/s)\n");
-
-    // Clear output matrices before timing.
-    for (int i = 0; i < R1; i++) {
-        for (int j = 0; j < C2; j++) {
-            result_ijk[i][j] = 0;
-            result_ikj[i][j] = 0;
-        }
-    }
-
-    double rate, msec, start, end;
+
+    if (sweep_count > 0) {
+        print_both(fp, "Matrix Multiplication Size Sweep\n");
+        print_both(fp, "Memory: %s\n", buffer_backing_name());
+        print_both(fp, "Timing: median of %d runs after %d warmup (wall clock)\n\n", reps, warmup);
+        int failed = run_size_sweep(fp, sweep, sweep_count, padded);
+        fclose(fp);
+        printf("\nResults saved to %s\n", output);
+        return failed ? EXIT_FAILURE : 0;
+    }
+
+    // One contiguous aligned buffer per matrix (no per-row allocations).
+    matrix_t m1 = matrix_create(R1, C1, padded);
+    matrix_t m2 = matrix_create(R2, C2, padded);
+    matrix_t result_ijk = matrix_create(R1, C2, padded);
+    matrix_t result_ikj = matrix_create(R1, C2, padded);
+    matrix_t result_bt = matrix_create(R1, C2, padded);
+    matrix_t result_tiled = matrix_create(R1, C2, padded);
+    b_transposed = matrix_create(C2, R2, padded);
+    const matrix_t *results[] = {&result_ijk, &result_ikj, &result_bt, &result_tiled};
+    const char *result_names[] = {"i-j-k", "i-k-j", "i-j-k on B^T", "Tiled"};
+
+    // Fill inputs with small pseudo-random values (not focusing on numerical accuracy here).
+    matrix_fill_random(&m1);
+    matrix_fill_random(&m2);
+
+    print_both(fp, "Matrix Multiplication Performance Analysis\n");
+    print_both(fp, "Matrix size: %d x %d\n", R1, C2);
+    print_both(fp, "Inner dimension: %d\n", C1);
+    print_both(fp, "Row stride: %d (%s)\n", result_ijk.ld, padded ? "padded" : "dense");
+    print_both(fp, "Memory: %s\n", buffer_backing_name());
+    print_both(fp, "Timing: median of %d runs after %d warmup (wall clock)\n\n", reps, warmup);
+    print_both(fp, "Version, Time (msec), Bandwidth (MB/s), Min (msec), Mean (msec), "
+                   "Stddev (msec), P95 (msec)");
+    perf_print_header(stdout);
+    perf_print_header(fp);
+    print_both(fp, "\n");
+
+    double rate;
+    timing_stats_t st;
     long long total_ops = 4LL * R1 * R2 * C2; // 4 memory ops per iteration (3 reads + 1 write)
     long long total_bytes = total_ops * sizeof(double);
 
     // ===== Version 1: i-j-k loop order =====
     // B is accessed column-wise (poor spatial locality in row-major storage).
-    start = (double)clock() / CLOCKS_PER_SEC;
-
-    for (int i = 0; i < R1; i++) {
-        for (int j = 0; j < C2; j++) {
-            for (int k = 0; k < R2; k++) {
-                result_ijk[i][j] += m1[i][k] * m2[k][j];
-            }
-        }
-    }
-
-    end = (double)clock() / CLOCKS_PER_SEC;
-    msec = (end - start) * 1000.0;
-    rate = total_bytes * (1000.0 / msec) / (1024 * 1024);
-
-    printf("i-j-k (Standard), %.4f, %.2f\n", msec, rate);
-    fprintf(fp, "i-j-k (Standard), %.4f, %.2f\n", msec, rate);
+    st = time_order(multiply_ijk, &m1, &m2, &result_ijk);
+    rate = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+
+    print_both(fp, "i-j-k (Standard), %.4f, %.2f, %.4f, %.4f, %.4f, %.4f", st.median, rate,
+               st.min, st.mean, st.stddev, st.p95);
+    perf_print_values(stdout, &st.perf);
+    perf_print_values(fp, &st.perf);
+    print_both(fp, "\n");
 
     // ===== Version 2: i-k-j loop order =====
     // Inner loop walks through B[k][j] contiguously, which is typically cache-friendly.
-    start = (double)clock() / CLOCKS_PER_SEC;
-
-    for (int i = 0; i < R1; i++) {
-        for (int k = 0; k < R2; k++) {
-            for (int j = 0; j < C2; j++) {
-                result_ikj[i][j] += m1[i][k] * m2[k][j];
-            }
-        }
-    }
-
-    end = (double)clock() / CLOCKS_PER_SEC;
-    msec = (end - start) * 1000.0;
-    rate = total_bytes * (1000.0 / msec) / (1024 * 1024);
-
-    printf("i-k-j (Optimized), %.4f, %.2f\n", msec, rate);
-    fprintf(fp, "i-k-j (Optimized), %.4f, %.2f\n", msec, rate);
+    st = time_order(multiply_ikj, &m1, &m2, &result_ikj);
+    rate = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+
+    print_both(fp, "i-k-j (Optimized), %.4f, %.2f, %.4f, %.4f, %.4f, %.4f", st.median, rate,
+               st.min, st.mean, st.stddev, st.p95);
+    perf_print_values(stdout, &st.perf);
+    perf_print_values(fp, &st.perf);
+    print_both(fp, "\n");
+
+    // ===== Version 3: i-j-k on B^T =====
+    // Same order as version 1, but both operands of the dot product are rows.
+    st = time_order(multiply_ijk_bt, &m1, &m2, &result_bt);
+    rate = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+
+    print_both(fp, "i-j-k on B^T (transpose included), %.4f, %.2f, %.4f, %.4f, %.4f, %.4f", st.median,
+               rate, st.min, st.mean, st.stddev, st.p95);
+    perf_print_values(stdout, &st.perf);
+    perf_print_values(fp, &st.perf);
+    print_both(fp, "\n");
+
+    // ===== Version 4: tiled =====
+    // The blocked GEMM of exercise 3, for reference.
+    st = time_order(multiply_tiled, &m1, &m2, &result_tiled);
+    rate = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+
+    print_both(fp, "Tiled (%s), %.4f, %.2f, %.4f, %.4f, %.4f, %.4f", gemm_kernel_select()->name, st.median,
+               rate, st.min, st.mean, st.stddev, st.p95);
+    perf_print_values(stdout, &st.perf);
+    perf_print_values(fp, &st.perf);
+    print_both(fp, "\n");
+
+    int failed = verify_results(fp, &m1, &m2, results, result_names, 4);
+
+    // The transpose used by version 3, on B alone.
+    run_transpose(fp, &m2, padded);
+
+    // Both orders again per element type (--precision), from one loop
+    // template with SIMD row updates (ikj); ijk stays a scalar dot product.
+    if (precision_count > 0) {
+        const int orders[] = {GEMM_ORDER_IJK, GEMM_ORDER_IKJ};
+        const char *names[] = {"i-j-k", "i-k-j"};
+        gemm_precision_run_t runs[MAX_PRECISIONS * 2];
+        failed += gemm_precision_benchmark(precision_list, precision_count, orders, 2, R1, C1, C2,
+                                           padded, warmup, reps, runs);
+        gemm_precision_print(stdout, precision_list, precision_count, names, 2, R1, C1, C2, runs);
+        gemm_precision_print(fp, precision_list, precision_count, names, 2, R1, C1, C2, runs);
+    }
 
     fclose(fp);
-    printf("\nResults saved to mxm_results.txt\n");
-
-    // Release all allocated rows and pointer tables.
-    for (int i = 0; i < R1; i++) {
-        free(m1[i]);
-        free(result_ijk[i]);
-        free(result_ikj[i]);
-    }
-    for (int i = 0; i < R2; i++) {
-        free(m2[i]);
-    }
-    free(m1);
-    free(m2);
-    free(result_ijk);
-    free(result_ikj);
-
-
-
-    return 0;
+    printf("\nResults saved to %s\n", output);
+
+    // Release the matrix buffers.
+    matrix_free(&m1);
+    matrix_free(&m2);
+    matrix_free(&result_ijk);
+    matrix_free(&result_ikj);
+    matrix_free(&result_bt);
+    matrix_free(&result_tiled);
+    matrix_free(&b_transposed);
+
+    return failed ? EXIT_FAILURE : 0;
 }
@@ -1,152 +1,1463 @@
-#include "stdio.h"
-#include "stdlib.h"
-#include "time.h"
-
-#define N 512  // Square matrix dimension (N x N).
-
-int min(int a, int b) {
-    return (a < b) ? a : b;
-}
-
-// Blocked (tiled) matrix multiplication.
-void matrix_multiply_blocked(double **A, double **B, double **C, int n, int block_size) {
-    // Iterate over submatrices so the inner work reuses cache lines more effectively.
-    for (int ii = 0; ii < n; ii += block_size) {        // Block row index (A and C).
-        for (int jj = 0; jj < n; jj += block_size) {    // Block column index (B and C).
-            for (int kk = 0; kk < n; kk += block_size) {// Block index used for accumulation.
-                
-                // Compute C's current tile using the corresponding tiles of A and B.
-                for (int i = ii; i < min(ii + block_size, n); i++) {
-                    for (int k = kk; k < min(kk + block_size, n); k++) {
-                        for (int j = jj; j < min(jj + block_size, n); j++) {
-                            C[i][j] += A[i][k] * B[k][j];
-                        }
-                    }
-                }
-            }
-        }
-    }
-}
-
-// Unblocked multiplication (used as a reference point).
-void matrix_multiply_standard(double **A, double **B, double **C, int n) {
-    for (int i = 0; i < n; i++) {
-        for (int k = 0; k < n; k++) {
-            for (int j = 0; j < n; j++) {
-                C[i][j] += A[i][k] * B[k][j];
-            }
-        }
-    }
-}
-
-int main() {
-    // Allocate A, B, and C as dynamic 2D arrays.
-    double **A = (double **)malloc(N * sizeof(double *));
-    double **B = (double **)malloc(N * sizeof(double *));
-    double **C = (double **)malloc(N * sizeof(double *));
-    
-    for (int i = 0; i < N; i++) {
-        A[i] = (double *)malloc(N * sizeof(double));
-        B[i] = (double *)malloc(N * sizeof(double));
-        C[i] = (double *)malloc(N * sizeof(double));
-    }
-    
+#include "math.h"
+#include "stdarg.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include "../common/autotune.h"
+#include "../common/buffer.h"
+#include "../common/cache_info.h"
+#include "../common/gemm.h"
+#include "../common/gemm_ooc.h"
+#include "../common/gemm_stats.h"
+#include "../common/matfile.h"
+#include "../common/matrix.h"
+#include "../common/precision.h"
+#include "../common/sparse.h"
+#include "../common/timing.h"
+#include "../common/topology.h"
+#include "../common/verify.h"
+
+#define DEFAULT_SIZE 512  // Square matrix dimension used when no --shape is given.
+#define MAX_PRECISIONS 8  // Maximum number of entries in --precision.
+#define MAX_SWEEP 64      // Maximum number of entries in --sizes, --prefetch, --batch, --sparse.
+#define MAX_CHECKS 512    // Verified runs kept for the final table.
+
+static int warmup = TIMING_DEFAULT_WARMUP;  // Untimed runs before measuring (--warmup).
+static int reps = TIMING_DEFAULT_REPS;      // Timed repetitions per configuration (--reps).
+static int verify_mode = VERIFY_FREIVALDS;  // Checks run after every timed multiply (--verify).
+static const char *stats_file = NULL;       // Prometheus text written at exit (--stats-file).
+
+// Write the same text to stdout and to the results file.
+static void print_both(FILE *fp, const char *fmt, ...) {
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    va_start(args, fmt);
+    vfprintf(fp, fmt, args);
+    va_end(args);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [--shape N|MxKxN] [--sizes N1,N2,...] [--pad] "
+                    "[--kernel scalar|avx2|avx512] [--threads N] [--pin] [--numa-init] "
+                    "[--mc N] [--kc N] [--nc N] [--prefetch D1,D2,...] [--strassen] [--crossover N]\n"
+                    "       [--precision double,float,bf16] [--batch N1,N2,...] [--batch-sizes S1,S2,...]\n"
+                    "       [--sparse D1,D2,...] [--bsr B] [--clustered]\n"
+                    "       [--tune|--retune] [--dtype double|float|bf16] [--tune-cache FILE]\n"
+                    "       [--warmup N] [--reps N] [--perf]"
+                    " [--alloc malloc|memalign|thp|huge2m|huge1g] [--populate] [--output FILE]\n"
+                    "       [--load-a FILE --load-b FILE] [--save-c FILE] [--save-inputs PREFIX]\n"
+                    "       [--out-of-core [--ooc-memory MiB] [--ooc-tile T]]"
+                    " [--verify none|freivalds|reference|both] [--fused]\n"
+                    "       [--stats] [--stats-file FILE] [--stats-sample N]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+// Allocate and initialize A (m x k), B (k x n) and a zeroed C (m x n).
+// Operands already mapped from matrix files (non-NULL file_ab / file_c) are
+// used in place instead.
+static void setup_matrices(matrix_t *A, matrix_t *B, matrix_t *C, int m, int k, int n,
+                           int padded, int numa_init, const matfile_t *file_ab,
+                           const matfile_t *file_c) {
+    *A = file_ab ? file_ab[0].m : matrix_create(m, k, padded);
+    *B = file_ab ? file_ab[1].m : matrix_create(k, n, padded);
+    *C = file_c ? file_c->m : matrix_create(m, n, padded);
+
+    // Place pages before the (serial) fill: the first write decides the node.
+    // Mapped files are paged in by whoever touches them first anyway.
+    if (numa_init && !file_ab && !file_c) {
+        gemm_first_touch(A, B, C);
+    }
+
     // Fill A and B with deterministic pseudo-random values so runs are comparable.
+    if (!file_ab) {
+        srand(42);
+        matrix_fill_random(A);
+        matrix_fill_random(B);
+    }
+    matrix_fill(C, 0.0);
+}
+
+// Write A and B to PREFIX_a.mat and PREFIX_b.mat through the streaming
+// writer, a block of rows at a time, so later runs can --load them.
+static void save_inputs(FILE *fp, const char *prefix, const matrix_t *A, const matrix_t *B) {
+    const matrix_t *ops[] = {A, B};
+    const char *suffix[] = {"a", "b"};
+    for (int o = 0; o < 2; o++) {
+        char path[4096];
+        snprintf(path, sizeof(path), "%s_%s.mat", prefix, suffix[o]);
+        const matrix_t *m = ops[o];
+        double start = timing_now();
+        matfile_writer_t w;
+        int status = matfile_writer_open(&w, path, m->rows, m->cols, MATFILE_F64);
+        for (int i = 0; status == 0 && i < m->rows; i += 256) {
+            int count = m->rows - i < 256 ? m->rows - i : 256;
+            status = matfile_writer_append(&w, &MAT(m, i, 0), count, m->ld);
+        }
+        if (status != 0 || matfile_writer_close(&w) != 0) {
+            fprintf(stderr, "Warning: could not write %s\n", path);
+            continue;
+        }
+        double ms = (timing_now() - start) * 1000.0;
+        double mib = (double)w.header.data_bytes / (1024 * 1024);
+        print_both(fp, "Saved %s (%d x %d): %.1f MiB in %.2f ms (%.0f MiB/s)\n", path, m->rows,
+                   m->cols, mib, ms, mib / (ms / 1000.0));
+    }
+}
+
+// Engines timed by time_multiply().
+enum { ENGINE_STANDARD, ENGINE_BLOCKED, ENGINE_RECURSIVE, ENGINE_STRASSEN };
+
+typedef struct {
+    const matrix_t *A;
+    const matrix_t *B;
+    matrix_t *C;
+    int engine;
+    const gemm_blocking_t *blk;
+    int crossover;   // ENGINE_STRASSEN only.
+} multiply_ctx_t;
+
+static void multiply_body(void *p) {
+    multiply_ctx_t *ctx = (multiply_ctx_t *)p;
+    if (ctx->engine == ENGINE_BLOCKED) {
+        matrix_multiply_blocked(ctx->A, ctx->B, ctx->C, ctx->blk);
+    } else if (ctx->engine == ENGINE_RECURSIVE) {
+        matrix_multiply_recursive(ctx->A, ctx->B, ctx->C);
+    } else if (ctx->engine == ENGINE_STRASSEN) {
+        matrix_multiply_strassen(ctx->A, ctx->B, ctx->C, ctx->crossover);
+    } else {
+        matrix_multiply_standard(ctx->A, ctx->B, ctx->C);
+    }
+}
+
+// Each repetition accumulates into C, so clear it (untimed) first.
+static void multiply_reset(void *p) {
+    matrix_fill(((multiply_ctx_t *)p)->C, 0.0);
+}
+
+// Time a multiply over warmup + reps runs (wall clock, milliseconds).
+// For ENGINE_BLOCKED, blk is passed on (NULL = auto blocking).
+static timing_stats_t time_multiply(const matrix_t *A, const matrix_t *B, matrix_t *C,
+                                    int engine, const gemm_blocking_t *blk) {
+    multiply_ctx_t ctx = {A, B, C, engine, blk, 0};
+    return timing_run(multiply_body, multiply_reset, &ctx, warmup, reps);
+}
+
+typedef struct {
+    const morton_matrix_t *A;
+    const morton_matrix_t *B;
+    morton_matrix_t *C;
+} morton_ctx_t;
+
+static void morton_body(void *p) {
+    morton_ctx_t *ctx = (morton_ctx_t *)p;
+    matrix_multiply_recursive_morton(ctx->A, ctx->B, ctx->C);
+}
+
+static void morton_reset(void *p) {
+    morton_zero(((morton_ctx_t *)p)->C);
+}
+
+// Time the recursive engine on Morton copies of A and B. The layout
+// conversions happen once, outside the timed region; the product of the
+// last run is copied back to C.
+static timing_stats_t time_morton(const matrix_t *A, const matrix_t *B, matrix_t *C, int tile) {
+    morton_matrix_t MA = morton_create(A->rows, A->cols, tile);
+    morton_matrix_t MB = morton_create(B->rows, B->cols, tile);
+    morton_matrix_t MC = morton_create(A->rows, B->cols, tile);
+    morton_from_matrix(&MA, A);
+    morton_from_matrix(&MB, B);
+    morton_ctx_t ctx = {&MA, &MB, &MC};
+    timing_stats_t st = timing_run(morton_body, morton_reset, &ctx, warmup, reps);
+    morton_to_matrix(C, &MC);
+    morton_free(&MA);
+    morton_free(&MB);
+    morton_free(&MC);
+    return st;
+}
+
+typedef struct {
+    const gemm_tune_config_t *cfg;
+    const matrix_t *A;
+    const matrix_t *B;
+    matrix_t *C;
+} tuned_ctx_t;
+
+static void tuned_body(void *p) {
+    tuned_ctx_t *ctx = (tuned_ctx_t *)p;
+    gemm_tune_multiply(ctx->cfg, ctx->A, ctx->B, ctx->C);
+}
+
+static void tuned_reset(void *p) {
+    matrix_fill(((tuned_ctx_t *)p)->C, 0.0);
+}
+
+// Time a tuned double configuration; the kernel and thread count it sets
+// are restored afterwards.
+static timing_stats_t time_tuned(const gemm_tune_config_t *cfg, const matrix_t *A,
+                                 const matrix_t *B, matrix_t *C) {
+    char kernel[GEMM_TUNE_NAME];
+    snprintf(kernel, sizeof(kernel), "%s", gemm_kernel_select()->name);
+    int threads = gemm_get_num_threads();
+    gemm_tune_apply(cfg);
+    tuned_ctx_t ctx = {cfg, A, B, C};
+    timing_stats_t st = timing_run(tuned_body, tuned_reset, &ctx, warmup, reps);
+    gemm_kernel_force(kernel);
+    if (gemm_get_num_threads() != threads) {
+        gemm_set_num_threads(threads);
+    }
+    return st;
+}
+
+typedef struct {
+    const gemm_plan_t *plan;
+    const matrix_t *A;
+    const matrix_t *B;
+    matrix_t *C;
+} plan_ctx_t;
+
+static void plan_body(void *p) {
+    plan_ctx_t *ctx = (plan_ctx_t *)p;
+    gemm_plan_execute(ctx->plan, ctx->A, ctx->B, ctx->C);
+}
+
+static void plan_reset(void *p) {
+    matrix_fill(((plan_ctx_t *)p)->C, 0.0);
+}
+
+// Time gemm_plan_execute alone; the plan is built (and destroyed) outside
+// the timed region.
+static timing_stats_t time_plan(const gemm_plan_t *plan, const matrix_t *A, const matrix_t *B,
+                                matrix_t *C) {
+    plan_ctx_t ctx = {plan, A, B, C};
+    return timing_run(plan_body, plan_reset, &ctx, warmup, reps);
+}
+
+// Time Strassen-Winograd with the given crossover.
+static timing_stats_t time_strassen(const matrix_t *A, const matrix_t *B, matrix_t *C,
+                                    int crossover) {
+    multiply_ctx_t ctx = {A, B, C, ENGINE_STRASSEN, NULL, crossover};
+    return timing_run(multiply_body, multiply_reset, &ctx, warmup, reps);
+}
+
+// Normwise error of Strassen (and, for scale, of the blocked kernel) against
+// matrix_multiply_standard on uniform [-1, 1) data of side n: the benchmark's
+// small integers multiply exactly under any summation order.
+static void report_strassen_error(FILE *fp, int n, int padded, int crossover) {
+    matrix_t A = matrix_create(n, n, padded), B = matrix_create(n, n, padded);
+    matrix_t R = matrix_create(n, n, padded), X = matrix_create(n, n, padded);
+    srand(7);
+    matrix_fill_uniform(&A, -1.0, 1.0);
+    matrix_fill_uniform(&B, -1.0, 1.0);
+    matrix_fill(&R, 0.0);
+    matrix_multiply_standard(&A, &B, &R);
+
+    matrix_fill(&X, 0.0);
+    matrix_multiply_strassen(&A, &B, &X, crossover);
+    double strassen_error = matrix_max_rel_error(&X, &R);
+    matrix_fill(&X, 0.0);
+    matrix_multiply_blocked(&A, &B, &X, NULL);
+    double blocked_error = matrix_max_rel_error(&X, &R);
+    print_both(fp, "Max relative error vs standard (uniform [-1,1) data): "
+                   "Strassen %.3e, blocked %.3e\n", strassen_error, blocked_error);
+
+    matrix_free(&A);
+    matrix_free(&B);
+    matrix_free(&R);
+    matrix_free(&X);
+}
+
+// Spread columns (and hardware counters, per run, with --perf) appended to
+// every timing row.
+static void print_spread(FILE *fp, const timing_stats_t *st) {
+    print_both(fp, ", %10.2f, %10.2f, %8.2f, %10.2f", st->min, st->mean, st->stddev, st->p95);
+    perf_print_values(stdout, &st->perf);
+    perf_print_values(fp, &st->perf);
+    print_both(fp, "\n");
+}
+
+static void print_perf_header(FILE *fp) {
+    perf_print_header(stdout);
+    perf_print_header(fp);
+    print_both(fp, "\n");
+}
+
+typedef struct {
+    char label[64];
+    verify_result_t freivalds;
+    verify_result_t reference;
+} check_row_t;
+
+static check_row_t checks[MAX_CHECKS];
+static int check_count;
+
+// Reference product for --verify reference|both (an empty matrix otherwise),
+// from the unblocked i-k-j loop.
+static matrix_t reference_product(const matrix_t *A, const matrix_t *B) {
+    matrix_t R = {NULL, 0, 0, 0};
+    if (verify_mode & VERIFY_REFERENCE) {
+        R = matrix_create(A->rows, B->cols, 0);
+        matrix_fill(&R, 0.0);
+        matrix_multiply_standard(A, B, &R);
+    }
+    return R;
+}
+
+// New row of the final table for label; NULL with --verify none or when
+// the table is full.
+static check_row_t *add_check(const char *label) {
+    if (verify_mode == 0 || check_count == MAX_CHECKS) {
+        return NULL;
+    }
+    check_row_t *row = &checks[check_count++];
+    snprintf(row->label, sizeof(row->label), "%s", label);
+    row->freivalds.checked = row->reference.checked = 0;
+    return row;
+}
+
+// Fold one check into a row that may cover several products: the row keeps
+// the worst errors and passes only if every product passed.
+static void merge_check(verify_result_t *into, const verify_result_t *r) {
+    if (!r->checked) {
+        return;
+    }
+    if (!into->checked) {
+        *into = *r;
+        return;
+    }
+    into->passed = into->passed && r->passed;
+    into->max_error = fmax(into->max_error, r->max_error);
+    into->max_ratio = fmax(into->max_ratio, r->max_ratio);
+    into->max_ulps = fmax(into->max_ulps, r->max_ulps);
+    into->rel_error = fmax(into->rel_error, r->rel_error);
+}
+
+// Run the --verify checks on C and merge them into row. Without a reference
+// product (out of core), Freivalds runs even under --verify reference.
+static void check_into(check_row_t *row, const matrix_t *A, const matrix_t *B,
+                       const matrix_t *C, const matrix_t *R, double slack) {
+    verify_result_t f = {0}, ref = {0};
+    if ((verify_mode & VERIFY_FREIVALDS) || !R->data) {
+        verify_freivalds(A, B, C, VERIFY_DEFAULT_ROUNDS, (unsigned long)check_count, slack, &f);
+    }
+    if ((verify_mode & VERIFY_REFERENCE) && R->data) {
+        verify_reference(A, B, C, R, slack, &ref);
+    }
+    merge_check(&row->freivalds, &f);
+    merge_check(&row->reference, &ref);
+}
+
+// Check C, which holds the product of the last timed repetition, with the
+// --verify checks and keep the outcome for print_checks(). slack loosens the
+// bounds for engines with weaker error guarantees (see verify.h).
+static void check_result(const matrix_t *A, const matrix_t *B, const matrix_t *C,
+                         const matrix_t *R, double slack, const char *fmt, ...) {
+    char label[sizeof(checks[0].label)];
+    va_list args;
+    va_start(args, fmt);
+    vsnprintf(label, sizeof(label), fmt, args);
+    va_end(args);
+    check_row_t *row = add_check(label);
+    if (row) {
+        check_into(row, A, B, C, R, slack);
+    }
+}
+
+// Reference for an epilogue run with beta = 0: ep applied to the unblocked
+// product (an empty matrix when --verify none). Needed whatever the mode,
+// since Freivalds cannot see through the activation.
+static matrix_t reference_epilogue(const matrix_t *A, const matrix_t *B,
+                                   const gemm_epilogue_t *ep) {
+    matrix_t R = {NULL, 0, 0, 0};
+    if (verify_mode == 0) {
+        return R;
+    }
+    R = matrix_create(A->rows, B->cols, 0);
+    matrix_fill(&R, 0.0);
+    matrix_multiply_standard(A, B, &R);
+    for (int i = 0; i < R.rows; i++) {
+        double *row = &MAT(&R, i, 0);
+        for (int j = 0; j < R.cols; j++) {
+            double v = ep->alpha * row[j] + (ep->bias ? ep->bias[j] : 0.0);
+            row[j] = ep->activation == GEMM_ACTIVATION_RELU && v < 0.0 ? 0.0 : v;
+        }
+    }
+    return R;
+}
+
+// Elementwise check of an epilogue's output against reference_epilogue().
+// Scaling by alpha <= 1, adding the bias and clipping do not widen the
+// product's error, so the product bound still applies.
+static void check_epilogue(const matrix_t *A, const matrix_t *B, const matrix_t *C,
+                           const matrix_t *R, const char *label) {
+    check_row_t *row = add_check(label);
+    if (row) {
+        verify_reference(A, B, C, R, 1.0, &row->reference);
+    }
+}
+
+// Table of every check so far; returns the number of failed runs.
+static int print_checks(FILE *fp) {
+    if (check_count == 0) {
+        return 0;
+    }
+    int failed = 0;
+    FILE *outs[] = {stdout, fp};
+    for (int o = 0; o < 2; o++) {
+        fprintf(outs[o], "\nVerification (%d Freivalds rounds), Run", VERIFY_DEFAULT_ROUNDS);
+        verify_print_header(outs[o]);
+        fprintf(outs[o], "\n");
+        for (int c = 0; c < check_count; c++) {
+            fprintf(outs[o], "Check, %s", checks[c].label);
+            verify_print_values(outs[o], &checks[c].freivalds, &checks[c].reference);
+            fprintf(outs[o], "\n");
+        }
+    }
+    for (int c = 0; c < check_count; c++) {
+        failed += (checks[c].freivalds.checked && !checks[c].freivalds.passed) ||
+                  (checks[c].reference.checked && !checks[c].reference.passed);
+    }
+    if (failed) {
+        print_both(fp, "%d of %d runs FAILED verification\n", failed, check_count);
+    }
+    return failed;
+}
+
+// Per-engine totals of every library call the run made (warmups, timed
+// repetitions and reference products alike), plus the Prometheus file.
+static void print_stats(FILE *fp) {
+    if (!gemm_stats_enabled()) {
+        return;
+    }
+    gemm_stats_snapshot_t snap;
+    gemm_stats_snapshot(&snap);
+    printf("\n");
+    fprintf(fp, "\n");
+    gemm_stats_print(stdout, &snap);
+    gemm_stats_print(fp, &snap);
+    if (stats_file) {
+        FILE *prom = fopen(stats_file, "w");
+        if (prom == NULL) {
+            fprintf(stderr, "Warning: could not write %s\n", stats_file);
+            return;
+        }
+        gemm_stats_print_prometheus(prom, &snap);
+        fclose(prom);
+        printf("Metrics written to %s\n", stats_file);
+    }
+}
+
+typedef struct {
+    const matrix_t *A;
+    const matrix_t *B;
+    matrix_t *C;
+    const gemm_epilogue_t *ep;
+    int fused;
+} epilogue_ctx_t;
+
+// C = act(alpha * A * B + bias) either in one matrix_multiply_fused call
+// (beta = 0, so C needs no clearing) or the way callers did it before:
+// clear C, C += A * B, then one more pass for scaling, bias and ReLU.
+static void epilogue_body(void *p) {
+    epilogue_ctx_t *ctx = (epilogue_ctx_t *)p;
+    const gemm_epilogue_t *ep = ctx->ep;
+    matrix_t *C = ctx->C;
+    if (ctx->fused) {
+        matrix_multiply_fused(ctx->A, ctx->B, C, ep, NULL);
+        return;
+    }
+    matrix_fill(C, 0.0);
+    matrix_multiply_blocked(ctx->A, ctx->B, C, NULL);
+    for (int i = 0; i < C->rows; i++) {
+        double *row = &MAT(C, i, 0);
+        for (int j = 0; j < C->cols; j++) {
+            double v = ep->alpha * row[j] + ep->bias[j];
+            row[j] = v > 0.0 ? v : 0.0;
+        }
+    }
+}
+
+// Fused epilogue against separate passes over C, both timed in full.
+static void run_epilogue(FILE *fp, const matrix_t *A, const matrix_t *B, matrix_t *C,
+                         int padded) {
+    // Odd columns get a bias of about minus their mean, so ReLU clips half of them.
+    double *bias = (double *)buffer_alloc((size_t)C->cols * sizeof(double));
+    for (int j = 0; j < C->cols; j++) {
+        bias[j] = j % 2 ? -0.5 * 30.25 * A->cols : 1.0;
+    }
+    gemm_epilogue_t ep = {0.5, 0.0, bias, GEMM_ACTIVATION_RELU};
+    matrix_t separate = matrix_create(C->rows, C->cols, padded);
+    long long total_bytes = 4LL * A->rows * A->cols * B->cols * sizeof(double);
+
+    print_both(fp, "\nEpilogue (C = ReLU(0.5 A B + bias)), Time (msec), Bandwidth (MB/s), Speedup, "
+                   "Min (msec), Mean (msec), Stddev (msec), P95 (msec)");
+    print_perf_header(fp);
+    epilogue_ctx_t ctx = {A, B, &separate, &ep, 0};
+    timing_stats_t base = timing_run(epilogue_body, NULL, &ctx, warmup, reps);
+    print_both(fp, "Separate passes (clear + multiply + epilogue), %10.2f, %12.2f, %6.2fx",
+               base.median, total_bytes * (1000.0 / base.median) / (1024 * 1024), 1.0);
+    print_spread(fp, &base);
+    ctx.C = C;
+    ctx.fused = 1;
+    timing_stats_t st = timing_run(epilogue_body, NULL, &ctx, warmup, reps);
+    print_both(fp, "Fused (matrix_multiply_fused), %10.2f, %12.2f, %6.2fx", st.median,
+               total_bytes * (1000.0 / st.median) / (1024 * 1024), base.median / st.median);
+    print_spread(fp, &st);
+    print_both(fp, "Max relative difference fused vs separate: %.3e\n",
+               matrix_max_rel_error(C, &separate));
+
+    matrix_t R = reference_epilogue(A, B, &ep);
+    check_epilogue(A, B, &separate, &R, "Epilogue separate passes");
+    check_epilogue(A, B, C, &R, "Epilogue fused");
+    matrix_free(&R);
+
+    // Put the plain product back (untimed), so C and a --save-c file hold
+    // A * B after every section.
+    matrix_fill(C, 0.0);
+    matrix_multiply_blocked(A, B, C, NULL);
+    matrix_free(&separate);
+    buffer_free(bias);
+}
+
+// Square size sweep: as N grows, the unblocked loop slows down each time its
+// working set outgrows a cache level, while the tiled run should stay flat.
+static void run_size_sweep(FILE *fp, const int *sizes, int count, int padded, int numa_init,
+                           const gemm_blocking_t *blk) {
+    print_both(fp, "Size, Blocked (msec), Blocked (GFLOP/s), Standard (msec), "
+                   "Standard (GFLOP/s), Working set (KiB), Blocked P95 (msec), Standard P95 (msec)");
+    print_perf_header(fp);
+
+    for (int s = 0; s < count; s++) {
+        int n = sizes[s];
+        matrix_t A, B, C;
+        setup_matrices(&A, &B, &C, n, n, n, padded, numa_init, NULL, NULL);
+
+        double gflop = 2.0 * n * n * n / 1e9;
+        matrix_t R = reference_product(&A, &B);
+        timing_stats_t blocked = time_multiply(&A, &B, &C, ENGINE_BLOCKED, blk);
+        check_result(&A, &B, &C, &R, 1.0, "N=%d blocked", n);
+        timing_stats_t standard = time_multiply(&A, &B, &C, ENGINE_STANDARD, NULL);
+        check_result(&A, &B, &C, &R, 1.0, "N=%d standard", n);
+        double working_set_kib = 3.0 * n * n * sizeof(double) / 1024;
+
+        // "N=" keeps these rows apart from block-size rows in the plot script.
+        // Counters (with --perf) are those of the blocked run.
+        print_both(fp, "N=%d, %10.2f, %8.2f, %10.2f, %8.2f, %12.0f, %10.2f, %10.2f", n,
+                   blocked.median, gflop / (blocked.median / 1000.0), standard.median,
+                   gflop / (standard.median / 1000.0), working_set_kib, blocked.p95, standard.p95);
+        perf_print_values(stdout, &blocked.perf);
+        perf_print_values(fp, &blocked.perf);
+        print_both(fp, "\n");
+
+        matrix_free(&A);
+        matrix_free(&B);
+        matrix_free(&C);
+        matrix_free(&R);
+    }
+}
+
+// Batched small multiplies: one layout per engine, all on the same buffers.
+enum { BATCH_STRIDED, BATCH_POINTERS, BATCH_LOOP };
+
+typedef struct {
+    int engine;
+    gemm_batch_shape_t shape;
+    double *A, *B, *C;          // count matrices back to back.
+    const double **pa, **pb;    // Pointer-array view of the same matrices.
+    double **pc;
+    int count;
+} batch_ctx_t;
+
+static void batch_body(void *p) {
+    batch_ctx_t *ctx = (batch_ctx_t *)p;
+    int s = ctx->shape.m;
+    size_t stride = (size_t)s * s;
+    if (ctx->engine == BATCH_STRIDED) {
+        matrix_multiply_batch_strided(&ctx->shape, ctx->A, stride, ctx->B, stride, ctx->C, stride,
+                                      ctx->count);
+    } else if (ctx->engine == BATCH_POINTERS) {
+        matrix_multiply_batch(&ctx->shape, ctx->pa, ctx->pb, ctx->pc, ctx->count);
+    } else {
+        // What the batched entry points replace: one full blocked call each.
+        for (int i = 0; i < ctx->count; i++) {
+            matrix_t a = {ctx->A + i * stride, s, s, s}, b = {ctx->B + i * stride, s, s, s};
+            matrix_t c = {ctx->C + i * stride, s, s, s};
+            matrix_multiply_blocked(&a, &b, &c, NULL);
+        }
+    }
+}
+
+static void batch_reset(void *p) {
+    batch_ctx_t *ctx = (batch_ctx_t *)p;
+    memset(ctx->C, 0, (size_t)ctx->count * ctx->shape.m * ctx->shape.m * sizeof(double));
+}
+
+// One check row for a whole batch: every product of the last timed run.
+static void check_batch(const batch_ctx_t *ctx, const char *engine) {
+    char label[sizeof(checks[0].label)];
+    snprintf(label, sizeof(label), "Batch %d x %d %s", ctx->shape.m, ctx->count, engine);
+    check_row_t *row = add_check(label);
+    int s = ctx->shape.m;
+    size_t stride = (size_t)s * s;
+    for (int i = 0; row && i < ctx->count; i++) {
+        matrix_t a = {ctx->A + i * stride, s, s, s}, b = {ctx->B + i * stride, s, s, s};
+        matrix_t c = {ctx->C + i * stride, s, s, s};
+        matrix_t R = reference_product(&a, &b);
+        check_into(row, &a, &b, &c, &R, 1.0);
+        matrix_free(&R);
+    }
+}
+
+// Batch count x matrix size: GFLOP/s of the strided and pointer-array batched
+// calls against a loop of matrix_multiply_blocked over the same matrices.
+static void run_batch_sweep(FILE *fp, const int *counts, int ncounts, const int *sizes, int nsizes) {
+    print_both(fp, "Size, Batch, Strided (msec), Strided (GFLOP/s), Pointers (GFLOP/s), "
+                   "Loop (GFLOP/s), Speedup vs loop, Kernel, Max |diff| vs loop\n");
+    for (int z = 0; z < nsizes; z++) {
+        int s = sizes[z];
+        size_t stride = (size_t)s * s;
+        for (int c = 0; c < ncounts; c++) {
+            batch_ctx_t ctx;
+            ctx.shape = (gemm_batch_shape_t){s, s, s, s, s, s};
+            ctx.count = counts[c];
+            size_t bytes = (size_t)ctx.count * stride * sizeof(double);
+            ctx.A = (double *)buffer_alloc(bytes);
+            ctx.B = (double *)buffer_alloc(bytes);
+            ctx.C = (double *)buffer_alloc(bytes);
+            ctx.pa = (const double **)buffer_alloc((size_t)ctx.count * sizeof(double *));
+            ctx.pb = (const double **)buffer_alloc((size_t)ctx.count * sizeof(double *));
+            ctx.pc = (double **)buffer_alloc((size_t)ctx.count * sizeof(double *));
+            srand(42);
+            for (size_t i = 0; i < (size_t)ctx.count * stride; i++) {
+                ctx.A[i] = (double)(rand() % 10) + 1.0;
+                ctx.B[i] = (double)(rand() % 10) + 1.0;
+            }
+            for (int i = 0; i < ctx.count; i++) {
+                ctx.pa[i] = ctx.A + i * stride;
+                ctx.pb[i] = ctx.B + i * stride;
+                ctx.pc[i] = ctx.C + i * stride;
+            }
+
+            double median[3];
+            const char *engines[] = {"strided", "pointers", "loop"};
+            for (int e = BATCH_STRIDED; e <= BATCH_LOOP; e++) {
+                ctx.engine = e;
+                median[e] = timing_run(batch_body, batch_reset, &ctx, warmup, reps).median;
+                check_batch(&ctx, engines[e]);
+            }
+
+            // C now holds the loop's result; recompute with the batched call and compare.
+            double *loop_c = (double *)buffer_alloc(bytes);
+            memcpy(loop_c, ctx.C, bytes);
+            batch_reset(&ctx);
+            ctx.engine = BATCH_STRIDED;
+            batch_body(&ctx);
+            double diff = 0.0;
+            for (size_t i = 0; i < (size_t)ctx.count * stride; i++) {
+                double d = fabs(ctx.C[i] - loop_c[i]);
+                diff = d > diff ? d : diff;
+            }
+
+            double gflop = 2.0 * s * s * s * ctx.count / 1e9;
+            print_both(fp, "%d, %d, %.4f, %.2f, %.2f, %.2f, %.2fx, %s, %g\n", s, ctx.count,
+                       median[BATCH_STRIDED], gflop / (median[BATCH_STRIDED] / 1000.0),
+                       gflop / (median[BATCH_POINTERS] / 1000.0),
+                       gflop / (median[BATCH_LOOP] / 1000.0),
+                       median[BATCH_LOOP] / median[BATCH_STRIDED],
+                       gemm_fixed_kernel(s) ? "fixed" : gemm_kernel_select()->name, diff);
+
+            buffer_free(loop_c);
+            buffer_free(ctx.A);
+            buffer_free(ctx.B);
+            buffer_free(ctx.C);
+            buffer_free(ctx.pa);
+            buffer_free(ctx.pb);
+            buffer_free(ctx.pc);
+        }
+    }
+}
+
+// Sparse A (m x k) with about density * m * k nonzeros: independent entries,
+// or with clustered != 0 whole block x block tiles (a BSR-friendly pattern).
+static void fill_sparse(matrix_t *A, double density, int clustered, int block) {
+    int step = clustered ? block : 1;
     srand(42);
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j < N; j++) {
-            A[i][j] = (double)(rand() % 10) + 1.0;
-            B[i][j] = (double)(rand() % 10) + 1.0;
-            C[i][j] = 0.0;
+    matrix_fill(A, 0.0);
+    for (int i = 0; i < A->rows; i += step) {
+        for (int j = 0; j < A->cols; j += step) {
+            if ((double)rand() / ((double)RAND_MAX + 1.0) >= density) {
+                continue;
+            }
+            for (int r = i; r < i + step && r < A->rows; r++) {
+                for (int c = j; c < j + step && c < A->cols; c++) {
+                    MAT(A, r, c) = (double)(rand() % 10) + 1.0;
+                }
+            }
+        }
+    }
+}
+
+enum { SPARSE_DENSE, SPARSE_CSR, SPARSE_BSR, SPARSE_ADAPTIVE };
+
+typedef struct {
+    int engine;
+    const matrix_t *A;
+    const csr_matrix_t *csr;
+    const bsr_matrix_t *bsr;
+    const matrix_t *B;
+    matrix_t *C;
+    double crossover;   // SPARSE_ADAPTIVE only.
+} sparse_ctx_t;
+
+static void sparse_body(void *p) {
+    sparse_ctx_t *ctx = (sparse_ctx_t *)p;
+    if (ctx->engine == SPARSE_DENSE) {
+        matrix_multiply_blocked(ctx->A, ctx->B, ctx->C, NULL);
+    } else if (ctx->engine == SPARSE_CSR) {
+        csr_multiply(ctx->csr, ctx->B, ctx->C, 0);
+    } else if (ctx->engine == SPARSE_BSR) {
+        bsr_multiply(ctx->bsr, ctx->B, ctx->C, 0);
+    } else {
+        matrix_multiply_adaptive(ctx->A, ctx->B, ctx->C, ctx->crossover);
+    }
+}
+
+static void sparse_reset(void *p) {
+    matrix_fill(((sparse_ctx_t *)p)->C, 0.0);
+}
+
+typedef struct {
+    double density;   // Measured with matrix_density().
+    long long nnz;
+    double dense, csr, bsr, convert;
+} sparse_row_t;
+
+// Dense vs CSR vs BSR over a list of densities, the crossover density where
+// CSR catches up with the tiled dense kernel (interpolated between the two
+// measurements that bracket it), then matrix_multiply_adaptive at each
+// density with that crossover.
+static void run_sparse_sweep(FILE *fp, const double *densities, int count, int m, int k, int n,
+                             int padded, int block, int clustered) {
+    matrix_t A = matrix_create(m, k, padded), B = matrix_create(k, n, padded);
+    matrix_t C = matrix_create(m, n, padded);
+    matrix_fill_random(&B);
+    sparse_row_t rows[MAX_SWEEP];
+    double gflop_dense = 2.0 * m * k * n / 1e9;
+
+    print_both(fp, "Density (target), Density (measured), nnz, Dense (msec), CSR (msec), "
+                   "BSR%d (msec), CSR convert (msec), CSR useful GFLOP/s, Best\n", block);
+    for (int d = 0; d < count; d++) {
+        sparse_row_t *row = &rows[d];
+        fill_sparse(&A, densities[d], clustered, block);
+        row->density = matrix_density(&A);
+        row->nnz = (long long)(row->density * m * k + 0.5);
+
+        double t0 = timing_now();
+        csr_matrix_t csr = csr_from_dense(&A);
+        row->convert = (timing_now() - t0) * 1000.0;
+        bsr_matrix_t bsr = bsr_from_dense(&A, block);
+
+        matrix_t R = reference_product(&A, &B);
+        sparse_ctx_t ctx = {SPARSE_DENSE, &A, &csr, &bsr, &B, &C, 0.0};
+        row->dense = timing_run(sparse_body, sparse_reset, &ctx, warmup, reps).median;
+        check_result(&A, &B, &C, &R, 1.0, "density %g dense", densities[d]);
+        ctx.engine = SPARSE_CSR;
+        row->csr = timing_run(sparse_body, sparse_reset, &ctx, warmup, reps).median;
+        check_result(&A, &B, &C, &R, 1.0, "density %g CSR", densities[d]);
+        ctx.engine = SPARSE_BSR;
+        row->bsr = timing_run(sparse_body, sparse_reset, &ctx, warmup, reps).median;
+        check_result(&A, &B, &C, &R, 1.0, "density %g BSR%d", densities[d], block);
+        matrix_free(&R);
+
+        const char *best = row->dense <= row->csr && row->dense <= row->bsr ? "dense"
+                           : row->csr <= row->bsr                           ? "CSR"
+                                                                              : "BSR";
+        print_both(fp, "%g, %.5f, %lld, %.4f, %.4f, %.4f, %.4f, %.2f, %s\n", densities[d],
+                   row->density, row->nnz, row->dense, row->csr, row->bsr, row->convert,
+                   gflop_dense * row->density / (row->csr / 1000.0), best);
+        csr_free(&csr);
+        bsr_free(&bsr);
+    }
+
+    // Crossover: the measured densities in increasing order, first pair
+    // where CSR / dense time goes from below 1 to at least 1.
+    int order[MAX_SWEEP];
+    for (int d = 0; d < count; d++) {
+        int pos = d;
+        while (pos > 0 && rows[order[pos - 1]].density > rows[d].density) {
+            order[pos] = order[pos - 1];
+            pos--;
+        }
+        order[pos] = d;
+    }
+    double crossover = -1.0;
+    const sparse_row_t *first = &rows[order[0]], *last = &rows[order[count - 1]];
+    for (int d = 0; d + 1 < count && crossover < 0; d++) {
+        const sparse_row_t *lo = &rows[order[d]], *hi = &rows[order[d + 1]];
+        double r_lo = lo->csr / lo->dense, r_hi = hi->csr / hi->dense;
+        if (r_lo < 1.0 && r_hi >= 1.0) {
+            crossover = lo->density + (hi->density - lo->density) * (1.0 - r_lo) / (r_hi - r_lo);
         }
     }
-    
+    if (crossover >= 0) {
+        print_both(fp, "\nCrossover density (CSR time = dense time): %.5f\n", crossover);
+    } else if (first->csr >= first->dense) {
+        crossover = 0.0;
+        print_both(fp, "\nCrossover density: below %.5f (dense won everywhere)\n", first->density);
+    } else {
+        crossover = 1.0;
+        print_both(fp, "\nCrossover density: above %.5f (CSR won everywhere)\n", last->density);
+    }
+
+    print_both(fp, "Density (measured), Adaptive (msec), Path\n");
+    for (int d = 0; d < count; d++) {
+        fill_sparse(&A, densities[d], clustered, block);
+        sparse_ctx_t ctx = {SPARSE_ADAPTIVE, &A, NULL, NULL, &B, &C, crossover};
+        double t = timing_run(sparse_body, sparse_reset, &ctx, warmup, reps).median;
+        matrix_t R = reference_product(&A, &B);
+        check_result(&A, &B, &C, &R, 1.0, "density %g adaptive", densities[d]);
+        matrix_free(&R);
+        print_both(fp, "%.5f, %.4f, %s\n", rows[d].density, t,
+                   rows[d].density < crossover ? "CSR (with conversion)" : "dense");
+    }
+
+    matrix_free(&A);
+    matrix_free(&B);
+    matrix_free(&C);
+}
+
+// Every sparse engine on the sweep's shape with one dimension cut to zero
+// (untimed, checked only): K = 0 must leave C alone, M or N = 0 must not
+// touch anything, and none of them may divide by the empty side.
+static void check_sparse_empty(int m, int k, int n, int block) {
+    const int shapes[3][3] = {{m, 0, n}, {0, k, n}, {m, k, 0}};
+    const char *names[] = {"dense", "CSR", "BSR", "adaptive"};
+    for (int s = 0; s < 3; s++) {
+        int sm = shapes[s][0], sk = shapes[s][1], sn = shapes[s][2];
+        matrix_t A = matrix_create(sm, sk, 0), B = matrix_create(sk, sn, 0);
+        matrix_t C = matrix_create(sm, sn, 0);
+        matrix_fill_random(&A);
+        matrix_fill_random(&B);
+        csr_matrix_t csr = csr_from_dense(&A);
+        bsr_matrix_t bsr = bsr_from_dense(&A, block);
+        matrix_t R = reference_product(&A, &B);
+        for (int e = SPARSE_DENSE; e <= SPARSE_ADAPTIVE; e++) {
+            sparse_ctx_t ctx = {e, &A, &csr, &bsr, &B, &C, 0.5};
+            sparse_reset(&ctx);
+            sparse_body(&ctx);
+            check_result(&A, &B, &C, &R, 1.0, "%dx%dx%d %s", sm, sk, sn, names[e]);
+        }
+        csr_free(&csr);
+        bsr_free(&bsr);
+        matrix_free(&A);
+        matrix_free(&B);
+        matrix_free(&C);
+        matrix_free(&R);
+    }
+}
+
+// Batches with one side 0 through both batched layouts: C += nothing must
+// leave C as it was.
+static void check_batch_empty(int size) {
+    const int shapes[3][3] = {{size, 0, size}, {0, size, size}, {size, size, 0}};
+    for (int s = 0; s < 3; s++) {
+        int sm = shapes[s][0], sk = shapes[s][1], sn = shapes[s][2];
+        matrix_t A = matrix_create(sm, sk, 0), B = matrix_create(sk, sn, 0);
+        matrix_t C = matrix_create(sm, sn, 0);
+        matrix_fill_random(&A);
+        matrix_fill_random(&B);
+        matrix_t R = reference_product(&A, &B);
+        gemm_batch_shape_t shape = {sm, sk, sn, A.ld, B.ld, C.ld};
+        const double *pa[2] = {A.data, A.data}, *pb[2] = {B.data, B.data};
+        double *pc[2] = {C.data, C.data};
+        matrix_fill(&C, 0.0);
+        matrix_multiply_batch_strided(&shape, A.data, 0, B.data, 0, C.data, 0, 2);
+        check_result(&A, &B, &C, &R, 1.0, "Batch %dx%dx%d strided", sm, sk, sn);
+        matrix_fill(&C, 0.0);
+        matrix_multiply_batch(&shape, pa, pb, pc, 2);
+        check_result(&A, &B, &C, &R, 1.0, "Batch %dx%dx%d pointers", sm, sk, sn);
+        matrix_free(&A);
+        matrix_free(&B);
+        matrix_free(&C);
+        matrix_free(&R);
+    }
+}
+
+int main(int argc, char **argv) {
+    // --shape sets the problem: N for N x N, or MxKxN for (M x K) * (K x N).
+    // --sizes runs a square size sweep instead of the block-size sweep.
+    // --pad selects a padded row stride so N=512 rows do not share cache sets.
+    // --kernel overrides the CPUID-selected micro-kernel (scalar, avx2, avx512).
+    // --mc/--kc/--nc override the cache-derived block sizes of the auto run.
+    // --threads sets the worker count of the tiled runs (0 = all CPUs).
+    // --pin pins workers to CPUs node by node; --numa-init first-touches the
+    // matrices in parallel with the compute phase's tile-to-thread mapping.
+    int M = DEFAULT_SIZE, K = DEFAULT_SIZE, N = DEFAULT_SIZE;
+    int sweep[MAX_SWEEP], sweep_count = 0;
+    int padded = 0;
+    int threads = 1;
+    int pin = 0, numa_init = 0;
+    int mc = 0, kc = 0, nc = 0;
+    int prefetch[MAX_SWEEP], prefetch_count = 0;
+    int strassen = 0, crossover = 0;
+    int batch[MAX_SWEEP], batch_count = 0;
+    int tune = 0, retune = 0;
+    const char *dtype = "double", *tune_cache = GEMM_TUNE_DEFAULT_CACHE;
+    const char *output = "mxm_bloc_results.txt";
+    const char *load_a = NULL, *load_b = NULL, *save_c = NULL, *save_prefix = NULL;
+    int out_of_core = 0;
+    int fused = 0;
+    int stats = 0, stats_sample = 0;
+    gemm_ooc_options_t ooc = {0, 0};
+    double densities[MAX_SWEEP];
+    int density_count = 0, bsr_block = 4, clustered = 0;
+    int batch_sizes[MAX_SWEEP] = {4, 8, 16, 32, 64}, batch_size_count = 5;
+    const gemm_precision_t *precision_list[MAX_PRECISIONS];
+    int precision_count = 0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--shape") == 0 && i + 1 < argc) {
+            if (matrix_parse_shape(argv[++i], &M, &K, &N) != 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--sizes") == 0 && i + 1 < argc) {
+            sweep_count = parse_int_list(argv[++i], sweep, MAX_SWEEP);
+            if (sweep_count <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--pad") == 0) {
+            padded = 1;
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            if (gemm_kernel_force(argv[++i]) != 0) {
+                fprintf(stderr, "Kernel '%s' is unknown or not supported by this CPU\n", argv[i]);
+                exit(EXIT_FAILURE);
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--pin") == 0) {
+            pin = 1;
+        } else if (strcmp(argv[i], "--numa-init") == 0) {
+            numa_init = 1;
+        } else if (timing_parse_arg(argc, argv, &i, &warmup, &reps) ||
+                   buffer_parse_arg(argc, argv, &i)) {
+            continue;
+        } else if (strcmp(argv[i], "--prefetch") == 0 && i + 1 < argc) {
+            // parse_int_list wants positive values; 0 (prefetch off) is always run first.
+            prefetch_count = parse_int_list(argv[++i], prefetch, MAX_SWEEP);
+            if (prefetch_count <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--precision") == 0 && i + 1 < argc) {
+            precision_count = gemm_precision_parse_list(argv[++i], precision_list, MAX_PRECISIONS);
+            if (precision_count <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batch_count = parse_int_list(argv[++i], batch, MAX_SWEEP);
+            if (batch_count <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--batch-sizes") == 0 && i + 1 < argc) {
+            batch_size_count = parse_int_list(argv[++i], batch_sizes, MAX_SWEEP);
+            if (batch_size_count <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--tune") == 0) {
+            tune = 1;
+        } else if (strcmp(argv[i], "--retune") == 0) {
+            tune = retune = 1;
+        } else if (strcmp(argv[i], "--dtype") == 0 && i + 1 < argc) {
+            dtype = argv[++i];
+            if (gemm_precision_find(dtype) == NULL) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--tune-cache") == 0 && i + 1 < argc) {
+            tune_cache = argv[++i];
+        } else if (strcmp(argv[i], "--sparse") == 0 && i + 1 < argc) {
+            density_count = parse_double_list(argv[++i], densities, MAX_SWEEP);
+            if (density_count <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--bsr") == 0 && i + 1 < argc) {
+            bsr_block = atoi(argv[++i]);
+            if (bsr_block <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--clustered") == 0) {
+            clustered = 1;
+        } else if (strcmp(argv[i], "--strassen") == 0) {
+            strassen = 1;
+        } else if (strcmp(argv[i], "--crossover") == 0 && i + 1 < argc) {
+            strassen = 1;
+            crossover = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (strcmp(argv[i], "--load-a") == 0 && i + 1 < argc) {
+            load_a = argv[++i];
+        } else if (strcmp(argv[i], "--load-b") == 0 && i + 1 < argc) {
+            load_b = argv[++i];
+        } else if (strcmp(argv[i], "--save-c") == 0 && i + 1 < argc) {
+            save_c = argv[++i];
+        } else if (strcmp(argv[i], "--save-inputs") == 0 && i + 1 < argc) {
+            save_prefix = argv[++i];
+        } else if (strcmp(argv[i], "--out-of-core") == 0) {
+            out_of_core = 1;
+        } else if (strcmp(argv[i], "--ooc-memory") == 0 && i + 1 < argc) {
+            out_of_core = 1;
+            ooc.memory = (size_t)atol(argv[++i]) << 20;
+        } else if (strcmp(argv[i], "--ooc-tile") == 0 && i + 1 < argc) {
+            out_of_core = 1;
+            ooc.tile = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            stats = 1;
+        } else if (strcmp(argv[i], "--stats-file") == 0 && i + 1 < argc) {
+            stats = 1;
+            stats_file = argv[++i];
+        } else if (strcmp(argv[i], "--stats-sample") == 0 && i + 1 < argc) {
+            stats = 1;
+            stats_sample = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--fused") == 0) {
+            fused = 1;
+        } else if (strcmp(argv[i], "--verify") == 0 && i + 1 < argc) {
+            verify_mode = verify_parse_mode(argv[++i]);
+            if (verify_mode < 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--mc") == 0 && i + 1 < argc) {
+            mc = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--kc") == 0 && i + 1 < argc) {
+            kc = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--nc") == 0 && i + 1 < argc) {
+            nc = atoi(argv[++i]);
+        } else {
+            usage(argv[0]);
+        }
+    }
+    if ((load_a != NULL) != (load_b != NULL) || (out_of_core && (!load_a || !save_c))) {
+        usage(argv[0]);
+    }
+
+    // Operands mapped from matrix files: the files set the shape, and the
+    // kernels read the mapped pages directly.
+    matfile_t files[2];
+    double map_ms = 0.0;
+    if (load_a) {
+        double start = timing_now();
+        if (matfile_map(&files[0], load_a) != 0 || matfile_map(&files[1], load_b) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        map_ms = (timing_now() - start) * 1000.0;
+        if (!files[0].m.data || !files[1].m.data || files[0].m.cols != files[1].m.rows) {
+            fprintf(stderr, "--load-a/--load-b: need double matrices with A's columns equal "
+                            "to B's rows\n");
+            exit(EXIT_FAILURE);
+        }
+        M = files[0].m.rows;
+        K = files[0].m.cols;
+        N = files[1].m.cols;
+    }
+
+    // Sampled calls read the perf counters, which worker threads only
+    // inherit if they are opened before the pool exists.
+    if (stats) {
+        gemm_stats_enable(1);
+        if (stats_sample > 0) {
+            if (!perf_counters_enabled() && perf_counters_open() == 0) {
+                fprintf(stderr, "Warning: no hardware counters available, calls are not sampled\n");
+            }
+            gemm_stats_set_sampling(stats_sample);
+        }
+    }
+
+    gemm_set_num_threads(threads);
+    if (pin && gemm_pin_threads() != 0) {
+        fprintf(stderr, "Warning: could not pin every thread\n");
+    }
+    const gemm_kernel_t *kernel = gemm_kernel_select();
+    const cache_info_t *cache = cache_info_get();
+
+    // Cache-derived block sizes, with any explicit override applied on top.
+    gemm_blocking_t auto_blk = gemm_blocking_auto(kernel);
+    if (mc > 0) auto_blk.mc = mc;
+    if (kc > 0) auto_blk.kc = kc;
+    if (nc > 0) auto_blk.nc = nc;
+
     // Save measurements in a simple CSV-like text file.
-    FILE *fp = fopen("mxm_bloc_results.txt", "w");
+    FILE *fp = fopen(output, "w");
     if (fp == NULL) {
         printf("Error opening file!\n");
         exit(EXIT_FAILURE);
     }
-    
-    fprintf(fp, "Block Matrix Multiplication Performance Analysis\n");
-    fprintf(fp, "Matrix size: %d x %d\n\n", N, N);
-    fprintf(fp, "Block Size, Time (msec), Bandwidth (MB/s), Speedup vs Standard\n");
-    
-    printf("Block Matrix Multiplication Performance Analysis\n");
-    printf("Matrix size: %d x %d\n\n", N, N);
-    printf("Block Size, Time (msec), Bandwidth (MB/s), Speedup\n");
-    
+
+    if (sweep_count > 0) {
+        print_both(fp, "Block Matrix Multiplication Size Sweep\n");
+        print_both(fp, "Kernel: %s (%dx%d), threads: %d\n", kernel->name, kernel->mr, kernel->nr,
+                   gemm_get_num_threads());
+        print_both(fp, "Caches: L1d %ld KiB, L2 %ld KiB, L3 %ld KiB%s\n", cache->l1d / 1024,
+                   cache->l2 / 1024, cache->l3 / 1024, cache->detected ? "" : " (defaults)");
+        print_both(fp, "Memory: %s\n", buffer_backing_name());
+        print_both(fp, "Timing: median of %d runs after %d warmup (wall clock)\n\n", reps, warmup);
+
+        run_size_sweep(fp, sweep, sweep_count, padded, numa_init, &auto_blk);
+        int failed = print_checks(fp);
+
+        print_stats(fp);
+        fclose(fp);
+        printf("\nResults saved to %s\n", output);
+        gemm_set_num_threads(1);
+        return failed ? EXIT_FAILURE : 0;
+    }
+
+    // Out-of-core: the mapped files only supplied the shape; the multiply
+    // streams them through a few tile buffers instead.
+    if (out_of_core) {
+        matfile_unmap(&files[0]);
+        matfile_unmap(&files[1]);
+        print_both(fp, "Out-of-core Matrix Multiplication\n");
+        print_both(fp, "Shape: %d x %d x %d, A %s, B %s, C %s\n", M, K, N, load_a, load_b, save_c);
+        print_both(fp, "Kernel: %s (%dx%d), threads: %d, tile memory: %zu MiB\n", kernel->name,
+                   kernel->mr, kernel->nr, gemm_get_num_threads(),
+                   (ooc.memory ? ooc.memory : GEMM_OOC_DEFAULT_MEMORY) >> 20);
+        gemm_ooc_stats_t os;
+        if (gemm_ooc_multiply(load_a, load_b, save_c, &ooc, &os) != 0) {
+            exit(EXIT_FAILURE);
+        }
+        double mib = (double)(os.bytes_read + os.bytes_written) / (1024 * 1024);
+        double gflops = 2.0 * M * K * N / os.seconds * 1e-9;
+        print_both(fp, "Tiles: %d x %d x %d, %ld steps\n", os.tile_m, os.tile_k, os.tile_n,
+                   os.steps);
+        print_both(fp, "Total (msec), GFLOP/s, I/O (MiB), I/O (MiB/s), I/O busy (msec), "
+                       "Compute (msec), Stall (msec), Overlap\n");
+        // Overlap: share of the I/O time hidden behind compute.
+        double hidden = os.io_seconds > 0.0 ? 1.0 - os.stall_seconds / os.io_seconds : 1.0;
+        print_both(fp, "%10.2f, %8.2f, %10.1f, %10.1f, %10.2f, %10.2f, %10.2f, %5.1f%%\n",
+                   os.seconds * 1000.0, gflops, mib, mib / os.seconds, os.io_seconds * 1000.0,
+                   os.compute_seconds * 1000.0, os.stall_seconds * 1000.0,
+                   100.0 * (hidden > 0.0 ? hidden : 0.0));
+
+        // Freivalds streams the three files once each; a reference product
+        // would need the whole of C in memory.
+        if (verify_mode) {
+            matfile_t out;
+            if (matfile_map(&files[0], load_a) != 0 || matfile_map(&files[1], load_b) != 0 ||
+                matfile_map(&out, save_c) != 0) {
+                exit(EXIT_FAILURE);
+            }
+            matrix_t none = {NULL, 0, 0, 0};
+            check_result(&files[0].m, &files[1].m, &out.m, &none, 1.0, "Out of core");
+            matfile_unmap(&files[0]);
+            matfile_unmap(&files[1]);
+            matfile_unmap(&out);
+        }
+        int failed = print_checks(fp);
+
+        print_stats(fp);
+        fclose(fp);
+        printf("\nResults saved to %s\n", output);
+        gemm_set_num_threads(1);
+        return failed ? EXIT_FAILURE : 0;
+    }
+
+    // Tuning cache: one file read at startup, then hash lookups only.
+    int tuned_entries = gemm_tune_load(tune_cache);
+
+    if (tune) {
+        print_both(fp, "Autotuning: %s %d x %d x %d, cache %s (%d entries)\n", dtype, M, K, N,
+                   tune_cache, tuned_entries);
+        print_both(fp, "CPU: %s\n", gemm_tune_cpu_model());
+        const gemm_tune_config_t *hit = gemm_tune_lookup(dtype, M, K, N);
+        gemm_tune_config_t best;
+        if (hit && !retune) {
+            best = *hit;
+            print_both(fp, "Cache hit, no search\n");
+        } else {
+            best = gemm_tune_search(dtype, M, K, N, stdout);
+            if (gemm_tune_save(tune_cache) != 0) {
+                fprintf(stderr, "Warning: could not write %s\n", tune_cache);
+            }
+        }
+        char desc[128];
+        gemm_tune_describe(&best, desc, sizeof(desc));
+        print_both(fp, "Best: %s, %.2f GFLOP/s when tuned\n", desc, best.gflops);
+
+        print_stats(fp);
+        fclose(fp);
+        printf("\nResults saved to %s\n", output);
+        gemm_set_num_threads(1);
+        return 0;
+    }
+
+    if (density_count > 0) {
+        print_both(fp, "Sparse x Dense Multiplication\n");
+        print_both(fp, "Shape: %d x %d x %d, A %s, BSR block %d\n", M, K, N,
+                   clustered ? "clustered in blocks" : "random entries", bsr_block);
+        print_both(fp, "Kernel: %s (%dx%d), threads: %d, panel: %d columns\n", kernel->name,
+                   kernel->mr, kernel->nr, gemm_get_num_threads(), sparse_panel_cols(K));
+        print_both(fp, "Memory: %s\n", buffer_backing_name());
+        print_both(fp, "Timing: median of %d runs after %d warmup (wall clock)\n\n", reps, warmup);
+
+        run_sparse_sweep(fp, densities, density_count, M, K, N, padded, bsr_block, clustered);
+        check_sparse_empty(M, K, N, bsr_block);
+        int failed = print_checks(fp);
+
+        print_stats(fp);
+        fclose(fp);
+        printf("\nResults saved to %s\n", output);
+        gemm_set_num_threads(1);
+        return failed ? EXIT_FAILURE : 0;
+    }
+
+    if (batch_count > 0) {
+        print_both(fp, "Batched Small Matrix Multiplication\n");
+        print_both(fp, "Kernel: %s (%dx%d), threads: %d\n", kernel->name, kernel->mr, kernel->nr,
+                   gemm_get_num_threads());
+        print_both(fp, "Memory: %s\n", buffer_backing_name());
+        print_both(fp, "Timing: median of %d runs after %d warmup (wall clock)\n\n", reps, warmup);
+
+        run_batch_sweep(fp, batch, batch_count, batch_sizes, batch_size_count);
+        check_batch_empty(batch_sizes[0]);
+        int failed = print_checks(fp);
+
+        print_stats(fp);
+        fclose(fp);
+        printf("\nResults saved to %s\n", output);
+        gemm_set_num_threads(1);
+        return failed ? EXIT_FAILURE : 0;
+    }
+
+    // Allocate A (M x K), B (K x N) and C (M x N) as contiguous aligned buffers.
+    // With --save-c the multiply writes straight into a mapped result file.
+    matfile_t file_c;
+    if (save_c && matfile_create(&file_c, save_c, M, N, MATFILE_F64) != 0) {
+        exit(EXIT_FAILURE);
+    }
+    matrix_t A, B, C;
+    setup_matrices(&A, &B, &C, M, K, N, padded, numa_init, load_a ? files : NULL,
+                   save_c ? &file_c : NULL);
+
+    print_both(fp, "Block Matrix Multiplication Performance Analysis\n");
+    print_both(fp, "Matrix size: %d x %d\n", M, N);
+    print_both(fp, "Inner dimension: %d\n", K);
+    print_both(fp, "Row stride: %d (%s)\n", C.ld, padded ? "padded" : "dense");
+    if (load_a) {
+        print_both(fp, "Inputs: %s, %s (mapped in %.3f ms)\n", load_a, load_b, map_ms);
+    }
+    if (save_c) {
+        print_both(fp, "Result: mapped %s\n", save_c);
+    }
+    if (save_prefix) {
+        save_inputs(fp, save_prefix, &A, &B);
+    }
+    print_both(fp, "Memory: %s\n", buffer_backing_name());
+    print_both(fp, "Kernel: %s (%dx%d), threads: %d\n", kernel->name, kernel->mr, kernel->nr,
+               gemm_get_num_threads());
+    print_both(fp, "Caches: L1d %ld KiB, L2 %ld KiB, L3 %ld KiB%s\n", cache->l1d / 1024,
+               cache->l2 / 1024, cache->l3 / 1024, cache->detected ? "" : " (defaults)");
+    print_both(fp, "Auto blocking: MC=%d KC=%d NC=%d\n", auto_blk.mc, auto_blk.kc, auto_blk.nc);
+    print_both(fp, "Threads pinned: %s, NUMA first-touch: %s\n", pin ? "yes" : "no",
+               numa_init ? "parallel" : "serial");
+    print_both(fp, "Timing: median of %d runs after %d warmup (wall clock)\n", reps, warmup);
+    FILE *outs[] = {stdout, fp};
+    for (int o = 0; o < 2; o++) {
+        FILE *out = outs[o];
+        topology_report_buffer(out, "A", A.data, (size_t)A.rows * A.ld * sizeof(double));
+        topology_report_buffer(out, "B", B.data, (size_t)B.rows * B.ld * sizeof(double));
+        topology_report_buffer(out, "C", C.data, (size_t)C.rows * C.ld * sizeof(double));
+    }
+    print_both(fp, "\n");
+    print_both(fp, "Block Size, Time (msec), Bandwidth (MB/s), Speedup, "
+                   "Min (msec), Mean (msec), Stddev (msec), P95 (msec)");
+    print_perf_header(fp);
+
     double standard_time = 0;
-    long long total_ops = 4LL * N * N * N; // Rough traffic estimate: 3 loads + 1 store per multiply-add.
+    long long total_ops = 4LL * M * K * N; // Rough traffic estimate: 3 loads + 1 store per multiply-add.
     long long total_bytes = total_ops * sizeof(double);
-    
-    // Sweep a few block sizes (powers of two).
+
+    // Unblocked reference first, so every row can report a speedup against it.
+    // With --verify reference|both, R is an untimed product of the same loop.
+    matrix_t R = reference_product(&A, &B);
+    timing_stats_t reference = time_multiply(&A, &B, &C, ENGINE_STANDARD, NULL);
+    check_result(&A, &B, &C, &R, 1.0, "Standard (no blocking)");
+
+    // Cache-aware run: independent MC/KC/NC sized for L2/L1/L3.
+    timing_stats_t st = time_multiply(&A, &B, &C, ENGINE_BLOCKED, &auto_blk);
+    check_result(&A, &B, &C, &R, 1.0, "Auto MC=%d KC=%d NC=%d", auto_blk.mc, auto_blk.kc,
+                 auto_blk.nc);
+    double bandwidth = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+    print_both(fp, "Auto MC=%d KC=%d NC=%d, %10.2f, %12.2f, %6.2fx", auto_blk.mc, auto_blk.kc,
+               auto_blk.nc, st.median, bandwidth, reference.median / st.median);
+    print_spread(fp, &st);
+
+    // Same kernel and blocking through a plan: setup paid once, then execute only.
+    gemm_plan_options_t plan_opt = {gemm_get_num_threads(), kernel->name, &auto_blk, pin,
+                                    gemm_get_prefetch_distance()};
+    double plan_start = timing_now();
+    gemm_plan_t *plan = gemm_plan_create(M, K, N, &plan_opt);
+    double plan_setup = (timing_now() - plan_start) * 1000.0;
+    st = time_plan(plan, &A, &B, &C);
+    check_result(&A, &B, &C, &R, 1.0, "Planned");
+    bandwidth = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+    print_both(fp, "Planned (setup %.3f ms), %10.2f, %12.2f, %6.2fx", plan_setup, st.median,
+               bandwidth, reference.median / st.median);
+    print_spread(fp, &st);
+    gemm_plan_destroy(plan);
+
+    // Tuned configuration for this shape, if the cache has one (--tune).
+    const gemm_tune_config_t *tuned = gemm_tune_lookup("double", M, K, N);
+    if (tuned) {
+        char desc[128];
+        gemm_tune_describe(tuned, desc, sizeof(desc));
+        st = time_tuned(tuned, &A, &B, &C);
+        check_result(&A, &B, &C, &R, 1.0, "Tuned %s", desc);
+        bandwidth = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+        print_both(fp, "Tuned %s, %10.2f, %12.2f, %6.2fx", desc, st.median, bandwidth,
+                   reference.median / st.median);
+        print_spread(fp, &st);
+    }
+
+    // Cache-oblivious engine: no block sizes, row-major and Morton storage.
+    int tile = gemm_recursive_tile(kernel);
+    st = time_multiply(&A, &B, &C, ENGINE_RECURSIVE, NULL);
+    check_result(&A, &B, &C, &R, 1.0, "Recursive (base %d)", tile);
+    bandwidth = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+    print_both(fp, "Recursive (base %d), %10.2f, %12.2f, %6.2fx", tile, st.median, bandwidth,
+               reference.median / st.median);
+    print_spread(fp, &st);
+    st = time_morton(&A, &B, &C, tile);
+    check_result(&A, &B, &C, &R, 1.0, "Recursive Morton (tile %d)", tile);
+    bandwidth = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+    print_both(fp, "Recursive Morton (tile %d), %10.2f, %12.2f, %6.2fx", tile, st.median, bandwidth,
+               reference.median / st.median);
+    print_spread(fp, &st);
+
+    // Sweep a few uniform block sizes (powers of two) for comparison.
     int block_sizes[] = {8, 16, 32, 64, 128, 256};
     int num_sizes = sizeof(block_sizes) / sizeof(block_sizes[0]);
-    
+
     for (int bs_idx = 0; bs_idx < num_sizes; bs_idx++) {
         int block_size = block_sizes[bs_idx];
-        
-        // Clear C before each timed run.
-        for (int i = 0; i < N; i++) {
-            for (int j = 0; j < N; j++) {
-                C[i][j] = 0.0;
-            }
-        }
-        
-        // Timing (CPU time via clock()).
-        double start = (double)clock() / CLOCKS_PER_SEC;
-        
-        if (block_size == 512) {
-            // If block_size equals N, the blocked routine degenerates to the unblocked i-k-j order.
-            matrix_multiply_standard(A, B, C, N);
-        } else {
-            matrix_multiply_blocked(A, B, C, N, block_size);
-        }
-        
-        double end = (double)clock() / CLOCKS_PER_SEC;
-        double msec = (end - start) * 1000.0;
-        double bandwidth = total_bytes * (1000.0 / msec) / (1024 * 1024);
-        
+        gemm_blocking_t blk = gemm_blocking_uniform(block_size);
+
+        // If one block covers the whole problem, the blocked routine degenerates
+        // to the unblocked i-k-j order.
+        int whole = block_size >= M && block_size >= N && block_size >= K;
+        st = time_multiply(&A, &B, &C, whole ? ENGINE_STANDARD : ENGINE_BLOCKED, &blk);
+        check_result(&A, &B, &C, &R, 1.0, "Block %d", block_size);
+        bandwidth = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+
         // Keep a baseline to compute speedup (first configuration used as reference here).
-        if (block_size == 512 || bs_idx == 0) {
-            standard_time = msec;
-        }
-        
-        double speedup = standard_time / msec;
-        
-        printf("%4d, %10.2f, %12.2f, %6.2fx\n", block_size, msec, bandwidth, speedup);
-        fprintf(fp, "%4d, %10.2f, %12.2f, %6.2fx\n", block_size, msec, bandwidth, speedup);
-    }
-    
-    // Finally, run the unblocked version once (recorded separately in the output).
-    for (int i = 0; i < N; i++) {
-        for (int j = 0; j < N; j++) {
-            C[i][j] = 0.0;
-        }
-    }
-    
-    double start = (double)clock() / CLOCKS_PER_SEC;
-    matrix_multiply_standard(A, B, C, N);
-    double end = (double)clock() / CLOCKS_PER_SEC;
-    double msec = (end - start) * 1000.0;
-    double bandwidth = total_bytes * (1000.0 / msec) / (1024 * 1024);
-    
-    printf("Standard (no blocking), %10.2f, %12.2f, %6.2fx\n", msec, bandwidth, 1.0);
-    fprintf(fp, "Standard (no blocking), %10.2f, %12.2f, %6.2fx\n", msec, bandwidth, 1.0);
-    
-    fclose(fp);
-    printf("\nResults saved to mxm_bloc_results.txt\n");
-    
-    // Free memory
-    for (int i = 0; i < N; i++) {
-        free(A[i]);
-        free(B[i]);
-        free(C[i]);
-    }
-    free(A);
-    free(B);
-    free(C);
-    
-    return 0;
-}
+        if (whole || bs_idx == 0) {
+            standard_time = st.median;
+        }
+
+        double speedup = standard_time / st.median;
+
+        print_both(fp, "%4d, %10.2f, %12.2f, %6.2fx", block_size, st.median, bandwidth, speedup);
+        print_spread(fp, &st);
+    }
+
+    // Finally, report the unblocked version (recorded separately in the output).
+    bandwidth = total_bytes * (1000.0 / reference.median) / (1024 * 1024);
+    print_both(fp, "Standard (no blocking), %10.2f, %12.2f, %6.2fx", reference.median, bandwidth, 1.0);
+    print_spread(fp, &reference);
+
+    // Software prefetch of B rows at each requested distance (auto blocking),
+    // against the same blocking without prefetch. "PF=" keeps these rows out
+    // of the block-size plot.
+    if (prefetch_count > 0) {
+        print_both(fp, "\nPrefetch (rows of B), Time (msec), Bandwidth (MB/s), Speedup, "
+                       "Min (msec), Mean (msec), Stddev (msec), P95 (msec)");
+        print_perf_header(fp);
+        double base_time = 0;
+        for (int p = -1; p < prefetch_count; p++) {
+            int distance = p < 0 ? 0 : prefetch[p];
+            gemm_set_prefetch_distance(distance);
+            st = time_multiply(&A, &B, &C, ENGINE_BLOCKED, &auto_blk);
+            check_result(&A, &B, &C, &R, 1.0, "PF=%d", distance);
+            if (p < 0) {
+                base_time = st.median;
+            }
+            bandwidth = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+            print_both(fp, "PF=%d, %10.2f, %12.2f, %6.2fx", distance, st.median, bandwidth,
+                       base_time / st.median);
+            print_spread(fp, &st);
+        }
+        gemm_set_prefetch_distance(0);
+    }
+
+    // Strassen-Winograd (square shapes only) down to the crossover, then the
+    // auto-blocked kernel. "Strassen" rows are skipped by the plot script.
+    if (strassen && (M != K || K != N)) {
+        print_both(fp, "\nStrassen: skipped, needs a square shape\n");
+    } else if (strassen) {
+        const char *origin = crossover > 0 ? "--crossover" : "measured";
+        if (crossover <= 0) {
+            crossover = gemm_strassen_crossover();
+        }
+        int levels = gemm_strassen_levels(N, crossover);
+        print_both(fp, "\nStrassen-Winograd: crossover %d (%s), %d level(s)\n", crossover, origin,
+                   levels);
+        print_both(fp, "Engine, Time (msec), Bandwidth (MB/s), Speedup, "
+                       "Min (msec), Mean (msec), Stddev (msec), P95 (msec)");
+        print_perf_header(fp);
+        st = time_strassen(&A, &B, &C, crossover);
+        // Winograd's variant has a normwise bound only, worse by up to a
+        // factor of 18 per level (Higham, Accuracy and Stability, ch. 23).
+        check_result(&A, &B, &C, &R, pow(18.0, levels), "Strassen (crossover %d)", crossover);
+        bandwidth = total_bytes * (1000.0 / st.median) / (1024 * 1024);
+        print_both(fp, "Strassen (crossover %d), %10.2f, %12.2f, %6.2fx", crossover, st.median,
+                   bandwidth, reference.median / st.median);
+        print_spread(fp, &st);
+        report_strassen_error(fp, N, padded, crossover);
+    }
+
+    // Scaling, bias and ReLU inside the multiply (--fused) vs extra passes.
+    if (fused) {
+        run_epilogue(fp, &A, &B, &C, padded);
+    }
+
+    // Tiled multiply per element type (--precision): float and bf16 inputs
+    // halve and quarter the traffic of double, and float doubles the SIMD width.
+    int precision_failed = 0;
+    if (precision_count > 0) {
+        const int orders[] = {GEMM_ORDER_BLOCKED};
+        const char *names[] = {"blocked"};
+        print_both(fp, "\nPrecisions (common/precision.c, single thread):");
+        for (int t = 0; t < precision_count; t++) {
+            gemm_blocking_t pb = gemm_precision_blocking(precision_list[t]);
+            print_both(fp, " %s KC=%d NC=%d%s", precision_list[t]->name, pb.kc, pb.nc,
+                       t + 1 < precision_count ? "," : "\n");
+        }
+        gemm_precision_run_t runs[MAX_PRECISIONS];
+        precision_failed = gemm_precision_benchmark(precision_list, precision_count, orders, 1, M,
+                                                    K, N, padded, warmup, reps, runs);
+        gemm_precision_print(stdout, precision_list, precision_count, names, 1, M, K, N, runs);
+        gemm_precision_print(fp, precision_list, precision_count, names, 1, M, K, N, runs);
+    }
+
+    int failed = print_checks(fp) + precision_failed;
+    print_stats(fp);
+
+    fclose(fp);
+    printf("\nResults saved to %s\n", output);
+
+    // Free memory (C, mapped from --save-c, holds the product of the last timed run)
+    gemm_set_num_threads(1);
+    if (load_a) {
+        matfile_unmap(&files[0]);
+        matfile_unmap(&files[1]);
+    } else {
+        matrix_free(&A);
+        matrix_free(&B);
+    }
+    if (save_c) {
+        matfile_unmap(&file_c);
+        printf("Result written to %s\n", save_c);
+    } else {
+        matrix_free(&C);
+    }
+    matrix_free(&R);
+
+    return failed ? EXIT_FAILURE : 0;
+}
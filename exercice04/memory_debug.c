@@ -1,7 +1,9 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../common/arena.h"
+
 #define SIZE 5
 
 int* allocate_array(int size) {
@@ -28,8 +30,8 @@ void print_array(int *arr, int size) {
     printf("Array elements: ");
     for (int i = 0; i < size; i++) {
         printf("%d ", arr[i]);
-    }
-    printf("\n");
+    }
+    printf("\n");
 }
 
 int* duplicate_array(int *arr, int size) {
@@ -38,9 +40,9 @@ int* duplicate_array(int *arr, int size) {
     int *copy = (int*)malloc(size * sizeof(int));
     if (!copy) {
         fprintf(stderr, "Memory allocation failed\n");
-        exit(EXIT_FAILURE);
-    }
-    memcpy(copy, arr, size * sizeof(int));
+        exit(EXIT_FAILURE);
+    }
+    memcpy(copy, arr, size * sizeof(int));
     return copy;
 }
 
@@ -51,14 +53,49 @@ void free_memory(int *arr) {
     }
 }
 
-int main() {
+// Same steps with the array and its copy taken from a fixed-size pool. Built
+// with -DMEMORY_DEBUG the pool checks itself: --leak skips one pool_put (and
+// pool_destroy lists the block), --double-free returns a block twice (and
+// pool_put stops the program), no Valgrind needed. Other builds refuse both.
+void pool_demo(int leak, int double_free) {
+    pool_t pool;
+    pool_init(&pool, SIZE * sizeof(int), 2);
+    int *array = (int*)pool_get(&pool);
+    initialize_array(array, SIZE);
+    int *array_copy = (int*)pool_get(&pool);
+    memcpy(array_copy, array, SIZE * sizeof(int));
+    print_array(array_copy, SIZE);
+    pool_put(&pool, array);
+    if (double_free) {
+        pool_put(&pool, array);
+    }
+    if (!leak) {
+        pool_put(&pool, array_copy);
+    }
+    printf("Pool: %d block(s) from the heap, %d not returned\n", pool.allocated, pool.outstanding);
+    pool_destroy(&pool);
+}
+
+int main(int argc, char **argv) {
+    int leak = argc > 1 && strcmp(argv[1], "--leak") == 0;
+    int double_free = argc > 1 && strcmp(argv[1], "--double-free") == 0;
+#ifndef MEMORY_DEBUG
+    // Without the checks the pool would take both faults silently (a double
+    // free makes its free list cyclic), so there is nothing to demonstrate.
+    if (leak || double_free) {
+        fprintf(stderr, "%s needs a build with -DMEMORY_DEBUG (see README.md)\n", argv[1]);
+        return EXIT_FAILURE;
+    }
+#endif
     // Allocate → initialize → duplicate → free (Valgrind should report no leaks).
     int *array = allocate_array(SIZE);
     initialize_array(array, SIZE);
     print_array(array, SIZE);
     int *array_copy = duplicate_array(array, SIZE);
-    print_array(array_copy, SIZE);
-    free_memory(array);
-    free_memory(array_copy);
-    return 0; // Memory leaks fixed!
-}
+    print_array(array_copy, SIZE);
+    free_memory(array);
+    free_memory(array_copy);
+
+    pool_demo(leak, double_free);
+    return 0; // Memory leaks fixed!
+}
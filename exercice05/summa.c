@@ -0,0 +1,410 @@
+#include "math.h"
+#include "stdarg.h"
+#include "stdint.h"
+#include "stdio.h"
+#include "stdlib.h"
+#include "string.h"
+
+#include <mpi.h>
+
+#include "../common/gemm.h"
+#include "../common/matrix.h"
+#include "../common/timing.h"
+
+// Distributed C = A * B with SUMMA on a P x Q process grid. A (M x K),
+// B (K x N) and C (M x N) are distributed 2-D block-cyclically with square
+// NB x NB blocks: global block (I, J) lives on process (I mod P, J mod Q).
+// Step kb of SUMMA broadcasts block column kb of A along process rows and
+// block row kb of B along process columns, then every process applies the
+// rank-NB update C_local += A_panel * B_panel with matrix_multiply_blocked.
+// Broadcasts are non-blocking and double-buffered: the panels for step
+// kb + 1 are in flight while step kb is multiplied.
+
+#define DEFAULT_SIZE 2048
+#define DEFAULT_NB 256
+#define CHECK_SAMPLES 64      // C entries each process recomputes for the residual check.
+#define CHECK_THRESHOLD 16.0  // HPL's pass threshold on the scaled residual.
+
+static int warmup = TIMING_DEFAULT_WARMUP;
+static int reps = TIMING_DEFAULT_REPS;
+static int rank = 0;
+
+// Write the same text to stdout and to the results file (rank 0 only).
+static void print_both(FILE *fp, const char *fmt, ...) {
+    if (rank != 0) {
+        return;
+    }
+    va_list args;
+    va_start(args, fmt);
+    vprintf(fmt, args);
+    va_end(args);
+    va_start(args, fmt);
+    vfprintf(fp, fmt, args);
+    va_end(args);
+}
+
+static void usage(const char *prog) {
+    if (rank == 0) {
+        fprintf(stderr, "Usage: mpirun -np P*Q %s [--shape N|MxKxN] [--nb NB] [--grid PxQ] "
+                        "[--threads N] [--no-overlap]\n"
+                        "       [--warmup N] [--reps N] [--output FILE]\n", prog);
+    }
+    MPI_Finalize();
+    exit(EXIT_FAILURE);
+}
+
+typedef struct {
+    int P, Q;          // Process grid.
+    int myrow, mycol;
+    MPI_Comm row;      // Processes of my grid row, ranked by column.
+    MPI_Comm col;      // Processes of my grid column, ranked by row.
+} grid_t;
+
+// Rows (or columns) of an n-long dimension held by process iproc of nprocs
+// (ScaLAPACK's NUMROC).
+static int numroc(int n, int nb, int iproc, int nprocs) {
+    int blocks = n / nb;
+    int count = blocks / nprocs * nb;
+    int extra = blocks % nprocs;
+    if (iproc < extra) {
+        count += nb;
+    } else if (iproc == extra) {
+        count += n % nb;
+    }
+    return count;
+}
+
+// Global index of local index l on process iproc.
+static int global_index(int l, int nb, int iproc, int nprocs) {
+    return (l / nb * nprocs + iproc) * nb + l % nb;
+}
+
+// Deterministic uniform [-1, 1) entry of a global matrix (splitmix64 of the
+// indices), so every process generates its own blocks and can recompute any
+// entry of the product without communication.
+static double entry(uint64_t seed, int i, int j) {
+    uint64_t z = seed + ((uint64_t)i << 32 | (uint32_t)j) * 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return (double)(z >> 11) / (double)(1ull << 52) - 1.0;
+}
+
+#define SEED_A 0x1234
+#define SEED_B 0x5678
+
+// Local matrix that may be empty on some processes (a grid larger than the
+// block count): never ask for a zero-byte buffer.
+static matrix_t local_matrix(int rows, int cols) {
+    matrix_t m = matrix_create(rows > 0 ? rows : 1, cols > 0 ? cols : 1, 0);
+    m.rows = rows;
+    m.cols = cols;
+    m.ld = cols > 0 ? cols : 1;
+    return m;
+}
+
+static void fill_local(matrix_t *m, uint64_t seed, int nb, const grid_t *g) {
+    for (int i = 0; i < m->rows; i++) {
+        int gi = global_index(i, nb, g->myrow, g->P);
+        for (int j = 0; j < m->cols; j++) {
+            MAT(m, i, j) = entry(seed, gi, global_index(j, nb, g->mycol, g->Q));
+        }
+    }
+}
+
+typedef struct {
+    double total;     // Wall time of the multiply on this process.
+    double compute;   // In matrix_multiply_blocked.
+    double wait;      // Blocked in MPI (broadcast time not hidden by compute).
+    double pack;      // Copying the owned panel into the send buffer.
+} summa_times_t;
+
+// Panels of one SUMMA step, received (or packed, on the owner) into one of
+// two buffer pairs.
+typedef struct {
+    matrix_t a;        // m_loc x width.
+    matrix_t b;        // width x n_loc.
+    MPI_Request req[2];
+} panel_t;
+
+static void post_step(int kb, int K, int nb, const grid_t *g, const matrix_t *A,
+                      const matrix_t *B, panel_t *p, int overlap, summa_times_t *t) {
+    int width = K - kb * nb < nb ? K - kb * nb : nb;
+    int owner_col = kb % g->Q, owner_row = kb % g->P;
+    p->a.cols = width;
+    p->a.ld = width;
+    p->b.rows = width;
+
+    double start = timing_now();
+    if (g->mycol == owner_col) {
+        int off = kb / g->Q * nb;
+        for (int i = 0; i < A->rows; i++) {
+            memcpy(&MAT(&p->a, i, 0), &MAT(A, i, off), (size_t)width * sizeof(double));
+        }
+    }
+    if (g->myrow == owner_row) {
+        int off = kb / g->P * nb;
+        for (int i = 0; i < width; i++) {
+            memcpy(&MAT(&p->b, i, 0), &MAT(B, off + i, 0), (size_t)B->cols * sizeof(double));
+        }
+    }
+    t->pack += timing_now() - start;
+
+    int a_count = A->rows * width, b_count = width * B->cols;
+    if (overlap) {
+        MPI_Ibcast(p->a.data, a_count, MPI_DOUBLE, owner_col, g->row, &p->req[0]);
+        MPI_Ibcast(p->b.data, b_count, MPI_DOUBLE, owner_row, g->col, &p->req[1]);
+    } else {
+        start = timing_now();
+        MPI_Bcast(p->a.data, a_count, MPI_DOUBLE, owner_col, g->row);
+        MPI_Bcast(p->b.data, b_count, MPI_DOUBLE, owner_row, g->col);
+        t->wait += timing_now() - start;
+        p->req[0] = p->req[1] = MPI_REQUEST_NULL;
+    }
+}
+
+// C_local += A * B over all K / NB steps.
+static void summa(int K, int nb, const grid_t *g, const matrix_t *A, const matrix_t *B,
+                  matrix_t *C, panel_t panels[2], int overlap, summa_times_t *t) {
+    int steps = (K + nb - 1) / nb;
+    memset(t, 0, sizeof(*t));
+    double start = timing_now();
+    post_step(0, K, nb, g, A, B, &panels[0], overlap, t);
+    for (int kb = 0; kb < steps; kb++) {
+        panel_t *cur = &panels[kb % 2];
+        double w = timing_now();
+        MPI_Waitall(2, cur->req, MPI_STATUSES_IGNORE);
+        t->wait += timing_now() - w;
+
+        // Start the next step's broadcasts before computing this one.
+        if (kb + 1 < steps) {
+            post_step(kb + 1, K, nb, g, A, B, &panels[(kb + 1) % 2], overlap, t);
+        }
+        double c0 = timing_now();
+        if (C->rows > 0 && C->cols > 0) {
+            matrix_multiply_blocked(&cur->a, &cur->b, C, NULL);
+        }
+        t->compute += timing_now() - c0;
+    }
+    t->total = timing_now() - start;
+}
+
+// Recompute CHECK_SAMPLES local entries of C from the generators and return
+// HPL's scaled residual max |C - R| / (eps * K * max|A| * max|B|), with
+// max|A| = max|B| = 1 for these inputs.
+static double local_residual(const matrix_t *C, int K, int nb, const grid_t *g) {
+    double worst = 0.0;
+    if (C->rows == 0 || C->cols == 0) {
+        return 0.0;
+    }
+    for (int s = 0; s < CHECK_SAMPLES; s++) {
+        int i = (int)((uint64_t)(s * 7919 + 13) % C->rows);
+        int j = (int)((uint64_t)(s * 104729 + 7) % C->cols);
+        int gi = global_index(i, nb, g->myrow, g->P), gj = global_index(j, nb, g->mycol, g->Q);
+        double ref = 0.0;
+        for (int k = 0; k < K; k++) {
+            ref += entry(SEED_A, gi, k) * entry(SEED_B, k, gj);
+        }
+        double d = fabs(MAT(C, i, j) - ref);
+        if (d > worst) {
+            worst = d;
+        }
+    }
+    return worst / (2.220446049250313e-16 * K);
+}
+
+static int compare_doubles(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+// Flop rate of the local rank-NB update alone (one process, no MPI), the
+// per-process ceiling the efficiency is measured against.
+static double local_kernel_gflops(int m, int n, int nb) {
+    if (m == 0 || n == 0) {
+        return 0.0;
+    }
+    matrix_t a = matrix_create(m, nb, 0), b = matrix_create(nb, n, 0), c = matrix_create(m, n, 0);
+    matrix_fill_random(&a);
+    matrix_fill_random(&b);
+    matrix_fill(&c, 0.0);
+    matrix_multiply_blocked(&a, &b, &c, NULL);
+    int calls = 0;
+    double start = timing_now(), elapsed;
+    do {
+        matrix_multiply_blocked(&a, &b, &c, NULL);
+        calls++;
+        elapsed = timing_now() - start;
+    } while (elapsed < 0.2);
+    matrix_free(&a);
+    matrix_free(&b);
+    matrix_free(&c);
+    return 2.0 * m * n * nb * calls / elapsed * 1e-9;
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    int nprocs;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+    MPI_Comm_size(MPI_COMM_WORLD, &nprocs);
+
+    int M = DEFAULT_SIZE, K = DEFAULT_SIZE, N = DEFAULT_SIZE, nb = DEFAULT_NB;
+    int P = 0, Q = 0, threads = 1, overlap = 1;
+    const char *output = "summa_results.txt";
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--shape") == 0 && i + 1 < argc) {
+            if (matrix_parse_shape(argv[++i], &M, &K, &N) != 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--nb") == 0 && i + 1 < argc) {
+            nb = atoi(argv[++i]);
+            if (nb <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            char tail;
+            if (sscanf(argv[++i], "%dx%d%c", &P, &Q, &tail) != 2 || P <= 0 || Q <= 0) {
+                usage(argv[0]);
+            }
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--no-overlap") == 0) {
+            overlap = 0;
+        } else if (strcmp(argv[i], "--output") == 0 && i + 1 < argc) {
+            output = argv[++i];
+        } else if (timing_parse_arg(argc, argv, &i, &warmup, &reps)) {
+            continue;
+        } else {
+            usage(argv[0]);
+        }
+    }
+    // As square a grid as the process count allows (P <= Q), unless given.
+    if (P == 0) {
+        int dims[2] = {0, 0};
+        MPI_Dims_create(nprocs, 2, dims);
+        P = dims[1];
+        Q = dims[0];
+    }
+    if (P * Q != nprocs) {
+        if (rank == 0) {
+            fprintf(stderr, "--grid %dx%d needs %d processes, got %d\n", P, Q, P * Q, nprocs);
+        }
+        usage(argv[0]);
+    }
+    gemm_set_num_threads(threads);
+
+    grid_t g;
+    g.P = P;
+    g.Q = Q;
+    g.myrow = rank / Q;
+    g.mycol = rank % Q;
+    MPI_Comm_split(MPI_COMM_WORLD, g.myrow, g.mycol, &g.row);
+    MPI_Comm_split(MPI_COMM_WORLD, g.mycol, g.myrow, &g.col);
+
+    // Local pieces of the block-cyclic distribution.
+    int m_loc = numroc(M, nb, g.myrow, P), n_loc = numroc(N, nb, g.mycol, Q);
+    int ka_loc = numroc(K, nb, g.mycol, Q), kb_loc = numroc(K, nb, g.myrow, P);
+    matrix_t A = local_matrix(m_loc, ka_loc);
+    matrix_t B = local_matrix(kb_loc, n_loc);
+    matrix_t C = local_matrix(m_loc, n_loc);
+    fill_local(&A, SEED_A, nb, &g);
+    fill_local(&B, SEED_B, nb, &g);
+    panel_t panels[2];
+    for (int p = 0; p < 2; p++) {
+        panels[p].a = local_matrix(m_loc, nb);
+        panels[p].b = local_matrix(nb, n_loc);
+    }
+
+    FILE *fp = NULL;
+    if (rank == 0) {
+        fp = fopen(output, "w");
+        if (fp == NULL) {
+            printf("Error opening file!\n");
+            MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+        }
+    }
+    const gemm_kernel_t *kernel = gemm_kernel_select();
+    print_both(fp, "SUMMA Distributed Matrix Multiplication\n");
+    print_both(fp, "Shape: %d x %d x %d, NB %d, grid %d x %d (%d processes), threads/process %d\n",
+               M, K, N, nb, P, Q, nprocs, gemm_get_num_threads());
+    print_both(fp, "Kernel: %s (%dx%d), broadcasts: %s\n", kernel->name, kernel->mr, kernel->nr,
+               overlap ? "non-blocking, overlapped with the next step" : "blocking");
+    print_both(fp, "Timing: median of %d runs after %d warmup (slowest process per run)\n\n",
+               reps, warmup);
+
+    // Per-run times: the slowest process sets the run time, as in HPL.
+    double *runs = (double *)malloc(sizeof(double) * reps);
+    if (!runs) {
+        fprintf(stderr, "Memory allocation failed\n");
+        MPI_Abort(MPI_COMM_WORLD, EXIT_FAILURE);
+    }
+    summa_times_t t, sum = {0, 0, 0, 0};
+    for (int r = -warmup; r < reps; r++) {
+        matrix_fill(&C, 0.0);
+        MPI_Barrier(MPI_COMM_WORLD);
+        summa(K, nb, &g, &A, &B, &C, panels, overlap, &t);
+        double slowest;
+        MPI_Allreduce(&t.total, &slowest, 1, MPI_DOUBLE, MPI_MAX, MPI_COMM_WORLD);
+        if (r >= 0) {
+            runs[r] = slowest;
+            sum.total += t.total;
+            sum.compute += t.compute;
+            sum.wait += t.wait;
+            sum.pack += t.pack;
+        }
+    }
+    qsort(runs, reps, sizeof(double), compare_doubles);
+    double median = runs[reps / 2];
+    double gflops = 2.0 * M * N * (double)K / median * 1e-9;
+
+    // Breakdown averaged over runs, then max and mean over processes.
+    double mine[4] = {sum.total / reps, sum.compute / reps, sum.wait / reps, sum.pack / reps};
+    double worst[4], mean[4];
+    MPI_Reduce(mine, worst, 4, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+    MPI_Reduce(mine, mean, 4, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    // Efficiency against every process running the local update at its
+    // standalone rate (measured per process, then summed).
+    double kernel_rate = local_kernel_gflops(m_loc, n_loc, nb < K ? nb : K), peak;
+    MPI_Reduce(&kernel_rate, &peak, 1, MPI_DOUBLE, MPI_SUM, 0, MPI_COMM_WORLD);
+
+    double residual = local_residual(&C, K, nb, &g), worst_residual;
+    MPI_Reduce(&residual, &worst_residual, 1, MPI_DOUBLE, MPI_MAX, 0, MPI_COMM_WORLD);
+
+    print_both(fp, "T/V            M      K      N     NB     P     Q          Time        Gflops\n");
+    print_both(fp, "--------------------------------------------------------------------------------\n");
+    print_both(fp, "%-8s %6d %6d %6d %6d %5d %5d %13.3f %13.4e\n", overlap ? "WR_SUMMA" : "WR_BCAST",
+               M, K, N, nb, P, Q, median, gflops);
+    print_both(fp, "--------------------------------------------------------------------------------\n");
+    print_both(fp, "Best %.3f s, median %.3f s over %d runs\n", runs[0], median, reps);
+    print_both(fp, "Parallel efficiency: %.1f%% of %.2f GFLOP/s (sum of per-process kernel rates)\n",
+               peak > 0.0 ? 100.0 * gflops / peak : 0.0, peak);
+    print_both(fp, "\nPer process (sec), Max, Mean, Share of mean total\n");
+    const char *names[] = {"Total", "Compute", "Communication wait", "Panel packing"};
+    for (int p = 0; p < 4; p++) {
+        double avg = mean[p] / nprocs;
+        print_both(fp, "%s, %.4f, %.4f, %5.1f%%\n", names[p], worst[p], avg,
+                   mean[0] > 0.0 ? 100.0 * mean[p] / mean[0] : 0.0);
+    }
+    print_both(fp, "\n||C - A*B||_max / (eps * K) = %.4e ...... %s\n", worst_residual,
+               worst_residual < CHECK_THRESHOLD ? "PASSED" : "FAILED");
+
+    if (rank == 0) {
+        fclose(fp);
+        printf("\nResults saved to %s\n", output);
+    }
+
+    free(runs);
+    for (int p = 0; p < 2; p++) {
+        matrix_free(&panels[p].a);
+        matrix_free(&panels[p].b);
+    }
+    matrix_free(&A);
+    matrix_free(&B);
+    matrix_free(&C);
+    gemm_set_num_threads(1);
+    MPI_Comm_free(&g.row);
+    MPI_Comm_free(&g.col);
+    MPI_Finalize();
+    return worst_residual < CHECK_THRESHOLD || rank != 0 ? 0 : EXIT_FAILURE;
+}